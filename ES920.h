@@ -26,6 +26,17 @@
 #include "ES920/Configurator.h"
 #include "ES920/Parser.h"
 #include "ES920/Operator.h"
+#include "ES920/Dispatcher.h"
+#include "ES920/Stats.h"
+#include "ES920/Latency.h"
+#include "ES920/Tracer.h"
+#include "ES920/LinkTable.h"
+#include "ES920/Airtime.h"
+#include "ES920/Batch.h"
+#include "ES920/ExtHeader.h"
+#include "ES920/Compress.h"
+#include "ES920/Message.h"
+#include "ES920/Coroutine.h"
 
 namespace arduino {
 namespace es920 {
@@ -63,21 +74,59 @@ namespace es920 {
         uint32_t sendtime {0};
         StringType senddata {""};
 
-#ifdef OF_VERSION_MAJOR
+#ifndef ARDUINO
         // serial i/f name
         StringType device {""};
 #endif
     };
 
-    template <typename Stream, uint8_t PIN_RST, uint8_t PAYLOAD_SIZE>
+    using ResetCallbackType = std::function<void()>;
+
+    template <typename Stream, uint8_t PIN_RST, uint8_t PAYLOAD_SIZE, typename Clock = DefaultClock, typename Tracer = NoTracer>
     class ES920Base {
     protected:
-        Configurator<Stream> configurator;
-        Operator<Stream, PAYLOAD_SIZE> sender;
-        Parser<Stream, PAYLOAD_SIZE> parser;
+        Configurator<Stream, Tracer> configurator;
+        Operator<Stream, PAYLOAD_SIZE, Tracer> sender;
+        Parser<Stream, PAYLOAD_SIZE, Clock, Tracer> parser;
+        Dispatcher dispatcher;
 
         Stream* stream;
         Config configs;
+        BinaryAlwaysCallbackType bin_always_cb;
+        HeaderCallbackType header_cb;
+        Stats counters;  // counted here, others are collected from components by stats()
+        bool b_configuring {false};  // parse() reads config replies while asynchronous configuration
+        bool b_command_wait {false};  // replies of blocking commands are not delivered to dispatcher
+        uint32_t reply_timeout_ms {10000};  // for sends without timeout
+#ifndef ARDUINO
+        ResetCallbackType reset_trigger;
+#endif
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        FlightRecorder flight_recorder;
+        FlightRecorderCallbackType flight_recorder_cb;
+#endif
+#ifdef ES920_LATENCY_ENABLE
+        LatencyTracker latency_tracker;
+#endif
+#ifdef ES920_LINK_TABLE_ENABLE
+        LinkTable<ES920_LINK_TABLE_SIZE> link_table;
+        uint16_t last_panid {0};  // source of the packet being parsed
+        uint16_t last_ownid {0};
+        bool b_link_seq_index {false};
+#endif
+#ifdef ES920_BATCH_ENABLE
+        BatchBuffer<PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE> batch_buffer;
+        BatchStats batch_counters;
+        uint32_t batch_latency_ms {60000};
+        bool b_batch_inflight {false};
+        bool b_batching {false};  // batched readings are delivered to subscribe(index, cb)
+        struct BatchSubscriber {
+            uint8_t id;
+            BinaryCallbackType cb;
+        };
+        BatchSubscriber batch_subscribers[ES920_BATCH_SUBSCRIBERS];
+        uint8_t n_batch_subscribers {0};
+#endif
 
         const uint32_t wait_reply_ms {200};
         const uint32_t wait_start_ms {200};
@@ -91,18 +140,75 @@ namespace es920 {
         void attach(SerialType& s, const Config& cfg, const bool b_verbose = false) {
             verbose(b_verbose);
             configs = cfg;
+#ifdef ES920_DEDUP_ENABLE
+            if ((configs.format == Format::BINARY) && !configs.rcvid)
+                LOG_WARN("rcvid is disabled, duplicated frames are not dropped (sources are unknown)");
+#endif
             changeBaudRate(s);
             stream = (Stream*)&s;
             configurator.attach(s);
             sender.attach(s);
             parser.attach(s, configs.baudrate);
             parser.clear();
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+            configurator.flightRecorder(&flight_recorder);
+            sender.flightRecorder(&flight_recorder);
+            parser.flightRecorder(&flight_recorder);
+#endif
+            parser.subscribeReply([&](const Reply& r) {
+                counters.countReply(r);
+                Tracer::reply(r);
+#ifdef ES920_LATENCY_ENABLE
+                latency_tracker.replied(Clock::ms());
+#endif
+                if (!b_command_wait) dispatcher.onReply(r);
+            });
+            parser.subscribeHeader([&](const uint16_t pan, const uint16_t own, const int16_t rssi, const bool b_rssi) {
+#ifdef ES920_LINK_TABLE_ENABLE
+                link_table.update(pan, own, rssi, b_rssi, Clock::ms());
+                last_panid = pan;
+                last_ownid = own;
+#endif
+                if (header_cb) header_cb(pan, own, rssi, b_rssi);
+            });
+            // counters, batch unpacking and packet waiters see every accepted packet (also with parse(false))
+            parser.subscribeBinaryFrame([&](const uint8_t index, const uint8_t* data, const size_t size) {
+                counters.countRx(index);
+#ifdef ES920_LINK_TABLE_ENABLE
+                if (b_link_seq_index) link_table.sequence(last_panid, last_ownid, index);
+#endif
+#ifdef ES920_BATCH_ENABLE
+                if (index == ES920_BATCH_INDEX) {
+                    BatchBuffer<PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE>::unpack(data, size, [&](const uint8_t idx, const uint8_t* d, const size_t s) {
+                        counters.countRx(idx);
+                        for (uint8_t i = 0; i < n_batch_subscribers; ++i)
+                            if (batch_subscribers[i].id == idx) batch_subscribers[i].cb(d, s);
+                        dispatcher.onPacket(idx, d, s);
+                    });
+                    return;
+                }
+#endif
+                dispatcher.onPacket(index, data, size);
+            });
+            // user callback for all indexes, called from callbacks of queued packets
+            parser.subscribeBinary([&](const uint8_t index, const uint8_t* data, const size_t size) {
+                if (!bin_always_cb) return;
+#ifdef ES920_BATCH_ENABLE
+                if (index == ES920_BATCH_INDEX) {
+                    BatchBuffer<PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE>::unpack(data, size, [&](const uint8_t idx, const uint8_t* d, const size_t s) {
+                        bin_always_cb(idx, d, s);
+                    });
+                    return;
+                }
+#endif
+                bin_always_cb(index, data, size);
+            });
 #ifdef ARDUINO
             if (isResetPinSelected())
                 pinMode(PIN_RST, OUTPUT);
 #endif
             stream->flush();
-            while (stream->available()) stream->read();
+            while (stream->available()) ES920_READ_BYTE();
         }
 
         template <typename SerialType>
@@ -119,6 +225,7 @@ namespace es920 {
 #endif
             ) {
             attach(s, cfg, b_verbose);
+            dispatcher.abortReplies();
 
 #ifdef ARDUINO
 #ifdef ESP_PLATFORM
@@ -153,11 +260,11 @@ namespace es920 {
                     } else {
                         attach(s, cfg, b_verbose);
                         LOG_ERROR("cannot connect to module! please check wiring");
-                        return false;
+                        return beginFailed();
                     }
                 } else {
                     LOG_ERROR("cannot connect to module! please check wiring");
-                    return false;
+                    return beginFailed();
                 }
             }
 
@@ -170,10 +277,10 @@ namespace es920 {
                     LOG_INFO("successfully entered to configuration mode!");
                     bool b_success = config(s, cfg);
                     if (!b_success) LOG_ERROR("some configuration setting has write error!");
-                    return b_success;
+                    return b_success ? true : beginFailed();
                 } else {
                     LOG_ERROR("failed to enter configuration mode!");
-                    return false;
+                    return beginFailed();
                 }
             }
 
@@ -210,9 +317,9 @@ namespace es920 {
             // finally change baudrate
             LOG_INFO("change to baudrate", configToBaudrate(configs.baudrate));
             success &= baudrate(configs.baudrate);  // baudrate will be changed right after this command
-            wait(100);
+            wait<Clock>(100);
             changeBaudRate(s);
-            wait(100);
+            wait<Clock>(100);
             LOG_INFO("changed baudrate to", configToBaudrate(configs.baudrate));
             LOG_INFO("configuration done, change to operation mode");
 
@@ -224,15 +331,62 @@ namespace es920 {
 
         virtual bool configDeviceSpecificMode(const Config& cfg) = 0;
 
+#ifdef ES920_COROUTINE_ENABLE
+        // same procedure as config() but waits each reply asynchronously
+        // module must be in processor mode, and parse() must be called until the task is done
+        Task<bool> configAsync(const Config cfg) {
+            configs = cfg;
+            b_configuring = true;
+
+            bool success = true;
+
+            success &= co_await configDeviceSpecificModeAsync(cfg);
+
+            // basic configuration (common)
+            success &= co_await commandAsync([&]() { configurator.channel(configs.channel); });
+            success &= co_await commandAsync([&]() { configurator.node(configs.node); });
+            success &= co_await commandAsync([&]() { configurator.format(configs.format); });
+            success &= co_await commandAsync([&]() { configurator.transmode(configs.transmode); });
+
+            // id settings
+            success &= co_await commandAsync([&]() { configurator.panid(configs.panid); });
+            success &= co_await commandAsync([&]() { configurator.ownid(configs.ownid); });
+            success &= co_await commandAsync([&]() { configurator.dstid(configs.dstid); });
+
+            success &= co_await commandAsync([&]() { configurator.ack(configs.ack); });
+            success &= co_await commandAsync([&]() { configurator.retry(configs.retry); });
+            success &= co_await commandAsync([&]() { configurator.power(configs.power); });
+
+            // options
+            success &= co_await commandAsync([&]() { configurator.rssi(configs.rssi); });
+            success &= co_await commandAsync([&]() { configurator.rcvid(configs.rcvid); });
+
+            // finally change baudrate
+            success &= baudrate(configs.baudrate);  // baudrate will be changed right after this command
+            co_await sleepAsync(100);
+            changeBaudRate(*stream);
+            co_await sleepAsync(100);
+            LOG_INFO("changed baudrate to", configToBaudrate(configs.baudrate));
+
+            // change operation mode and save configuration and restart
+            success &= co_await commandAsync([&]() { configurator.operation(configs.operation); });
+            success &= co_await commandAsync([&]() { configurator.save(); });
+            success &= co_await restartAsync();
+
+            b_configuring = false;
+            co_return success;
+        }
+
+        virtual Task<bool> configDeviceSpecificModeAsync(const Config cfg) = 0;
+#endif
+
         // sending data
 
+        // replies are delivered to waiters in order of sends (the reply of send without timeout is skipped)
+        // timeout_ms == 0 : returns without waiting the reply, otherwise blocks until replied
+
         bool send(const StringType& str, const uint32_t timeout_ms = 0) {
-            if (configs.transmode != TransMode::PAYLOAD) {
-                LOG_WARN("TransMode is not matched. Please set PAN ID & OWN ID");
-                return false;
-            }
-            if (!sender.sendPayload(str)) return false;
-            return (timeout_ms != 0) ? parser.detectReplyAscii(timeout_ms) : true;
+            return canWaitReply(timeout_ms != 0) && postPayload(str) && waitSent(timeout_ms);
         }
 
         bool send(const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
@@ -240,21 +394,11 @@ namespace es920 {
         }
 
         bool send(const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
-            if (configs.transmode != TransMode::PAYLOAD) {
-                LOG_WARN("TransMode is not matched. Please set PAN ID & OWN ID");
-                return false;
-            }
-            if (!sender.sendPayload(data, size, index)) return false;
-            return (timeout_ms != 0) ? parser.detectReplyBinary(timeout_ms) : true;
+            return canWaitReply(timeout_ms != 0) && postPayload(index, data, size) && waitSent(timeout_ms);
         }
 
         bool send(const uint16_t pan, const uint16_t own, const StringType& str, const uint32_t timeout_ms = 0) {
-            if (configs.transmode != TransMode::FRAME) {
-                LOG_WARN("TransMode is not matched. Please remove PAN ID & OWN ID");
-                return false;
-            }
-            if (!sender.sendFrame(pan, own, str)) return false;
-            return (timeout_ms != 0) ? parser.detectReplyAscii(timeout_ms) : true;
+            return sendFrame(pan, own, str, FrameRoute(), timeout_ms);
         }
 
         bool send(const uint16_t pan, const uint16_t own, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
@@ -262,35 +406,204 @@ namespace es920 {
         }
 
         bool send(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
-            if (configs.transmode != TransMode::FRAME) {
-                LOG_WARN("TransMode is not matched. Please remove PAN ID & OWN ID");
-                return false;
-            }
-            if (!sender.sendFrame(pan, own, data, size, index)) return false;
-            return (timeout_ms != 0) ? parser.detectReplyBinary(timeout_ms) : true;
+            return sendFrame(pan, own, index, data, size, FrameRoute(), timeout_ms);
+        }
+
+        // unicast to any node in own PAN per message (TransMode::FRAME, no reconfiguration of dstid)
+
+        bool sendTo(const uint16_t dst, const StringType& str, const uint32_t timeout_ms = 0) {
+            return send(configs.panid, dst, str, timeout_ms);
+        }
+
+        bool sendTo(const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
+            return send(configs.panid, dst, index, data, size, timeout_ms);
+        }
+
+        // sending data asynchronously
+        // callback is called with module's reply from parse(), timeout_ms == 0 means replyTimeout()
+
+        bool sendAsync(const StringType& str, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return canWaitReply() && postPayload(str) && waitReplyAsync(cb, timeout_ms);
+        }
+
+        bool sendAsync(const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return canWaitReply() && postPayload(index, data, size) && waitReplyAsync(cb, timeout_ms);
         }
 
+        bool sendAsync(const uint16_t pan, const uint16_t own, const StringType& str, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return canWaitReply() && postFrame(pan, own, str, FrameRoute()) && waitReplyAsync(cb, timeout_ms);
+        }
+
+        bool sendAsync(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return canWaitReply() && postFrame(pan, own, index, data, size, FrameRoute()) && waitReplyAsync(cb, timeout_ms);
+        }
+
+        bool sendToAsync(const uint16_t dst, const StringType& str, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return sendAsync(configs.panid, dst, str, cb, timeout_ms);
+        }
+
+        bool sendToAsync(const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return sendAsync(configs.panid, dst, index, data, size, cb, timeout_ms);
+        }
+
+        // typed messages declared by ES920_MESSAGE(index, fields...) (see Message.h)
+        // false if the encoded message does not fit in a frame
+
+        template <typename T>
+        auto send(const T& msg, const uint32_t timeout_ms = 0) -> decltype(T::es920_message_index(), bool()) {
+            uint8_t buffer[messageCapacity()];
+            const uint8_t size = packMessage(msg, buffer);
+            return size && send(T::es920_message_index(), buffer, size, timeout_ms);
+        }
+
+        template <typename T>
+        auto sendTo(const uint16_t dst, const T& msg, const uint32_t timeout_ms = 0) -> decltype(T::es920_message_index(), bool()) {
+            uint8_t buffer[messageCapacity()];
+            const uint8_t size = packMessage(msg, buffer);
+            return size && sendTo(dst, T::es920_message_index(), buffer, size, timeout_ms);
+        }
+
+        template <typename T>
+        auto sendAsync(const T& msg, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) -> decltype(T::es920_message_index(), bool()) {
+            uint8_t buffer[messageCapacity()];
+            const uint8_t size = packMessage(msg, buffer);
+            return size && sendAsync(T::es920_message_index(), buffer, size, cb, timeout_ms);
+        }
+
+        template <typename T>
+        auto sendToAsync(const uint16_t dst, const T& msg, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) -> decltype(T::es920_message_index(), bool()) {
+            uint8_t buffer[messageCapacity()];
+            const uint8_t size = packMessage(msg, buffer);
+            return size && sendToAsync(dst, T::es920_message_index(), buffer, size, cb, timeout_ms);
+        }
+
+        // wait for next binary packet with index (data == nullptr if timeout)
+        void nextPacket(const uint8_t index, const PacketCallbackType& cb, const uint32_t timeout_ms = 0) {
+            dispatcher.waitPacket(index, Clock::ms(), timeout_ms, cb);
+        }
+
+#ifdef ES920_COROUTINE_ENABLE
+        // co_await-able versions of above, resumed with Reply / Packet from parse()
+
+        Awaitable<Reply> sendAsync(const StringType& str, const uint32_t timeout_ms = 0) {
+            Awaitable<Reply> a;
+            if (!sendAsync(str, [a](const Reply& r) { a.resolve(r); }, timeout_ms)) a.resolve(rejectedReply());
+            return a;
+        }
+
+        Awaitable<Reply> sendAsync(const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
+            Awaitable<Reply> a;
+            if (!sendAsync(index, data, size, [a](const Reply& r) { a.resolve(r); }, timeout_ms)) a.resolve(rejectedReply());
+            return a;
+        }
+
+        Awaitable<Reply> sendAsync(const uint16_t pan, const uint16_t own, const StringType& str, const uint32_t timeout_ms = 0) {
+            Awaitable<Reply> a;
+            if (!sendAsync(pan, own, str, [a](const Reply& r) { a.resolve(r); }, timeout_ms)) a.resolve(rejectedReply());
+            return a;
+        }
+
+        Awaitable<Reply> sendAsync(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
+            Awaitable<Reply> a;
+            if (!sendAsync(pan, own, index, data, size, [a](const Reply& r) { a.resolve(r); }, timeout_ms)) a.resolve(rejectedReply());
+            return a;
+        }
+
+        Awaitable<Reply> sendToAsync(const uint16_t dst, const StringType& str, const uint32_t timeout_ms = 0) {
+            return sendAsync(configs.panid, dst, str, timeout_ms);
+        }
+
+        Awaitable<Reply> sendToAsync(const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
+            return sendAsync(configs.panid, dst, index, data, size, timeout_ms);
+        }
+
+        Awaitable<Packet> nextPacket(const uint8_t index, const uint32_t timeout_ms = 0) {
+            Awaitable<Packet> a;
+            nextPacket(
+                index, [a](const uint8_t idx, const uint8_t* data, const size_t size) {
+                    Packet p;
+                    p.index = idx;
+                    if (data)
+                        p.data.assign(data, data + size);
+                    else
+                        p.b_timeout = true;
+                    a.resolve(p);
+                },
+                timeout_ms);
+            return a;
+        }
+
+        Awaitable<bool> sleepAsync(const uint32_t ms) {
+            Awaitable<bool> a;
+            dispatcher.waitTime(Clock::ms(), ms, [a]() { a.resolve(true); });
+            return a;
+        }
+#endif
+
         // received data management
 
         void subscribe(const uint8_t id, const BinaryCallbackType& cb) {
             parser.subscribeBinary(id, cb);
+#ifdef ES920_BATCH_ENABLE
+            if (!b_batching) return;
+            uint8_t i = 0;
+            while ((i < n_batch_subscribers) && (batch_subscribers[i].id != id)) ++i;
+            if (i == ES920_BATCH_SUBSCRIBERS) {
+                LOG_WARN("too many subscribers for batched readings, increase ES920_BATCH_SUBSCRIBERS");
+                return;
+            }
+            if (i == n_batch_subscribers) ++n_batch_subscribers;
+            batch_subscribers[i] = BatchSubscriber {id, cb};
+#endif
         }
 
         void subscribe(const BinaryAlwaysCallbackType& cb) {
-            parser.subscribeBinary(cb);
+            bin_always_cb = cb;
         }
 
         void subscribe(const AsciiCallbackType& cb) {
             parser.subscribeAscii(cb);
         }
 
+        // typed messages are decoded from the packet buffer, and cb is not called if the packet is too short for T
+        template <typename T>
+        void subscribe(const MessageCallbackType<T>& cb) {
+            subscribe(T::es920_message_index(), [cb](const uint8_t* data, const size_t size) {
+                T msg {};
+                if (decodeMessage(data, size, msg))
+                    cb(msg);
+                else
+                    LOG_WARN("too short message, index = ", (int)T::es920_message_index(), ", size = ", size);
+            });
+        }
+
+        // source and rssi of each received packet (rcvid must be enabled)
+        // callbacks are added (not replaced) so that AdrController, RouteManager, DownlinkQueue and user can listen together
+        void subscribeHeader(const HeaderCallbackType& cb) {
+            if (!cb) return;
+            if (!header_cb) {
+                header_cb = cb;
+                return;
+            }
+            const HeaderCallbackType prev = header_cb;
+            header_cb = [prev, cb](const uint16_t pan, const uint16_t own, const int16_t rssi, const bool b_rssi) {
+                prev(pan, own, rssi, b_rssi);
+                cb(pan, own, rssi, b_rssi);
+            };
+        }
+
         size_t parse(const bool b_exec_cb = true) {
-            if ((configs.operation == Mode::OPERATION) && (configs.format == Format::BINARY))
-                return parser.parseBinary(configs.rssi, configs.rcvid, b_exec_cb);
-            else
-                return parser.parseAscii(configs.rssi, configs.rcvid, b_exec_cb);
+            const size_t n = parseStream(b_exec_cb);
+#ifdef ES920_BATCH_ENABLE
+            if (!b_configuring && !b_batch_inflight && batch_buffer.due(Clock::ms(), batch_latency_ms)) flushBatch();
+#endif
+            return n;
         }
 
+        // reply timeout of sendAsync() and send() without timeout (default 10 sec)
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+        uint32_t replyTimeout() const { return reply_timeout_ms; }
+
         void callback() {
             if ((configs.operation == Mode::OPERATION) && (configs.format == Format::BINARY))
                 return parser.callbackBinary();
@@ -430,7 +743,7 @@ namespace es920 {
 
         bool node(const Node n) {
             configurator.node(n);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.node = n;
                 return true;
             }
@@ -439,7 +752,7 @@ namespace es920 {
 
         bool channel(const uint8_t ch) {
             configurator.channel(ch);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.channel = ch;
                 return true;
             }
@@ -452,7 +765,7 @@ namespace es920 {
                 return false;
             }
             configurator.panid(addr);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.panid = addr;
                 return true;
             }
@@ -472,7 +785,7 @@ namespace es920 {
                 }
             }
             configurator.ownid(addr);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.ownid = addr;
                 return true;
             }
@@ -481,7 +794,7 @@ namespace es920 {
 
         bool dstid(const uint16_t addr) {
             configurator.dstid(addr);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.dstid = addr;
                 return true;
             }
@@ -494,7 +807,7 @@ namespace es920 {
 
         bool ack(const bool b) {
             configurator.ack(b);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.ack = b;
                 return true;
             }
@@ -507,7 +820,7 @@ namespace es920 {
                 return false;
             }
             configurator.retry(i);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.retry = i;
                 return true;
             }
@@ -516,7 +829,7 @@ namespace es920 {
 
         bool transmode(const TransMode m) {
             configurator.transmode(m);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.transmode = m;
                 return true;
             }
@@ -525,7 +838,7 @@ namespace es920 {
 
         bool rcvid(const bool b) {
             configurator.rcvid(b);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.rcvid = b;
                 return true;
             }
@@ -534,7 +847,7 @@ namespace es920 {
 
         bool rssi(const bool b) {
             configurator.rssi(b);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.rssi = b;
                 return true;
             }
@@ -543,7 +856,7 @@ namespace es920 {
 
         bool operation(const Mode m) {
             configurator.operation(m);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.operation = m;
                 return true;
             }
@@ -559,7 +872,7 @@ namespace es920 {
 
         bool sleep(const SleepMode m) {
             configurator.sleep(m);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.sleep = m;
                 return true;
             }
@@ -568,7 +881,7 @@ namespace es920 {
 
         bool sleeptime(const uint32_t ms) {
             configurator.sleeptime(ms);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.sleeptime = ms;
                 return true;
             }
@@ -581,7 +894,7 @@ namespace es920 {
                 return false;
             }
             configurator.power(pwr);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.power = pwr;
                 return true;
             }
@@ -595,22 +908,22 @@ namespace es920 {
 
         bool save() {
             configurator.save();
-            return parser.detectReplyAscii(wait_reply_ms);
+            return waitCommandReply();
         }
 
         bool load() {
             configurator.load();
-            return parser.detectReplyAscii(wait_reply_ms);
+            return waitCommandReply();
         }
 
         bool start() {
             configurator.start();
-            return parser.detectReplyAscii(wait_reply_ms);
+            return waitCommandReply();
         }
 
         bool format(const Format f) {
             configurator.format(f);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.format = f;
                 return true;
             }
@@ -619,7 +932,7 @@ namespace es920 {
 
         bool sendtime(const uint32_t sec) {
             configurator.sendtime(sec);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.sendtime = sec;
                 return true;
             }
@@ -632,7 +945,7 @@ namespace es920 {
                 return false;
             }
             configurator.senddata(str);
-            if (parser.detectReplyAscii(wait_reply_ms)) {
+            if (waitCommandReply()) {
                 configs.senddata = str;
                 return true;
             }
@@ -641,6 +954,11 @@ namespace es920 {
 
         // get internal variables
 
+        // max binary data size which can be sent at once (without header, index, size, footer)
+        static constexpr uint8_t payloadSize() { return PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE; }
+        // max frame size of module (PAYLOAD_SIZE_ES920 / PAYLOAD_SIZE_ES920LR), identifies the model
+        static constexpr uint8_t modulePayloadSize() { return PAYLOAD_SIZE; }
+
         const Config& getConfigs() const { return configs; }
         Node node() const { return configs.node; }
         uint8_t channel() const { return configs.channel; }
@@ -668,15 +986,126 @@ namespace es920 {
             stream->flush();
             while (stream->available()) ES920_READ_BYTE();
             parser.clear();
+            dispatcher.abortReplies();
+#ifdef ES920_LATENCY_ENABLE
+            latency_tracker.abandon();
+#endif
             reset(false);
             LOG_INFO("reset signal trigger done");
 #else
             stream->flush();
             while (stream->available()) ES920_READ_BYTE();
             parser.clear();
-            PRINTLN("please push reset button");
-            wait(wait_reset_manual_ms);
+            dispatcher.abortReplies();
+#ifdef ES920_LATENCY_ENABLE
+            latency_tracker.abandon();
+#endif
+            if (reset_trigger) {
+                reset_trigger();
+                LOG_INFO("reset trigger done");
+            } else {
+                PRINTLN("please push reset button");
+                wait<Clock>(wait_reset_manual_ms);
+            }
+#endif
+        }
+
+#ifndef ARDUINO
+        // reset module from host (e.g. gpio via sysfs, DTR line or virtual module) instead of reset button
+        void resetTrigger(const ResetCallbackType& cb) { reset_trigger = cb; }
+#endif
+
+#ifdef ES920_LATENCY_ENABLE
+        // send -> OK / NG latency per TransMode and per destination (ownid of receiver)
+        const LatencyTracker& latency() const { return latency_tracker; }
+        void resetLatency() { latency_tracker.clear(); }
+#endif
+
+#ifdef ES920_LINK_TABLE_ENABLE
+        // rssi, packet rate, last seen time and loss of each node (rcvid must be enabled)
+        const LinkTable<ES920_LINK_TABLE_SIZE>& links() const { return link_table; }
+        LinkTable<ES920_LINK_TABLE_SIZE>& links() { return link_table; }
+        // treat binary index as 8 bit rolling sequence of each node to estimate loss
+        void linkSequenceFromIndex(const bool b) { b_link_seq_index = b; }
+#endif
+
+#ifdef ES920_BATCH_ENABLE
+        // buffers a reading and sends it with others in a packed frame from parse()
+        // (when readings exceed a frame or the oldest one waited batchLatency()), false if buffer is full
+        bool sendBatched(const uint8_t index, const uint8_t* data, const uint8_t size) {
+            const bool b = batch_buffer.push(index, data, size, Clock::ms());
+            if (b) {
+                ++batch_counters.readings;
+                batch_counters.unbatched_airtime_us += airtimeUs(size + 2);
+            } else
+                ++batch_counters.rejected;
+            return b;
+        }
+
+        // sends buffered readings now (one packed frame per reply, waits replyTimeout() for the reply)
+        bool flushBatch() {
+            if (b_batch_inflight || (batch_buffer.size() == 0)) return false;
+            uint8_t frame[PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE];
+            const uint8_t size = batch_buffer.pack(frame);
+            const ReplyCallbackType cb = [&](const Reply& r) {
+                b_batch_inflight = false;
+                if (!r.success()) ++batch_counters.failed;
+                // rest of buffer is sent from parse() when it is due
+            };
+            const bool b = (configs.transmode == TransMode::FRAME)
+                             ? sendAsync(configs.panid, configs.dstid, ES920_BATCH_INDEX, frame, size, cb, 0)
+                             : sendAsync(ES920_BATCH_INDEX, frame, size, cb, 0);
+            if (!b) {
+                ++batch_counters.failed;
+                return false;
+            }
+            b_batch_inflight = true;
+            ++batch_counters.packets;
+            batch_counters.airtime_us += airtimeUs(size + 2);
+            return true;
+        }
+
+        // receiver : batched readings are delivered to subscribe(index, cb) called after batching(true)
+        void batching(const bool b) { b_batching = b; }
+        bool batching() const { return b_batching; }
+
+        // max time a reading waits in buffer
+        void batchLatency(const uint32_t ms) { batch_latency_ms = ms; }
+        uint16_t batched() const { return batch_buffer.size(); }
+        const BatchStats& batchStats() const { return batch_counters; }
+        void resetBatchStats() { batch_counters.clear(); }
 #endif
+
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        // last raw bytes and parse events (recorded without ES920_DEBUGLOG_ENABLE)
+        const FlightRecorder& flightRecorder() const { return flight_recorder; }
+        // called when begin() fails or errorCount() increases in parse(), e.g. to dump the recorder
+        void flightRecorderTrigger(const FlightRecorderCallbackType& cb) { flight_recorder_cb = cb; }
+#endif
+
+        // snapshot of runtime counters (bytes, packets, replies, resyncs, queue high-water marks)
+        Stats stats() const {
+            Stats s = counters;
+            configurator.stats(s);
+            sender.stats(s);
+            parser.stats(s);
+            dispatcher.stats(s);
+            return s;
+        }
+
+        void resetStats() {
+            counters.clear();
+            configurator.resetStats();
+            sender.resetStats();
+            parser.resetStats();
+            dispatcher.resetStats();
+        }
+
+        // observe raw bytes read from / written to module (e.g. CaptureWriter)
+        void tap(const TapCallbackType& cb) {
+            configurator.tap(cb);
+            sender.tap(cb);
+            parser.tap(cb);
         }
 
         // for debug
@@ -685,34 +1114,194 @@ namespace es920 {
         bool verbose() const { return LOG_GET_LEVEL() == DebugLogLevel::LVL_INFO; }
 #endif
 
+    protected:
+        bool sendFrame(const uint16_t pan, const uint16_t own, const StringType& str, const FrameRoute& route, const uint32_t timeout_ms) {
+            return canWaitReply(timeout_ms != 0) && postFrame(pan, own, str, route) && waitSent(timeout_ms);
+        }
+
+        bool sendFrame(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const FrameRoute& route, const uint32_t timeout_ms) {
+            return canWaitReply(timeout_ms != 0) && postFrame(pan, own, index, data, size, route) && waitSent(timeout_ms);
+        }
+
+        // writes data to module without queueing a reply waiter
+
+        bool postPayload(const StringType& str) {
+            if (configs.transmode != TransMode::PAYLOAD) {
+                LOG_WARN("TransMode is not matched. Please set PAN ID & OWN ID");
+                return false;
+            }
+            if (!sender.sendPayload(str)) return false;
+            counters.countTx(0);
+            sent(configs.dstid);
+            return true;
+        }
+
+        bool postPayload(const uint8_t index, const uint8_t* data, const uint8_t size) {
+            if (configs.transmode != TransMode::PAYLOAD) {
+                LOG_WARN("TransMode is not matched. Please set PAN ID & OWN ID");
+                return false;
+            }
+            if (!sender.sendPayload(data, size, index)) return false;
+            counters.countTx(index);
+            sent(configs.dstid);
+            return true;
+        }
+
+        bool postFrame(const uint16_t pan, const uint16_t own, const StringType& str, const FrameRoute& route) {
+            if (configs.transmode != TransMode::FRAME) {
+                LOG_WARN("TransMode is not matched. Please remove PAN ID & OWN ID");
+                return false;
+            }
+            if (!sender.sendFrame(pan, own, str, route)) return false;
+            counters.countTx(0);
+            sent(own);
+            return true;
+        }
+
+        bool postFrame(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const FrameRoute& route) {
+            if (configs.transmode != TransMode::FRAME) {
+                LOG_WARN("TransMode is not matched. Please remove PAN ID & OWN ID");
+                return false;
+            }
+            if (!sender.sendFrame(pan, own, data, size, index, route)) return false;
+            counters.countTx(index);
+            sent(own);
+            return true;
+        }
+
+        // sends which wait for the reply are refused (nothing is written) while the queue of waiters is full
+        bool canWaitReply(const bool b_wait = true) const {
+            if (!b_wait || dispatcher.canWaitReply()) return true;
+            LOG_WARN("too many reply waiters, send is refused");
+            return false;
+        }
+
+        bool waitReplyAsync(const ReplyCallbackType& cb, const uint32_t timeout_ms) {
+            dispatcher.waitReply(Clock::ms(), (timeout_ms != 0) ? timeout_ms : reply_timeout_ms, cb);
+            return true;
+        }
+
+        // parses received bytes and resolves waiters (without sending anything)
+        size_t parseStream(const bool b_exec_cb) {
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+            const size_t n_errors = errorCount();
+#endif
+            size_t n = 0;
+            if (b_configuring)
+                n = parser.parseAscii(false, false, b_exec_cb);
+            else if ((configs.operation == Mode::OPERATION) && (configs.format == Format::BINARY))
+                n = parser.parseBinary(configs.rssi, configs.rcvid, b_exec_cb);
+            else
+                n = parser.parseAscii(configs.rssi, configs.rcvid, b_exec_cb);
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+            if ((errorCount() > n_errors) && flight_recorder_cb) flight_recorder_cb(flight_recorder);
+#endif
+            dispatcher.poll(Clock::ms());
+            return n;
+        }
+
+        // blocks until the reply of the last send (replies of previous sends are delivered to their waiters)
+        bool waitSent(const uint32_t timeout_ms) {
+            if (timeout_ms == 0) {
+                dispatcher.expectReply(Clock::ms(), reply_timeout_ms);
+                return true;
+            }
+            bool b_done = false;
+            bool b_success = false;
+            dispatcher.waitReply(Clock::ms(), timeout_ms, [&](const Reply& r) {
+                b_done = true;
+                b_success = r.success();
+            });
+            while (!b_done) {
+                parseStream(true);
+                if (!b_done) Clock::idle();
+            }
+            return b_success;
+        }
+
+        // commands are only sent in blocking way, their replies are not delivered to dispatcher
+        bool waitCommandReply() {
+            b_command_wait = true;
+            const bool b = parser.detectReplyAscii(wait_reply_ms);
+            b_command_wait = false;
+            return b;
+        }
+
+        // enter config mode, write only some settings, then save and restart
+        // (shorter downtime than begin() which writes all settings)
+        template <typename Commands>
+        bool reconfigure(const Commands& commands) {
+            dispatcher.abortReplies();
+            if (!autoProcedureFromAnywhereToConfigMode(10000)) {
+                LOG_ERROR("failed to enter configuration mode!");
+                return reconfigureFailed();
+            }
+            bool b_success = commands();
+            if (!b_success) LOG_ERROR("some configuration setting has write error!");
+            b_success &= autoProcedureSaveAndRestart(10000);
+            return b_success ? true : reconfigureFailed();
+        }
+
     private:
         bool isResetPinSelected() const { return (PIN_RST != 0xFF); }
 
+        // compressed messages can exceed payloadSize()
+        static constexpr uint8_t messageCapacity() {
+#ifdef ES920_COMPRESS_ENABLE
+            return (ES920_COMPRESS_MAX_SIZE > payloadSize()) ? ES920_COMPRESS_MAX_SIZE : payloadSize();
+#else
+            return payloadSize();
+#endif
+        }
+
+        // returns encoded size, 0 if msg does not fit
+        template <typename T>
+        static uint8_t packMessage(const T& msg, uint8_t* buffer) {
+            const size_t size = encodeMessage(msg, buffer, messageCapacity());
+            if (size == 0) LOG_WARN("too long message, index = ", (int)T::es920_message_index(), ", must be <= ", messageCapacity());
+            return (uint8_t)size;
+        }
+
+        uint32_t airtimeUs(const size_t size) const {
+            return airtime::airUs(PAYLOAD_SIZE == PAYLOAD_SIZE_ES920LR, configs.rate, configs.sf, configs.bw, size);
+        }
+
+        void sent(const uint16_t dst) {
+#ifdef ES920_LATENCY_ENABLE
+            latency_tracker.sent(Clock::ms(), configs.transmode, dst);
+#else
+            (void)dst;
+#endif
+        }
+
+        bool beginFailed() {
+            return failed(FlightEvent::BEGIN_FAILED);
+        }
+
+        bool reconfigureFailed() {
+            return failed(FlightEvent::RECONFIGURE_FAILED);
+        }
+
+        bool failed(const FlightEvent e) {
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+            flight_recorder.record(e, 0);
+            if (flight_recorder_cb) flight_recorder_cb(flight_recorder);
+#else
+            (void)e;
+#endif
+            return false;
+        }
+
         uint32_t configToBaudrate(const Baudrate b) {
-            switch (b) {
-                case Baudrate::BD_9600:
-                    return 9600;
-                case Baudrate::BD_19200:
-                    return 19200;
-                case Baudrate::BD_38400:
-                    return 38400;
-                case Baudrate::BD_57600:
-                    return 57600;
-                case Baudrate::BD_115200:
-                    return 115200;
-                case Baudrate::BD_230400:
-                    return 230400;
-                default:
-                    return 115200;
-            }
+            return toBaudrate(b);
         }
 
         // utility to change operation and config mode
 
         bool autoProcedureFromAnywhereToConfigMode(const uint32_t timeout_ms) {
-            uint32_t start_ms = ELAPSED_TIME_MS();
+            uint32_t start_ms = Clock::ms();
 
-            while (ELAPSED_TIME_MS() < start_ms + timeout_ms) {
+            while (Clock::ms() - start_ms < timeout_ms) {
                 // reset to detect current mode
                 while (1) {
                     reset();
@@ -749,9 +1338,9 @@ namespace es920 {
             else
                 start();
 
-            uint32_t start_ms = ELAPSED_TIME_MS();
+            uint32_t start_ms = Clock::ms();
 
-            while (ELAPSED_TIME_MS() < start_ms + timeout_ms) {
+            while (Clock::ms() - start_ms < timeout_ms) {
                 // reset to change to operation mode
                 reset();
 
@@ -780,6 +1369,69 @@ namespace es920 {
             }
         }
 
+#ifdef ES920_COROUTINE_ENABLE
+    protected:
+        // utility for asynchronous configuration
+
+        static Reply rejectedReply() {
+            Reply r;
+            r.b_rejected = true;
+            return r;
+        }
+
+        template <typename WriteCommand>
+        Awaitable<bool> commandAsync(const WriteCommand& write) {
+            Awaitable<bool> a;
+            dispatcher.waitReply(Clock::ms(), wait_reply_ms, [a](const Reply& r) { a.resolve(r.success()); });
+            write();
+            return a;
+        }
+
+        Task<bool> restartAsync() {
+            stream->flush();
+            while (stream->available()) ES920_READ_BYTE();
+            parser.clear();
+            dispatcher.abortReplies();
+#ifdef ES920_LATENCY_ENABLE
+            latency_tracker.abandon();
+#endif
+            if (reset_trigger)
+                reset_trigger();
+            else
+                PRINTLN("please push reset button");
+
+            // wait reset message, then wakeup message tells current mode
+            const uint32_t wait_ms = reset_trigger ? wait_reset_ms : (wait_reset_manual_ms + wait_reset_ms);
+            uint32_t start_ms = Clock::ms();
+            while (!parser.hasReset()) {
+                if (Clock::ms() - start_ms >= wait_ms) {
+                    LOG_ERROR("reset has not been detected");
+                    co_return false;
+                }
+                co_await sleepAsync(0);
+            }
+
+            Mode m = Mode::OPERATION;
+            start_ms = Clock::ms();
+            while (Clock::ms() - start_ms < wait_start_ms) {
+                if (parser.hasWakeup()) {
+                    m = parser.detectedMode();
+                    break;
+                }
+                co_await sleepAsync(0);
+            }
+
+            if (m != configs.operation) {
+                LOG_ERROR("operation mode is not expected!");
+                co_return false;
+            }
+            LOG_INFO("operation mode change success!");
+            co_return true;
+        }
+
+    private:
+#endif
+
         // utility to manage special reply (especially in boot sequence)
 
         bool detectReset() {
@@ -792,14 +1444,14 @@ namespace es920 {
 
         bool selectProcessorMode() {
             configurator.selectProcessorMode();
-            return parser.detectReplyAscii(wait_reply_ms);
+            return waitCommandReply();
         }
 
         void fromOperationToConfigTrigger() {
             StringType cmd = "config\r\n";
             ES920_WRITE_BYTES(cmd.c_str(), ES920_STRING_SIZE(cmd));
             LOG_INFO("from operation to config : ", cmd);
-            wait(wait_config_trigger_ms);
+            wait<Clock>(wait_config_trigger_ms);
         }
 
 #ifdef ARDUINO
@@ -820,15 +1472,15 @@ namespace es920 {
             ES920_SERIAL_END(s);
             ES920_SERIAL_BEGIN(s, configToBaudrate(configs.baudrate));
 #endif
-#elif defined OF_VERSION_MAJOR
+#else
             ES920_SERIAL_END(s);
             ES920_SERIAL_BEGIN(s, configs.device, configToBaudrate(configs.baudrate));
 #endif
         }
     };
 
-    template <typename Stream, uint8_t PIN_RST = 0xFF>
-    class ES920_ : public ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920> {
+    template <typename Stream, uint8_t PIN_RST = 0xFF, typename Clock = DefaultClock, typename Tracer = NoTracer>
+    class ES920_ : public ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920, Clock, Tracer> {
     public:
         bool hopcount(const uint8_t i) {
             if ((i < 1) || (i > 4)) {
@@ -836,7 +1488,7 @@ namespace es920 {
                 return false;
             }
             this->configurator.hopcount(i);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool endid(const uint16_t addr) {
@@ -845,7 +1497,7 @@ namespace es920 {
                 return false;
             }
             this->configurator.endid(addr);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool route1(const uint16_t addr) {
@@ -854,7 +1506,7 @@ namespace es920 {
                 return false;
             }
             this->configurator.route1(addr);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool route2(const uint16_t addr) {
@@ -863,7 +1515,7 @@ namespace es920 {
                 return false;
             }
             this->configurator.route2(addr);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool route3(const uint16_t addr) {
@@ -872,12 +1524,54 @@ namespace es920 {
                 return false;
             }
             this->configurator.route3(addr);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool rate(const Rate r) {
             this->configurator.rate(r);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
+        }
+
+        using ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920, Clock, Tracer>::sendTo;
+        using ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920, Clock, Tracer>::sendToAsync;
+
+        // unicast over relays given per message (TransMode::FRAME)
+
+        bool sendTo(const uint16_t dst, const FrameRoute& route, const StringType& str, const uint32_t timeout_ms = 0) {
+            return this->sendFrame(this->configs.panid, dst, str, route, timeout_ms);
+        }
+
+        bool sendTo(const uint16_t dst, const FrameRoute& route, const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t timeout_ms = 0) {
+            return this->sendFrame(this->configs.panid, dst, index, data, size, route, timeout_ms);
+        }
+
+        bool sendToAsync(const uint16_t dst, const FrameRoute& route, const StringType& str, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return this->canWaitReply() && this->postFrame(this->configs.panid, dst, str, route) && this->waitReplyAsync(cb, timeout_ms);
+        }
+
+        bool sendToAsync(const uint16_t dst, const FrameRoute& route, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms = 0) {
+            return this->canWaitReply() && this->postFrame(this->configs.panid, dst, index, data, size, route) && this->waitReplyAsync(cb, timeout_ms);
+        }
+
+        // change only multihop route (hopcount : 1 - 4, unused routes are ignored by module)
+        bool route(const uint8_t hops, const uint16_t end, const uint16_t r1 = 0x0001, const uint16_t r2 = 0x0001, const uint16_t r3 = 0x0001) {
+            const bool b = this->reconfigure([&]() {
+                bool success = true;
+                success &= hopcount(hops);
+                success &= endid(end);
+                success &= route1(r1);
+                success &= route2(r2);
+                success &= route3(r3);
+                return success;
+            });
+            if (b) {
+                this->configs.hopcount = hops;
+                this->configs.endid = end;
+                this->configs.route1 = r1;
+                this->configs.route2 = r2;
+                this->configs.route3 = r3;
+            }
+            return b;
         }
 
         uint8_t hopcount() const { return this->configs.hopcount; }
@@ -886,6 +1580,8 @@ namespace es920 {
         uint16_t route2() const { return this->configs.route2; }
         uint16_t route3() const { return this->configs.route3; }
         Rate rate() const { return this->configs.rate; }
+        // number of selectable channels for current rate
+        uint8_t channels() const { return channelCount(this->configs.rate); }
 
     private:
         virtual bool configDeviceSpecificMode(const Config& cfg) override {
@@ -899,6 +1595,19 @@ namespace es920 {
             return b;
         }
 
+#ifdef ES920_COROUTINE_ENABLE
+        virtual Task<bool> configDeviceSpecificModeAsync(const Config cfg) override {
+            bool b = true;
+            b &= co_await this->commandAsync([&]() { this->configurator.rate(cfg.rate); });
+            b &= co_await this->commandAsync([&]() { this->configurator.hopcount(cfg.hopcount); });
+            b &= co_await this->commandAsync([&]() { this->configurator.endid(cfg.endid); });
+            b &= co_await this->commandAsync([&]() { this->configurator.route1(cfg.route1); });
+            b &= co_await this->commandAsync([&]() { this->configurator.route2(cfg.route2); });
+            b &= co_await this->commandAsync([&]() { this->configurator.route3(cfg.route3); });
+            co_return b;
+        }
+#endif
+
         // inline uint32_t lagUs()
         // {
         //     if (this->configs.format == Format::ASCII)
@@ -929,21 +1638,23 @@ namespace es920 {
         // }
     };
 
-    template <typename Stream, uint8_t PIN_RST = 0xFF>
-    struct ES920LR_ : public ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920LR> {
+    template <typename Stream, uint8_t PIN_RST = 0xFF, typename Clock = DefaultClock, typename Tracer = NoTracer>
+    struct ES920LR_ : public ES920Base<Stream, PIN_RST, PAYLOAD_SIZE_ES920LR, Clock, Tracer> {
     public:
         bool bandwidth(const BW bw) {
             this->configurator.bandwidth(bw);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         bool spreadingfactor(const SF sf) {
             this->configurator.spreadingfactor(sf);
-            return this->parser.detectReplyAscii(this->wait_reply_ms);
+            return this->waitCommandReply();
         }
 
         BW bandwidth() const { return this->configs.bw; }
         SF spreadingfactor() const { return this->configs.sf; }
+        // number of selectable channels for current bandwidth
+        uint8_t channels() const { return channelCount(this->configs.bw); }
 
     private:
         virtual bool configDeviceSpecificMode(const Config& cfg) override {
@@ -952,6 +1663,15 @@ namespace es920 {
             b &= spreadingfactor(cfg.sf);
             return b;
         }
+
+#ifdef ES920_COROUTINE_ENABLE
+        virtual Task<bool> configDeviceSpecificModeAsync(const Config cfg) override {
+            bool b = true;
+            b &= co_await this->commandAsync([&]() { this->configurator.bandwidth(cfg.bw); });
+            b &= co_await this->commandAsync([&]() { this->configurator.spreadingfactor(cfg.sf); });
+            co_return b;
+        }
+#endif
     };
 
 #ifdef ARDUINO
@@ -959,7 +1679,7 @@ namespace es920 {
     using ES920 = ES920_<Stream, PIN_RST>;
     template <uint8_t PIN_RST = 0xFF>
     using ES920LR = ES920LR_<Stream, PIN_RST>;
-#else
+#elif defined(OF_VERSION_MAJOR)
     using ES920 = ES920_<ofSerial>;
     using ES920LR = ES920LR_<ofSerial>;
 #endif
@@ -967,6 +1687,22 @@ namespace es920 {
 }  // namespace es920
 }  // namespace arduino
 
+#include "ES920/Adr.h"
+#include "ES920/ChannelScan.h"
+#include "ES920/Route.h"
+#include "ES920/Downlink.h"
+#include "ES920/Transfer.h"
+#include "ES920/Fec.h"
+
+#ifndef ARDUINO
+#include "ES920/PosixSerial.h"
+#include "ES920/Gateway.h"
+#include "ES920/BondedLink.h"
+#include "ES920/Emulator.h"
+#include "ES920/Simulator.h"
+#include "ES920/Capture.h"
+#endif
+
 namespace ES920 = arduino::es920;
 
 #include <DebugLogRestoreState.h>
@@ -0,0 +1,324 @@
+#pragma once
+#ifndef ARDUINO_ES920_ADR_H
+#define ARDUINO_ES920_ADR_H
+
+// adaptive data rate for a pair of ES920LR_ (coordinator and end device) in binary format
+// coordinator watches rssi of packets from end device and its own ack loss (NG 103),
+// then chooses the fastest SF / BW which keeps link margin and target loss rate
+// both sides switch together through control messages on a reserved binary index
+//
+// REQUEST : [1][seq][sf][bw][delay ms (2 bytes, little endian)]  coordinator -> end device
+// ACCEPT  : [2][seq][sf][bw]                                      end device -> coordinator
+// CONFIRM : [3][seq][sf][bw]                                      end device -> coordinator (new setting)
+//
+// end device switches delay ms after sending ACCEPT, coordinator delay ms after receiving it
+// if CONFIRM does not arrive in fallback_ms (or is not acked), both sides return to the previous setting
+// rssi, rcvid and ack must be enabled
+
+#include <math.h>
+#include "Constants.h"
+#include "Utils.h"
+#include "Airtime.h"
+
+namespace arduino {
+namespace es920 {
+
+    struct AdrSetting {
+        SF sf {SF::SF_7};
+        BW bw {BW::BW_125_KHZ};
+
+        bool operator==(const AdrSetting& o) const { return (sf == o.sf) && (bw == o.bw); }
+        bool operator!=(const AdrSetting& o) const { return !(*this == o); }
+
+        // LoRa bitrate with coding rate 4/5
+        float bitrate() const {
+            return (float)(uint8_t)sf * (float)airtime::bandwidthHz(bw) / (float)(1UL << (uint8_t)sf) * 0.8f;
+        }
+
+        // approx. receiver sensitivity [dBm] : -174 + 10 log10(BW) + NF (6 dB) + required SNR
+        float sensitivity() const {
+            const float snr = -5.f - 2.5f * (float)((uint8_t)sf - 6);
+            return -174.f + 10.f * log10f((float)airtime::bandwidthHz(bw)) + 6.f + snr;
+        }
+    };
+
+    template <typename Radio, typename SerialType, typename Clock = DefaultClock>
+    class AdrController {
+    public:
+        enum class Role : uint8_t {
+            COORDINATOR,
+            ENDDEVICE
+        };
+
+    private:
+        enum class MessageType : uint8_t {
+            REQUEST = 1,
+            ACCEPT,
+            CONFIRM
+        };
+
+        enum class State : uint8_t {
+            IDLE,
+            REQUESTED,   // coordinator : waiting ACCEPT
+            SWITCHING,   // waiting switchover time
+            CONFIRMING,  // switched, waiting CONFIRM (coordinator) or its ack (end device)
+        };
+
+        Radio& radio;
+        SerialType& serial;
+        Role role;
+        uint8_t index;
+
+        State state {State::IDLE};
+        uint8_t seq {0};
+        AdrSetting target;
+        AdrSetting previous;
+        uint32_t state_ms {0};
+        uint32_t switch_ms {0};
+        uint32_t changed_ms {0};
+        uint32_t confirm_sent_ms {0};
+        bool b_confirm_pending {false};
+
+        // observations of coordinator
+        float rssi_ewma {0.f};
+        bool b_rssi {false};
+        uint32_t prev_ok {0};
+        uint32_t prev_missing_ack {0};
+        float blocked_bitrate {0.f};  // settings at or above this bitrate are not chosen until blocked_until_ms
+        uint32_t blocked_until_ms {0};
+
+        // parameters
+        float margin_db {10.f};
+        float target_loss {0.1f};
+        uint32_t hold_ms {60000};
+        uint32_t window {20};
+        uint16_t delay_ms {500};
+        uint32_t request_timeout_ms {3000};
+        uint32_t fallback_ms {30000};
+        uint32_t block_ms {600000};
+        uint32_t confirm_interval_ms {1000};
+
+        size_t n_switches {0};
+        size_t n_fallbacks {0};
+
+    public:
+        // index is reserved for control messages
+        AdrController(Radio& r, SerialType& s, const Role rl, const uint8_t idx = 0xF0)
+        : radio(r), serial(s), role(rl), index(idx) {
+            radio.subscribe(index, [&](const uint8_t* data, const size_t size) {
+                receive(data, size);
+            });
+            if (role == Role::COORDINATOR) {
+                radio.subscribeHeader([&](const uint16_t, const uint16_t own, const int16_t rssi, const bool b) {
+                    if (!b || (own != radio.dstid())) return;
+                    rssi_ewma = b_rssi ? (rssi_ewma + ((float)rssi - rssi_ewma) / 8.f) : (float)rssi;
+                    b_rssi = true;
+                });
+            }
+            changed_ms = Clock::ms();
+        }
+
+        // link margin over sensitivity [dB] required to choose a setting
+        void margin(const float db) { margin_db = db; }
+        // ack loss (NG 103 / sends) which forces slower setting
+        void targetLoss(const float rate) { target_loss = rate; }
+        // minimum interval between changes
+        void hold(const uint32_t ms) { hold_ms = ms; }
+        // minimum replies to evaluate ack loss
+        void lossWindow(const uint32_t replies) { window = replies; }
+        // time from ACCEPT to switchover
+        void switchDelay(const uint16_t ms) { delay_ms = ms; }
+        // time to receive CONFIRM after switchover (must cover reconfiguration of both modules)
+        void fallback(const uint32_t ms) { fallback_ms = ms; }
+
+        // call after parse() in main loop, reconfiguration blocks while switching
+        void update() {
+            const uint32_t now_ms = Clock::ms();
+            switch (state) {
+                case State::IDLE: {
+                    if (role == Role::COORDINATOR) evaluate(now_ms);
+                    break;
+                }
+                case State::REQUESTED: {
+                    if (now_ms - state_ms >= request_timeout_ms) {
+                        LOG_WARN("adr: no ACCEPT from end device");
+                        enter(State::IDLE, now_ms);
+                    }
+                    break;
+                }
+                case State::SWITCHING: {
+                    if ((int32_t)(now_ms - switch_ms) >= 0) {
+                        previous = current();
+                        if (!apply(target)) {
+                            LOG_ERROR("adr: switchover failed");
+                            apply(previous);
+                            enter(State::IDLE, Clock::ms());
+                            break;
+                        }
+                        ++n_switches;
+                        enter(State::CONFIRMING, Clock::ms());
+                        b_confirm_pending = false;
+                        confirm_sent_ms = 0;
+                    }
+                    break;
+                }
+                case State::CONFIRMING: {
+                    if (now_ms - state_ms >= fallback_ms) {
+                        LOG_WARN("adr: no confirmation, fall back to previous setting");
+                        ++n_fallbacks;
+                        if (role == Role::COORDINATOR) block(target, now_ms);
+                        apply(previous);
+                        enter(State::IDLE, Clock::ms());
+                    } else if ((role == Role::ENDDEVICE) && !b_confirm_pending && (now_ms - confirm_sent_ms >= confirm_interval_ms)) {
+                        sendConfirm(now_ms);
+                    }
+                    break;
+                }
+            }
+        }
+
+        AdrSetting current() const {
+            AdrSetting s;
+            s.sf = radio.getConfigs().sf;
+            s.bw = radio.getConfigs().bw;
+            return s;
+        }
+
+        // the fastest setting for rssi with margin (the most robust one if nothing has margin)
+        AdrSetting choose(const float rssi, const uint32_t now_ms) const {
+            AdrSetting best, robust;
+            bool b_best = false, b_robust = false;
+            for (uint8_t f = (uint8_t)SF::SF_7; f <= (uint8_t)SF::SF_12; ++f) {
+                for (uint8_t w = (uint8_t)BW::BW_62_5_KHZ; w <= (uint8_t)BW::BW_500_KHZ; ++w) {
+                    AdrSetting s;
+                    s.sf = (SF)f;
+                    s.bw = (BW)w;
+                    if (radio.getConfigs().channel > channelCount(s.bw)) continue;
+                    if (!b_robust || (s.sensitivity() < robust.sensitivity())) {
+                        robust = s;
+                        b_robust = true;
+                    }
+                    if (isBlocked(s, now_ms)) continue;
+                    if (rssi - s.sensitivity() < margin_db) continue;
+                    if (!b_best || (s.bitrate() > best.bitrate())) {
+                        best = s;
+                        b_best = true;
+                    }
+                }
+            }
+            return b_best ? best : robust;
+        }
+
+        bool busy() const { return state != State::IDLE; }
+        float rssi() const { return rssi_ewma; }
+        size_t switches() const { return n_switches; }
+        size_t fallbacks() const { return n_fallbacks; }
+
+    private:
+        void enter(const State s, const uint32_t now_ms) {
+            state = s;
+            state_ms = now_ms;
+        }
+
+        bool isBlocked(const AdrSetting& s, const uint32_t now_ms) const {
+            if (blocked_bitrate <= 0.f) return false;
+            if ((int32_t)(now_ms - blocked_until_ms) >= 0) return false;
+            return s.bitrate() >= blocked_bitrate;
+        }
+
+        void block(const AdrSetting& s, const uint32_t now_ms) {
+            blocked_bitrate = s.bitrate();
+            blocked_until_ms = now_ms + block_ms;
+        }
+
+        void evaluate(const uint32_t now_ms) {
+            if (!b_rssi || (now_ms - changed_ms < hold_ms)) return;
+
+            const Stats st = radio.stats();
+            const uint32_t ok = st.replies_ok - prev_ok;
+            const uint32_t missing = st.ng(ErrorCode::MissingAck) - prev_missing_ack;
+            const AdrSetting cur = current();
+            if (ok + missing >= window) {
+                prev_ok = st.replies_ok;
+                prev_missing_ack = st.ng(ErrorCode::MissingAck);
+                const float loss = (float)missing / (float)(ok + missing);
+                if (loss > target_loss) {
+                    LOG_WARN("adr: ack loss", loss, "is over target");
+                    block(cur, now_ms);
+                }
+            }
+
+            const AdrSetting next = choose(rssi_ewma, now_ms);
+            if (next == cur) return;
+            request(next, now_ms);
+        }
+
+        void request(const AdrSetting& s, const uint32_t now_ms) {
+            target = s;
+            ++seq;
+            uint8_t msg[6] {(uint8_t)MessageType::REQUEST, seq, (uint8_t)s.sf, (uint8_t)s.bw, (uint8_t)(delay_ms & 0xFF), (uint8_t)(delay_ms >> 8)};
+            LOG_INFO("adr: request sf", (int)s.sf, "bw", (int)s.bw);
+            const uint8_t sent_seq = seq;
+            const bool b_sent = radio.sendAsync(index, msg, sizeof(msg), [&, sent_seq](const Reply& r) {
+                if (!r.success() && (state == State::REQUESTED) && (seq == sent_seq)) enter(State::IDLE, Clock::ms());
+            });
+            if (b_sent) enter(State::REQUESTED, now_ms);
+            changed_ms = now_ms;  // also limits retries
+        }
+
+        void sendConfirm(const uint32_t now_ms) {
+            uint8_t msg[4] {(uint8_t)MessageType::CONFIRM, seq, (uint8_t)target.sf, (uint8_t)target.bw};
+            confirm_sent_ms = now_ms;
+            b_confirm_pending = radio.sendAsync(
+                index, msg, sizeof(msg), [&](const Reply& r) {
+                    b_confirm_pending = false;
+                    if (r.success() && (state == State::CONFIRMING)) enter(State::IDLE, Clock::ms());
+                },
+                confirm_interval_ms);
+        }
+
+        void receive(const uint8_t* data, const size_t size) {
+            if (size < 4) return;
+            const MessageType type = (MessageType)data[0];
+            AdrSetting s;
+            s.sf = (SF)data[2];
+            s.bw = (BW)data[3];
+            const uint32_t now_ms = Clock::ms();
+
+            if ((role == Role::ENDDEVICE) && (type == MessageType::REQUEST) && (size >= 6)) {
+                if ((state != State::IDLE) && (data[1] == seq)) return;  // duplicated
+                seq = data[1];
+                target = s;
+                const uint16_t delay = (uint16_t)(data[4] | (data[5] << 8));
+                uint8_t msg[4] {(uint8_t)MessageType::ACCEPT, seq, (uint8_t)s.sf, (uint8_t)s.bw};
+                radio.send(index, msg, sizeof(msg));
+                switch_ms = now_ms + delay;
+                enter(State::SWITCHING, now_ms);
+            } else if ((role == Role::COORDINATOR) && (type == MessageType::ACCEPT) && (state == State::REQUESTED) && (data[1] == seq)) {
+                switch_ms = now_ms + delay_ms;
+                enter(State::SWITCHING, now_ms);
+            } else if ((role == Role::COORDINATOR) && (type == MessageType::CONFIRM) && (data[1] == seq) && (s == current())) {
+                if (state == State::CONFIRMING) {
+                    LOG_INFO("adr: switched to sf", (int)s.sf, "bw", (int)s.bw);
+                    enter(State::IDLE, now_ms);
+                    changed_ms = now_ms;
+                    b_rssi = false;  // rssi is measured again with new setting
+                    const Stats st = radio.stats();
+                    prev_ok = st.replies_ok;
+                    prev_missing_ack = st.ng(ErrorCode::MissingAck);
+                }
+            }
+        }
+
+        bool apply(const AdrSetting& s) {
+            Config cfg = radio.getConfigs();
+            cfg.sf = s.sf;
+            cfg.bw = s.bw;
+            return radio.begin(serial, cfg);
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_ADR_H
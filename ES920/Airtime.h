@@ -0,0 +1,68 @@
+#pragma once
+#ifndef ARDUINO_ES920_AIRTIME_H
+#define ARDUINO_ES920_AIRTIME_H
+
+#include <math.h>
+#include "Constants.h"
+#include "Utils.h"
+
+namespace arduino {
+namespace es920 {
+
+    // approximate time on air / on uart (used by emulator, simulator and estimations)
+    namespace airtime {
+
+        // preamble, sync word, module header and crc added by module (approx.)
+        constexpr uint8_t FSK_OVERHEAD_BYTES {26};
+        constexpr uint8_t LORA_OVERHEAD_BYTES {8};
+        constexpr uint8_t LORA_PREAMBLE_SYMBOLS {8};
+        constexpr uint8_t LORA_CODING_RATE {1};  // 4/5
+
+        inline uint32_t bandwidthHz(const BW bw) {
+            switch (bw) {
+                case BW::BW_62_5_KHZ:
+                    return 62500;
+                case BW::BW_125_KHZ:
+                    return 125000;
+                case BW::BW_250_KHZ:
+                    return 250000;
+                case BW::BW_500_KHZ:
+                    return 500000;
+                default:
+                    return 125000;
+            }
+        }
+
+        // uart transfer time (8N1)
+        inline uint32_t serialUs(const Baudrate b, const size_t size) {
+            return (uint32_t)((uint64_t)size * 10 * 1000000 / toBaudrate(b));
+        }
+
+        // ES920 (FSK)
+        inline uint32_t fskUs(const Rate r, const size_t size) {
+            const uint32_t bps = (r == Rate::RATE_100KBPS) ? 100000 : 50000;
+            return (uint32_t)((uint64_t)(size + FSK_OVERHEAD_BYTES) * 8 * 1000000 / bps);
+        }
+
+        // ES920LR (LoRa), see Semtech AN1200.13
+        inline uint32_t loraUs(const SF sf, const BW bw, const size_t size) {
+            const int n_sf = (int)sf;
+            const float t_sym_us = (float)(1UL << n_sf) * 1000000.f / (float)bandwidthHz(bw);
+            const int de = (t_sym_us > 16000.f) ? 1 : 0;  // low data rate optimization
+            const int pl = (int)size + LORA_OVERHEAD_BYTES;
+            const float n = ceilf((float)(8 * pl - 4 * n_sf + 28 + 16) / (float)(4 * (n_sf - 2 * de)));
+            const float n_payload = 8.f + ((n > 0.f) ? n * (LORA_CODING_RATE + 4) : 0.f);
+            const float n_preamble = (float)LORA_PREAMBLE_SYMBOLS + 4.25f;
+            return (uint32_t)((n_preamble + n_payload) * t_sym_us);
+        }
+
+        inline uint32_t airUs(const bool b_lr, const Rate r, const SF sf, const BW bw, const size_t size) {
+            return b_lr ? loraUs(sf, bw, size) : fskUs(r, size);
+        }
+
+    }  // namespace airtime
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_AIRTIME_H
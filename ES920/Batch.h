@@ -0,0 +1,150 @@
+#pragma once
+#ifndef ARDUINO_ES920_BATCH_H
+#define ARDUINO_ES920_BATCH_H
+
+// burst batching for sleeping nodes : readings are buffered in RAM and sent in packed frames
+// enabled in ES920Base by defining ES920_BATCH_ENABLE before including ES920.h (both sender and receiver)
+// packed frame (binary index ES920_BATCH_INDEX) : ([index][size][data]) * n
+// receiver unpacks frames and dispatches each reading to subscribers of its index
+// ES920_BATCH_BUFFER : bytes of buffered readings (including 6 bytes per reading)
+// ES920_BATCH_SUBSCRIBERS : number of indexes subscribed by subscribe(id, cb) after batching(true) which receive unpacked readings
+
+#include "Constants.h"
+
+#ifndef ES920_BATCH_INDEX
+#define ES920_BATCH_INDEX 0xF3
+#endif
+
+#ifndef ES920_BATCH_BUFFER
+#define ES920_BATCH_BUFFER 256
+#endif
+
+#ifndef ES920_BATCH_SUBSCRIBERS
+#define ES920_BATCH_SUBSCRIBERS 8
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct BatchStats {
+        uint32_t readings {0};   // sendBatched() accepted
+        uint32_t rejected {0};   // buffer was full
+        uint32_t packets {0};    // packed frames sent (= wakes of module)
+        uint32_t failed {0};     // packed frames replied NG or timeout (readings are dropped)
+        uint32_t airtime_us {0};            // of packed frames
+        uint32_t unbatched_airtime_us {0};  // if each reading were sent alone
+
+        float wakesPerReading() const { return readings ? (float)packets / (float)readings : 0.f; }
+        void clear() { *this = BatchStats(); }
+    };
+
+    // approximate energy of module per wake (tx + waiting reply + wakeup overhead)
+    // default values are rough numbers for ES920LR at 13 dBm, measure actual module for precise estimation
+    struct EnergyModel {
+        float voltage {3.3f};
+        float tx_ma {45.f};
+        float rx_ma {13.f};         // waiting ack / reply after transmission
+        uint32_t rx_us {30000};     //
+        float wake_ma {10.f};       // wakeup from sleep and uart transfer
+        uint32_t wake_us {20000};   //
+
+        // [uJ]
+        float uj(const uint32_t wakes, const uint32_t airtime_us) const {
+            const float per_wake_uc = rx_ma * (float)rx_us + wake_ma * (float)wake_us;  // [mA us] = [nC]
+            return voltage * ((float)wakes * per_wake_uc + tx_ma * (float)airtime_us) / 1000.f;
+        }
+
+        // energy without batching / with batching
+        float saving(const BatchStats& s) const {
+            const float batched = uj(s.packets, s.airtime_us);
+            return (batched > 0.f) ? uj(s.readings, s.unbatched_airtime_us) / batched : 0.f;
+        }
+    };
+
+    template <uint8_t FRAME_SIZE>
+    class BatchBuffer {
+        static constexpr uint8_t RECORD_HEADER {6};  // queued ms (4), index, size
+
+        uint8_t buffer[ES920_BATCH_BUFFER];
+        uint16_t used {0};
+        uint16_t n {0};
+        uint8_t last_size {0};
+
+    public:
+        bool push(const uint8_t index, const uint8_t* data, const uint8_t size, const uint32_t now_ms) {
+            if ((size + 2 > FRAME_SIZE) || (used + RECORD_HEADER + size > ES920_BATCH_BUFFER)) return false;
+            uint8_t* p = buffer + used;
+            p[0] = (uint8_t)(now_ms);
+            p[1] = (uint8_t)(now_ms >> 8);
+            p[2] = (uint8_t)(now_ms >> 16);
+            p[3] = (uint8_t)(now_ms >> 24);
+            p[4] = index;
+            p[5] = size;
+            for (uint8_t i = 0; i < size; ++i) p[RECORD_HEADER + i] = data[i];
+            used += RECORD_HEADER + size;
+            ++n;
+            last_size = size;
+            return true;
+        }
+
+        // the oldest reading waited max_latency_ms, readings exceed a frame, or buffer cannot take the next one
+        bool due(const uint32_t now_ms, const uint32_t max_latency_ms) const {
+            if (n == 0) return false;
+            if (now_ms - oldest() >= max_latency_ms) return true;
+            if (used + RECORD_HEADER + last_size > ES920_BATCH_BUFFER) return true;
+            return packedSize(FRAME_SIZE) >= FRAME_SIZE;
+        }
+
+        // moves readings which fit in a frame to out, returns frame size
+        uint8_t pack(uint8_t* out) {
+            uint16_t from = 0;
+            uint8_t size = 0;
+            while (from < used) {
+                const uint8_t s = buffer[from + 5];
+                if (size + 2 + s > FRAME_SIZE) break;
+                out[size++] = buffer[from + 4];
+                out[size++] = s;
+                for (uint8_t i = 0; i < s; ++i) out[size++] = buffer[from + RECORD_HEADER + i];
+                from += RECORD_HEADER + s;
+                --n;
+            }
+            for (uint16_t i = from; i < used; ++i) buffer[i - from] = buffer[i];
+            used -= from;
+            return size;
+        }
+
+        // calls f(index, data, size) for each reading in packed frame
+        template <typename F>
+        static void unpack(const uint8_t* data, const size_t size, const F& f) {
+            size_t i = 0;
+            while (i + 2 <= size) {
+                const uint8_t index = data[i];
+                const uint8_t s = data[i + 1];
+                if (i + 2 + s > size) break;
+                f(index, data + i + 2, (size_t)s);
+                i += 2 + s;
+            }
+        }
+
+        void clear() { used = n = 0; }
+        uint16_t size() const { return n; }
+        uint16_t bytes() const { return used; }
+
+    private:
+        uint32_t oldest() const {
+            return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+        }
+
+        // packed bytes of readings from the oldest, up to limit
+        uint16_t packedSize(const uint16_t limit) const {
+            uint16_t size = 0;
+            for (uint16_t from = 0; (from < used) && (size < limit); from += RECORD_HEADER + buffer[from + 5])
+                size += 2 + buffer[from + 5];
+            return size;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_BATCH_H
@@ -0,0 +1,191 @@
+#pragma once
+#ifndef ARDUINO_ES920_BONDED_LINK_H
+#define ARDUINO_ES920_BONDED_LINK_H
+
+// one logical binary stream striped over several modules of a Gateway (host only)
+// each module should be on a different channel, and the receiver should have the same set of channels
+// frame : [seq (2 bytes, little endian)][data]
+// data is cut by the smallest payload of members, so that any member can retransmit any frame
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "Gateway.h"
+
+namespace arduino {
+namespace es920 {
+
+    using BondedCallbackType = std::function<void(const uint8_t* data, const size_t size)>;
+
+    class BondedLink {
+        static constexpr uint8_t SEQ_SIZE {2};
+
+        struct Chunk {
+            uint16_t seq;
+            std::vector<uint8_t> data;
+        };
+
+        Gateway& gateway;
+        std::vector<uint8_t> members;
+        uint8_t index;
+
+        // sender
+        std::deque<uint8_t> tx_stream;
+        std::deque<Chunk> retransmits;
+        uint16_t tx_seq {0};
+        uint32_t reply_timeout_ms {3000};
+
+        // receiver
+        std::map<uint16_t, std::vector<uint8_t>> reorder;
+        uint16_t rx_seq {0};
+        uint32_t gap_start_ms {0};
+        uint32_t gap_timeout_ms {5000};
+        size_t reorder_limit {256};  // frames waiting for a lost one
+        BondedCallbackType rx_callback;
+
+        size_t sent_frames {0};
+        size_t resent_frames {0};
+        size_t lost_frames {0};
+
+    public:
+        // modules must be added to the gateway before creating BondedLink
+        BondedLink(Gateway& gw, const std::vector<uint8_t>& modules, const uint8_t idx)
+        : gateway(gw), members(modules), index(idx) {
+            for (const uint8_t m : members) {
+                gateway.subscribe(m, index, [&](const uint8_t, const uint8_t, const uint8_t* data, const size_t size) {
+                    receive(data, size);
+                });
+            }
+        }
+        BondedLink(const BondedLink&) = delete;
+        BondedLink& operator=(const BondedLink&) = delete;
+
+        // queue data to be sent, actual sending is done in update()
+        void write(const uint8_t* data, const size_t size) {
+            tx_stream.insert(tx_stream.end(), data, data + size);
+        }
+
+        // ordered stream from all modules
+        void subscribe(const BondedCallbackType& cb) { rx_callback = cb; }
+
+        // call after Gateway::update()
+        void update() {
+            const size_t chunk_size = chunkSize();
+            if (chunk_size == 0) return;
+
+            // hand one frame to every idle module
+            for (const uint8_t m : members) {
+                if (gateway.inflight(m) != 0) continue;
+
+                Chunk c;
+                if (!retransmits.empty()) {
+                    c = retransmits.front();
+                    retransmits.pop_front();
+                    ++resent_frames;
+                } else if (!tx_stream.empty()) {
+                    const size_t n = std::min(tx_stream.size(), chunk_size);
+                    c.seq = tx_seq++;
+                    c.data.assign(tx_stream.begin(), tx_stream.begin() + n);
+                    tx_stream.erase(tx_stream.begin(), tx_stream.begin() + n);
+                } else
+                    break;
+
+                send(m, c);
+            }
+
+            // give up waiting lost frames and deliver following ones
+            if (!reorder.empty() && (ELAPSED_TIME_MS() - gap_start_ms >= gap_timeout_ms)) skipGap();
+        }
+
+        // no more data to be sent or to be acknowledged
+        bool idle() const {
+            if (!tx_stream.empty() || !retransmits.empty()) return false;
+            for (const uint8_t m : members)
+                if (gateway.inflight(m) != 0) return false;
+            return true;
+        }
+
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+        void gapTimeout(const uint32_t ms) { gap_timeout_ms = ms; }
+        void reorderLimit(const size_t n) { reorder_limit = std::max<size_t>(n, 1); }
+
+        size_t queued() const { return tx_stream.size(); }
+        size_t sentFrames() const { return sent_frames; }
+        size_t resentFrames() const { return resent_frames; }
+        size_t lostFrames() const { return lost_frames; }
+
+    private:
+        size_t chunkSize() const {
+            uint8_t size = 0;
+            for (const uint8_t m : members) {
+                const uint8_t s = gateway.payloadSize(m);
+                if ((size == 0) || (s < size)) size = s;
+            }
+            return (size > SEQ_SIZE) ? (size_t)(size - SEQ_SIZE) : 0;
+        }
+
+        void send(const uint8_t module, const Chunk& c) {
+            uint8_t frame[PAYLOAD_SIZE_ES920];
+            frame[0] = (uint8_t)(c.seq & 0xFF);
+            frame[1] = (uint8_t)(c.seq >> 8);
+            std::copy(c.data.begin(), c.data.end(), frame + SEQ_SIZE);
+            const uint8_t size = (uint8_t)(SEQ_SIZE + c.data.size());
+
+            // retransmit via any module if sending failed
+            const bool b = gateway.send(
+                module, index, frame, size, [this, c](const Reply& r) {
+                    if (!r.success()) retransmits.push_back(c);
+                },
+                reply_timeout_ms);
+            if (b)
+                ++sent_frames;
+            else
+                retransmits.push_back(c);
+        }
+
+        void receive(const uint8_t* data, const size_t size) {
+            if (size < SEQ_SIZE) return;
+            const uint16_t seq = (uint16_t)data[0] | ((uint16_t)data[1] << 8);
+
+            // too old (duplicated or already skipped)
+            if ((int16_t)(seq - rx_seq) < 0) return;
+
+            if (reorder.empty()) gap_start_ms = ELAPSED_TIME_MS();
+            reorder[seq].assign(data + SEQ_SIZE, data + size);
+            deliver();
+            if (reorder.size() > reorder_limit) skipGap();
+        }
+
+        // skips all missing frames up to the oldest received one
+        void skipGap() {
+            uint16_t next = reorder.begin()->first;
+            for (const auto& f : reorder)
+                if ((uint16_t)(f.first - rx_seq) < (uint16_t)(next - rx_seq)) next = f.first;
+            const uint16_t n = (uint16_t)(next - rx_seq);
+            LOG_WARN("bonded link: frames lost, seq =", rx_seq, ", count =", n);
+            lost_frames += n;
+            rx_seq = next;
+            deliver();
+        }
+
+        void deliver() {
+            while (!reorder.empty()) {
+                auto it = reorder.find(rx_seq);
+                if (it == reorder.end()) break;
+                if (rx_callback) rx_callback(it->second.data(), it->second.size());
+                reorder.erase(it);
+                ++rx_seq;
+                gap_start_ms = ELAPSED_TIME_MS();
+            }
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO
+
+#endif  // ARDUINO_ES920_BONDED_LINK_H
@@ -0,0 +1,476 @@
+#pragma once
+#ifndef ARDUINO_ES920_CAPTURE_H
+#define ARDUINO_ES920_CAPTURE_H
+
+// capture file of raw serial traffic with timestamps and active Config (host only)
+// CaptureWriter records through ES920Base::tap(), CaptureReplay feeds it back to parsers as a stream
+//
+// file   : "ES9C" [version] [payload size] [record]...
+//          payload size : PAYLOAD_SIZE_ES920 / PAYLOAD_SIZE_ES920LR of captured module (0 : unknown, not in version 1)
+// record : [type] [delta ms (varint)] [size (varint)] [data]
+//          type 1 : RX bytes, 2 : TX bytes, 3 : Config (see encodeConfig())
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace arduino {
+namespace es920 {
+
+    namespace capture {
+
+        constexpr char MAGIC[4] {'E', 'S', '9', 'C'};
+        constexpr uint8_t VERSION {2};
+
+        enum class RecordType : uint8_t {
+            RX = 1,
+            TX,
+            CONFIG
+        };
+
+        struct Record {
+            RecordType type;
+            uint32_t ms;  // from start of capture
+            std::string data;
+        };
+
+        inline void putVarint(std::string& out, uint32_t v) {
+            while (v >= 0x80) {
+                out.push_back((char)((v & 0x7F) | 0x80));
+                v >>= 7;
+            }
+            out.push_back((char)v);
+        }
+
+        inline bool getVarint(std::istream& in, uint32_t& v) {
+            v = 0;
+            for (uint8_t shift = 0; shift < 35; shift += 7) {
+                const int c = in.get();
+                if (c == EOF) return false;
+                v |= (uint32_t)(c & 0x7F) << shift;
+                if (!(c & 0x80)) return true;
+            }
+            return false;
+        }
+
+        inline void put16(std::string& out, const uint16_t v) {
+            out.push_back((char)(v & 0xFF));
+            out.push_back((char)(v >> 8));
+        }
+
+        inline void put32(std::string& out, const uint32_t v) {
+            put16(out, (uint16_t)(v & 0xFFFF));
+            put16(out, (uint16_t)(v >> 16));
+        }
+
+        // all fields except device, in declaration order
+        inline std::string encodeConfig(const Config& c) {
+            std::string s;
+            s.push_back((char)c.rate);
+            s.push_back((char)c.hopcount);
+            put16(s, c.endid);
+            put16(s, c.route1);
+            put16(s, c.route2);
+            put16(s, c.route3);
+            s.push_back((char)c.bw);
+            s.push_back((char)c.sf);
+            s.push_back((char)c.node);
+            s.push_back((char)c.channel);
+            put16(s, c.panid);
+            put16(s, c.ownid);
+            put16(s, c.dstid);
+            s.push_back((char)c.ack);
+            s.push_back((char)c.retry);
+            s.push_back((char)c.transmode);
+            s.push_back((char)c.rcvid);
+            s.push_back((char)c.rssi);
+            s.push_back((char)c.operation);
+            s.push_back((char)c.baudrate);
+            s.push_back((char)c.sleep);
+            put32(s, c.sleeptime);
+            s.push_back((char)c.power);
+            s.push_back((char)c.format);
+            put32(s, c.sendtime);
+            putVarint(s, (uint32_t)c.senddata.size());
+            s += c.senddata;
+            return s;
+        }
+
+        inline bool decodeConfig(const std::string& s, Config& c) {
+            size_t i = 0;
+            bool b_ok = true;
+            auto get8 = [&]() -> uint8_t {
+                if (i + 1 > s.size()) {
+                    b_ok = false;
+                    return 0;
+                }
+                return (uint8_t)s[i++];
+            };
+            auto get16 = [&]() -> uint16_t {
+                const uint16_t lo = get8();
+                return (uint16_t)(lo | ((uint16_t)get8() << 8));
+            };
+            auto get32 = [&]() -> uint32_t {
+                const uint32_t lo = get16();
+                return lo | ((uint32_t)get16() << 16);
+            };
+
+            c.rate = (Rate)get8();
+            c.hopcount = get8();
+            c.endid = get16();
+            c.route1 = get16();
+            c.route2 = get16();
+            c.route3 = get16();
+            c.bw = (BW)get8();
+            c.sf = (SF)get8();
+            c.node = (Node)get8();
+            c.channel = get8();
+            c.panid = get16();
+            c.ownid = get16();
+            c.dstid = get16();
+            c.ack = get8() != 0;
+            c.retry = get8();
+            c.transmode = (TransMode)get8();
+            c.rcvid = get8() != 0;
+            c.rssi = get8() != 0;
+            c.operation = (Mode)get8();
+            c.baudrate = (Baudrate)get8();
+            c.sleep = (SleepMode)get8();
+            c.sleeptime = get32();
+            c.power = get8();
+            c.format = (Format)get8();
+            c.sendtime = get32();
+            uint32_t size = 0;
+            for (uint8_t shift = 0; b_ok && (shift < 35); shift += 7) {
+                const uint8_t b = get8();
+                size |= (uint32_t)(b & 0x7F) << shift;
+                if (!(b & 0x80)) break;
+            }
+            if (!b_ok || (i + size > s.size())) return false;
+            c.senddata = s.substr(i, size);
+            return true;
+        }
+
+    }  // namespace capture
+
+    // records raw bytes of one ES920_ / ES920LR_ to capture file
+    // bytes in the same direction and the same millisecond are merged into one record
+    template <typename Clock = DefaultClock>
+    class CaptureWriter {
+        std::ofstream file;
+        const Config* config {nullptr};
+        std::string prev_config;
+        uint32_t prev_ms {0};
+        uint8_t payload_size {0};
+        bool b_header {false};
+
+        // pending record
+        capture::RecordType type {capture::RecordType::RX};
+        uint32_t chunk_ms {0};
+        std::string chunk;
+
+        size_t n_records {0};
+        size_t n_bytes {0};
+
+    public:
+        CaptureWriter() = default;
+        CaptureWriter(const CaptureWriter&) = delete;
+        CaptureWriter& operator=(const CaptureWriter&) = delete;
+        ~CaptureWriter() { close(); }
+
+        bool open(const std::string& path) {
+            close();
+            file.open(path, std::ios::binary | std::ios::trunc);
+            if (!file) {
+                LOG_ERROR("cannot open capture file :", path);
+                return false;
+            }
+            b_header = false;  // written with payload size of attached radio
+            prev_ms = Clock::ms();
+            prev_config.clear();
+            n_records = n_bytes = 0;
+            return true;
+        }
+
+        void close() {
+            if (!file.is_open()) return;
+            flush();
+            writeHeader();
+            file.close();
+        }
+
+        bool isOpen() const { return file.is_open(); }
+
+        // start recording radio, Config is recorded at first and whenever it changes
+        template <typename Radio>
+        void attach(Radio& radio) {
+            config = &radio.getConfigs();
+            payload_size = Radio::modulePayloadSize();
+            radio.tap([this](const Direction dir, const uint8_t* data, const size_t size) {
+                write(dir, data, size);
+            });
+        }
+
+        void write(const Direction dir, const uint8_t* data, const size_t size) {
+            if (!file.is_open()) return;
+            const capture::RecordType t = (dir == Direction::RX) ? capture::RecordType::RX : capture::RecordType::TX;
+            const uint32_t now_ms = Clock::ms();
+            if (!chunk.empty() && ((t != type) || (now_ms != chunk_ms))) flush();
+            if (chunk.empty()) {
+                writeConfigIfChanged(now_ms);
+                type = t;
+                chunk_ms = now_ms;
+            }
+            chunk.append((const char*)data, size);
+        }
+
+        // write pending bytes to file
+        void flush() {
+            if (!file.is_open()) return;
+            if (!chunk.empty()) {
+                writeRecord(type, chunk_ms, chunk);
+                n_bytes += chunk.size();
+                chunk.clear();
+            }
+            file.flush();
+        }
+
+        size_t records() const { return n_records; }
+        size_t bytes() const { return n_bytes; }
+
+    private:
+        void writeConfigIfChanged(const uint32_t now_ms) {
+            if (!config) return;
+            std::string c = capture::encodeConfig(*config);
+            if (c == prev_config) return;
+            writeRecord(capture::RecordType::CONFIG, now_ms, c);
+            prev_config.swap(c);
+        }
+
+        void writeHeader() {
+            if (b_header) return;
+            file.write(capture::MAGIC, sizeof(capture::MAGIC));
+            file.put((char)capture::VERSION);
+            file.put((char)payload_size);
+            b_header = true;
+        }
+
+        void writeRecord(const capture::RecordType t, const uint32_t ms, const std::string& data) {
+            writeHeader();
+            std::string h;
+            h.push_back((char)t);
+            capture::putVarint(h, ms - prev_ms);
+            capture::putVarint(h, (uint32_t)data.size());
+            file.write(h.data(), h.size());
+            file.write(data.data(), data.size());
+            prev_ms = ms;
+            ++n_records;
+        }
+    };
+
+    // reads all records of capture file
+    class CaptureReader {
+        std::vector<capture::Record> recs;
+        Config first_config;
+        bool b_config {false};
+        uint8_t payload_size {0};
+
+    public:
+        bool open(const std::string& path) {
+            recs.clear();
+            b_config = false;
+            payload_size = 0;
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                LOG_ERROR("cannot open capture file :", path);
+                return false;
+            }
+            char magic[sizeof(capture::MAGIC)];
+            if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), capture::MAGIC)) {
+                LOG_ERROR("not a capture file :", path);
+                return false;
+            }
+            const int version = file.get();
+            if ((version < 1) || (version > capture::VERSION)) {
+                LOG_ERROR("unsupported capture version :", path);
+                return false;
+            }
+            if (version >= 2) {
+                const int p = file.get();
+                if (p == EOF) {
+                    LOG_ERROR("capture file is truncated :", path);
+                    return false;
+                }
+                payload_size = (uint8_t)p;
+            }
+
+            uint32_t ms = 0;
+            while (true) {
+                const int t = file.get();
+                if (t == EOF) break;
+                uint32_t delta = 0, size = 0;
+                if (!capture::getVarint(file, delta) || !capture::getVarint(file, size)) {
+                    LOG_WARN("capture file is truncated");
+                    break;
+                }
+                capture::Record r {(capture::RecordType)t, ms + delta, std::string(size, '\0')};
+                if (size && !file.read(&r.data[0], size)) {
+                    LOG_WARN("capture file is truncated");
+                    break;
+                }
+                ms = r.ms;
+                if ((r.type == capture::RecordType::CONFIG) && !b_config)
+                    b_config = capture::decodeConfig(r.data, first_config);
+                recs.push_back(std::move(r));
+            }
+            return true;
+        }
+
+        const std::vector<capture::Record>& records() const { return recs; }
+
+        // first recorded Config (default if not recorded)
+        const Config& config() const { return first_config; }
+        bool hasConfig() const { return b_config; }
+
+        // PAYLOAD_SIZE_ES920 / PAYLOAD_SIZE_ES920LR of captured module (0 if unknown)
+        uint8_t payloadSize() const { return payload_size; }
+
+        // concatenated bytes of one direction (e.g. parser benchmark input)
+        std::string bytes(const Direction dir) const {
+            const capture::RecordType t = (dir == Direction::RX) ? capture::RecordType::RX : capture::RecordType::TX;
+            std::string s;
+            for (const auto& r : recs)
+                if (r.type == t) s += r.data;
+            return s;
+        }
+    };
+
+    // ofSerial compatible stream which replays RX bytes of capture file (TX bytes from library are discarded)
+    // e.g. ES920::ES920_<ES920::CaptureReplay<>> radio; replay.attach(radio); replay.play();
+    // Config records are applied to the attached radio when replay reaches them
+    template <typename Clock = DefaultClock>
+    class CaptureReplay {
+        struct ConfigChange {
+            size_t pos;  // applied before RX byte at this index
+            Config config;
+        };
+
+        CaptureReader reader;
+        std::string rx;                // RX bytes
+        std::vector<uint32_t> rx_ms;  // recorded time of each RX byte
+        std::vector<ConfigChange> changes;
+        std::function<void(const Config&)> apply_cb;
+        size_t pos {0};
+        mutable size_t due {0};          // bytes before this index are due
+        mutable size_t next_change {0};  // changes before this index are applied
+        mutable bool b_applying {false};
+        uint32_t start_ms {0};
+        bool b_playing {false};
+        bool b_realtime {false};
+
+    public:
+        bool open(const std::string& path) {
+            if (!reader.open(path)) return false;
+            rx.clear();
+            rx_ms.clear();
+            changes.clear();
+            for (const auto& r : reader.records()) {
+                if (r.type == capture::RecordType::CONFIG) {
+                    ConfigChange c {rx.size(), Config()};
+                    if (capture::decodeConfig(r.data, c.config)) changes.push_back(c);
+                    continue;
+                }
+                if (r.type != capture::RecordType::RX) continue;
+                rx += r.data;
+                rx_ms.insert(rx_ms.end(), r.data.size(), r.ms);
+            }
+            pos = due = next_change = 0;
+            b_playing = false;
+            return true;
+        }
+
+        // nothing is available until play() (attach() drains the stream)
+        // b_original_timing == false : all bytes at once, true : at recorded timing from now
+        void play(const bool b_original_timing = false) {
+            pos = due = next_change = 0;
+            start_ms = Clock::ms();
+            b_realtime = b_original_timing;
+            b_playing = true;
+            applyChanges();  // Config recorded before the first RX byte
+        }
+
+        bool finished() const { return pos >= rx.size(); }
+        const Config& config() const { return reader.config(); }
+        const CaptureReader& capture() const { return reader; }
+        // PAYLOAD_SIZE_ES920 / PAYLOAD_SIZE_ES920LR of captured module (0 if unknown), selects ES920_ or ES920LR_ to replay
+        uint8_t payloadSize() const { return reader.payloadSize(); }
+
+        // attaches radio with recorded Config, false if the capture was recorded by the other model
+        template <typename Radio>
+        bool attach(Radio& radio) {
+            if (payloadSize() && (payloadSize() != Radio::modulePayloadSize())) {
+                LOG_ERROR("capture was recorded by other model, payload size :", (int)payloadSize());
+                return false;
+            }
+            radio.attach(*this, config());
+            apply_cb = [&radio, this](const Config& c) { radio.attach(*this, c, radio.verbose()); };
+            return true;
+        }
+
+        // ofSerial compatible interface
+
+        bool setup(const std::string&, const int) { return true; }
+        void close() {}
+        bool isInitialized() const { return true; }
+
+        int available() const {
+            if (!b_playing || b_applying) return 0;
+            // current parse() has selected its parser by previous Config
+            if (applyChanges()) return 0;
+            size_t end = rx.size();
+            if (b_realtime) {
+                const uint32_t elapsed_ms = Clock::ms() - start_ms;
+                while ((due < rx.size()) && (rx_ms[due] <= elapsed_ms)) ++due;
+                end = due;
+            }
+            if ((next_change < changes.size()) && (changes[next_change].pos < end)) end = changes[next_change].pos;
+            return (int)(end - pos);
+        }
+
+        int readByte() {
+            if (available() <= 0) return -1;
+            return (uint8_t)rx[pos++];
+        }
+        int read() { return readByte(); }
+
+        bool writeByte(const uint8_t) { return true; }
+        long writeBytes(const uint8_t*, const size_t size) { return (long)size; }
+        long writeBytes(const char*, const size_t size) { return (long)size; }
+        void flush() {}
+
+    private:
+        // applies Config records reached by replay, true if radio was reconfigured
+        // radio.attach() drains the stream, so no byte is available while applying
+        bool applyChanges() const {
+            bool b_applied = false;
+            b_applying = true;
+            while ((next_change < changes.size()) && (changes[next_change].pos <= pos)) {
+                if (apply_cb) apply_cb(changes[next_change].config);
+                b_applied |= (bool)apply_cb;
+                ++next_change;
+            }
+            b_applying = false;
+            return b_applied;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO
+
+#endif  // ARDUINO_ES920_CAPTURE_H
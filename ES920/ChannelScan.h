@@ -0,0 +1,194 @@
+#pragma once
+#ifndef ARDUINO_ES920_CHANNEL_SCAN_H
+#define ARDUINO_ES920_CHANNEL_SCAN_H
+
+// channel occupancy scan : steps through all selectable channels for current Rate / BW,
+// sends short probe packets on each and measures carrier sense failures (NG 102) and latency
+// each channel is configured through begin() (channel can be changed only in config mode),
+// so scan() blocks for about (configuration + probes * interval) per channel
+// probes are sent without ack by default, so that the result does not depend on the peer
+// ES920_CHANNEL_SCAN_MAX : max number of channels to keep results
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifndef ES920_CHANNEL_SCAN_MAX
+#define ES920_CHANNEL_SCAN_MAX 38
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct ChannelScore {
+        uint8_t channel {0};
+        uint16_t probes {0};
+        uint16_t ok {0};
+        uint16_t carrier_sense {0};  // NG 102
+        uint16_t ng {0};             // other NG (e.g. NG 103 if ack is used)
+        uint16_t timeouts {0};
+        uint32_t latency_sum_ms {0};  // of replied probes
+        uint16_t latency_max_ms {0};
+
+        // NG 102 / probes
+        float busyRate() const { return probes ? (float)carrier_sense / (float)probes : 1.f; }
+        // (NG + timeout) / probes
+        float failureRate() const { return probes ? (float)(probes - ok) / (float)probes : 1.f; }
+        uint16_t latencyMean() const {
+            const uint16_t n = probes - timeouts;
+            return n ? (uint16_t)(latency_sum_ms / n) : 0xFFFF;
+        }
+    };
+
+    template <typename Radio, typename SerialType, typename Clock = DefaultClock>
+    class ChannelScanner {
+        Radio& radio;
+        SerialType& serial;
+
+        ChannelScore scores[ES920_CHANNEL_SCAN_MAX];
+        uint8_t n {0};
+
+        uint8_t n_probes {5};
+        uint8_t probe_size {8};
+        uint8_t probe_index {0xF1};
+        uint32_t interval_ms {200};
+        uint32_t reply_timeout_ms {3000};
+        bool b_ack {false};
+
+    public:
+        ChannelScanner(Radio& r, SerialType& s)
+        : radio(r), serial(s) {}
+
+        // probe packets per channel
+        void probes(const uint8_t count) { n_probes = count; }
+        // size of probe packet (airtime of each probe)
+        void probeSize(const uint8_t size) { probe_size = (size > Radio::payloadSize()) ? Radio::payloadSize() : size; }
+        // binary index of probe packets (binary format only)
+        void probeIndex(const uint8_t index) { probe_index = index; }
+        // minimum interval between probes
+        void interval(const uint32_t ms) { interval_ms = ms; }
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+        // keep ack of current configuration while probing (peer must be on the same channel)
+        void ack(const bool b) { b_ack = b; }
+
+        // scans channels first to last (0 : last selectable channel), configuration is restored after scan
+        bool scan(const uint8_t first = 1, uint8_t last = 0) {
+            const auto original = radio.getConfigs();
+            const uint8_t count = radio.channels();
+            if ((last == 0) || (last > count)) last = count;
+            if (last > ES920_CHANNEL_SCAN_MAX) last = ES920_CHANNEL_SCAN_MAX;
+
+            n = 0;
+            bool b = true;
+            for (uint8_t ch = first; ch <= last; ++ch) {
+                auto cfg = original;
+                cfg.channel = ch;
+                if (!b_ack) cfg.ack = false;
+                if (!radio.begin(serial, cfg)) {
+                    LOG_ERROR("scan: failed to configure channel", (int)ch);
+                    b = false;
+                    continue;
+                }
+                scores[n] = ChannelScore();
+                scores[n].channel = ch;
+                probe(scores[n]);
+                LOG_INFO("scan: channel", (int)ch, "busy", scores[n].busyRate(), "latency", scores[n].latencyMean());
+                ++n;
+            }
+
+            if (!radio.begin(serial, original)) {
+                LOG_ERROR("scan: failed to restore configuration");
+                return false;
+            }
+            return b && (n > 0);
+        }
+
+        // configures the best channel of last scan with current configuration
+        bool apply() {
+            const ChannelScore* s = best();
+            if (!s) return false;
+            if (s->channel == radio.channel()) return true;
+            auto cfg = radio.getConfigs();
+            cfg.channel = s->channel;
+            LOG_INFO("scan: change channel to", (int)s->channel);
+            return radio.begin(serial, cfg);
+        }
+
+        // results of last scan in channel order
+        uint8_t size() const { return n; }
+        const ChannelScore& at(const uint8_t i) const { return scores[i]; }
+
+        // channels from the least congested one
+        template <typename F>
+        void ranked(const F& f) const {
+            const ChannelScore* order[ES920_CHANNEL_SCAN_MAX];
+            for (uint8_t i = 0; i < n; ++i) {
+                uint8_t j = i;
+                for (; (j > 0) && better(scores[i], *order[j - 1]); --j) order[j] = order[j - 1];
+                order[j] = &scores[i];
+            }
+            for (uint8_t i = 0; i < n; ++i) f(*order[i]);
+        }
+
+        // nullptr if not scanned
+        const ChannelScore* best() const {
+            const ChannelScore* b = nullptr;
+            for (uint8_t i = 0; i < n; ++i)
+                if (!b || better(scores[i], *b)) b = &scores[i];
+            return b;
+        }
+
+    private:
+        void probe(ChannelScore& s) {
+            uint8_t data[Radio::payloadSize()] {};
+            for (uint8_t i = 0; i < n_probes; ++i) {
+                // all bytes differ and are outside ascii (no match in data or dictionary),
+                // so probes are never shortened by ES920_COMPRESS_ENABLE and keep probe_size of airtime
+                for (uint8_t k = 0; k < probe_size; ++k) data[k] = (uint8_t)(0x80 | ((i + k * 37) & 0x7F));
+                const uint32_t begin_ms = Clock::ms();
+                bool b_done = false;
+                ++s.probes;
+                const bool b_sent = radio.sendAsync(
+                    probe_index, data, probe_size, [&](const Reply& r) {
+                        b_done = true;
+                        if (r.b_timeout) {
+                            ++s.timeouts;
+                            return;
+                        }
+                        const uint32_t ms = Clock::ms() - begin_ms;
+                        s.latency_sum_ms += ms;
+                        if (ms > s.latency_max_ms) s.latency_max_ms = (ms > 0xFFFF) ? 0xFFFF : (uint16_t)ms;
+                        if (r.success())
+                            ++s.ok;
+                        else if (r.code == ErrorCode::CarriorSense)
+                            ++s.carrier_sense;
+                        else
+                            ++s.ng;
+                    },
+                    reply_timeout_ms);
+                if (!b_sent) {
+                    ++s.timeouts;
+                    continue;
+                }
+                while (!b_done) {
+                    radio.parse();
+                    Clock::idle();
+                }
+                while (Clock::ms() - begin_ms < interval_ms) {
+                    radio.parse();
+                    Clock::idle();
+                }
+            }
+        }
+
+        // lower NG 102 rate, then lower failure rate, then lower latency
+        static bool better(const ChannelScore& a, const ChannelScore& b) {
+            if (a.busyRate() != b.busyRate()) return a.busyRate() < b.busyRate();
+            if (a.failureRate() != b.failureRate()) return a.failureRate() < b.failureRate();
+            return a.latencyMean() < b.latencyMean();
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_CHANNEL_SCAN_H
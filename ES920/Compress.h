@@ -0,0 +1,136 @@
+#pragma once
+#ifndef ARDUINO_ES920_COMPRESS_H
+#define ARDUINO_ES920_COMPRESS_H
+
+// small LZ77 codec for binary payloads, applied before packetizing (COBS encoding)
+// the history window starts with a static dictionary shared by sender and receiver,
+// so short telemetry messages (json keys, common tokens) can refer to it from the first byte
+// no tables are allocated : encode() searches the window directly, decode() only needs the output buffer
+//
+// LITERAL : [0nnnnnnn] + (n + 1) bytes                 1 - 128 bytes
+// MATCH   : [1lllllob][oooooooo]  length l + 3, offset o + 1 back in (dictionary + output)    3 - 34 bytes, offset 1 - 1024
+//
+// ES920_COMPRESS_MAX_SIZE : max size of uncompressed data (<= PACKETIZER_MAX_PACKET_BINARY_SIZE on boards without libstdc++)
+// ES920_COMPRESS_DICTIONARY : string literal of the static dictionary (must be the same on both sides)
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifndef ES920_COMPRESS_MAX_SIZE
+#define ES920_COMPRESS_MAX_SIZE 128
+#endif
+
+#ifndef ES920_COMPRESS_DICTIONARY
+#define ES920_COMPRESS_DICTIONARY                                              \
+    "{\"id\":\"node\":\"seq\":\"ts\":\"time\":\"type\":\"status\":\"ok\","     \
+    "\"error\":\"value\":\"data\":[\"temp\":\"hum\":\"press\":\"lux\":\"co2\":" \
+    "\"batt\":\"volt\":\"rssi\":\"snr\":\"lat\":\"lon\":\"alt\":true,false,"   \
+    "null},{\"0.00,1.00,\":0,\":1,\":-1"
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    static_assert(ES920_COMPRESS_MAX_SIZE <= 255, "ES920_COMPRESS_MAX_SIZE must be <= 255");
+
+    namespace compress {
+
+        constexpr uint16_t WINDOW {1024};
+        constexpr uint8_t MIN_MATCH {3};
+        constexpr uint8_t MAX_MATCH {34};
+        constexpr uint8_t MAX_LITERALS {128};
+
+        // in program memory, read with ES920_PGM_READ_BYTE
+        inline const uint8_t* dictionary() {
+            static const char dict[] ES920_PROGMEM = ES920_COMPRESS_DICTIONARY;
+            return (const uint8_t*)dict;
+        }
+
+        constexpr uint16_t dictionarySize() {
+            return (uint16_t)(sizeof(ES920_COMPRESS_DICTIONARY) - 1);
+        }
+
+        static_assert(dictionarySize() + ES920_COMPRESS_MAX_SIZE <= WINDOW, "ES920_COMPRESS_DICTIONARY is too long");
+
+        // byte at position p of (dictionary + buf)
+        inline uint8_t at(const uint8_t* buf, const uint16_t p) {
+            return (p < dictionarySize()) ? ES920_PGM_READ_BYTE(dictionary() + p) : buf[p - dictionarySize()];
+        }
+
+        // returns compressed size, or 0 if data cannot be compressed into less than size bytes within capacity
+        inline size_t encode(const uint8_t* data, const size_t size, uint8_t* out, const size_t capacity) {
+            if ((size == 0) || (size > ES920_COMPRESS_MAX_SIZE)) return 0;
+            const size_t limit = (capacity < size - 1) ? capacity : size - 1;
+            size_t o = 0;
+            size_t lit_head = 0;
+            uint8_t n_lit = 0;
+
+            auto flush = [&]() {
+                if (n_lit == 0) return true;
+                if (o + 1 + n_lit > limit) return false;
+                out[o++] = (uint8_t)(n_lit - 1);
+                for (uint8_t k = 0; k < n_lit; ++k) out[o++] = data[lit_head + k];
+                n_lit = 0;
+                return true;
+            };
+
+            size_t i = 0;
+            while (i < size) {
+                const uint16_t pos = (uint16_t)(dictionarySize() + i);
+                const uint16_t from = (pos > WINDOW) ? (uint16_t)(pos - WINDOW) : 0;
+                uint8_t best_len = 0;
+                uint16_t best_pos = 0;
+                for (uint16_t p = from; p < pos; ++p) {
+                    if (at(data, p) != data[i]) continue;
+                    uint8_t len = 1;
+                    while ((len < MAX_MATCH) && (i + len < size) && (at(data, p + len) == data[i + len])) ++len;
+                    if (len > best_len) {
+                        best_len = len;
+                        best_pos = p;
+                        if (len == MAX_MATCH) break;
+                    }
+                }
+
+                if (best_len >= MIN_MATCH) {
+                    if (!flush() || (o + 2 > limit)) return 0;
+                    const uint16_t offset = (uint16_t)(pos - best_pos - 1);
+                    out[o++] = (uint8_t)(0x80 | ((best_len - MIN_MATCH) << 2) | (offset >> 8));
+                    out[o++] = (uint8_t)offset;
+                    i += best_len;
+                } else {
+                    if (n_lit == 0) lit_head = i;
+                    ++i;
+                    if ((++n_lit == MAX_LITERALS) && !flush()) return 0;
+                }
+            }
+            return flush() ? o : 0;
+        }
+
+        // returns uncompressed size, or 0 if data is broken or exceeds capacity
+        inline size_t decode(const uint8_t* data, const size_t size, uint8_t* out, const size_t capacity) {
+            size_t i = 0;
+            size_t o = 0;
+            while (i < size) {
+                const uint8_t t = data[i++];
+                if (!(t & 0x80)) {
+                    const size_t n = (size_t)t + 1;
+                    if ((i + n > size) || (o + n > capacity)) return 0;
+                    for (size_t k = 0; k < n; ++k) out[o++] = data[i++];
+                } else {
+                    if (i >= size) return 0;
+                    const uint8_t len = (uint8_t)(((t >> 2) & 0x1F) + MIN_MATCH);
+                    const uint16_t offset = (uint16_t)((((uint16_t)(t & 0x03) << 8) | data[i++]) + 1);
+                    const uint16_t pos = (uint16_t)(dictionarySize() + o);
+                    if ((offset > pos) || (o + len > capacity)) return 0;
+                    for (uint8_t k = 0; k < len; ++k, ++o) out[o] = at(out, (uint16_t)(pos + k - offset));
+                }
+            }
+            return o;
+        }
+
+    }  // namespace compress
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_COMPRESS_H
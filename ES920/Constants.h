@@ -7,11 +7,12 @@ namespace es920 {
 
 #ifdef ARDUINO
     using StringType = String;
-#elif defined(OF_VERSION_MAJOR)
+#else
     using StringType = std::string;
 #endif
 
     enum class ErrorCode : uint8_t {
+        None = 0,
         UndefinedCommand = 1,
         OptionValue = 2,
         FlashErase = 3,
@@ -23,6 +24,36 @@ namespace es920 {
         MissingAck = 103
     };
 
+    // result of a command or transmission reported by module ("OK" / "NG xxx")
+    struct Reply {
+        bool b_error {false};
+        bool b_timeout {false};
+        bool b_aborted {false};   // module was reset or reconfigured before the reply
+        bool b_rejected {false};  // not sent to module (wrong transmode or too long data), no reply comes
+        ErrorCode code {ErrorCode::None};
+
+        bool success() const { return !b_error && !b_timeout && !b_aborted && !b_rejected; }
+    };
+
+    using ReplyCallbackType = std::function<void(const Reply& reply)>;
+
+    // source of each received packet (only if rcvid is enabled)
+    using HeaderCallbackType = std::function<void(const uint16_t panid, const uint16_t ownid, const int16_t rssi, const bool b_rssi)>;
+
+    // relays of a frame mode packet (only for ES920, hops == 1 : direct)
+    struct FrameRoute {
+        uint8_t hops {1};                             // 1 - 4
+        uint16_t routes[3] {0x0001, 0x0001, 0x0001};  // relays (hops - 1) from the sender
+    };
+
+    // raw serial traffic observed by library (for capture / recording)
+    enum class Direction : uint8_t {
+        RX = 1,  // module -> host
+        TX       // host -> module
+    };
+
+    using TapCallbackType = std::function<void(const Direction dir, const uint8_t* data, const size_t size)>;
+
     // common
 
     enum class Mode : uint8_t {
@@ -0,0 +1,176 @@
+#pragma once
+#ifndef ARDUINO_ES920_COROUTINE_H
+#define ARDUINO_ES920_COROUTINE_H
+
+// C++20 coroutine support for host backends
+// awaitables are resolved from ES920Base::parse(), so call it from your event loop (e.g. ofApp::update())
+
+#if !defined(ARDUINO) && defined(__has_include)
+#if __has_include(<coroutine>) && (__cplusplus >= 202002L)
+#define ES920_COROUTINE_ENABLE
+#endif
+#endif
+
+#ifdef ES920_COROUTINE_ENABLE
+
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <vector>
+#include "Constants.h"
+
+namespace arduino {
+namespace es920 {
+
+    // received packet resumed by nextPacket()
+    struct Packet {
+        uint8_t index {0};
+        std::vector<uint8_t> data;
+        bool b_timeout {false};
+    };
+
+    // result holder shared between the dispatcher callback and the awaiting coroutine
+    // waiters are registered when the operation is issued (not when awaited),
+    // so several operations can be in flight and awaited in any order
+    template <typename T>
+    class Awaitable {
+        struct State {
+            T value {};
+            bool b_done {false};
+            std::coroutine_handle<> handle;
+        };
+        std::shared_ptr<State> state;
+
+    public:
+        Awaitable()
+        : state(std::make_shared<State>()) {}
+
+        void resolve(const T& v) const {
+            state->value = v;
+            state->b_done = true;
+            if (state->handle) {
+                auto h = state->handle;
+                state->handle = nullptr;
+                h.resume();
+            }
+        }
+
+        bool done() const { return state->b_done; }
+        const T& value() const { return state->value; }
+
+        bool await_ready() const noexcept { return state->b_done; }
+        void await_suspend(std::coroutine_handle<> h) noexcept { state->handle = h; }
+        T await_resume() const { return state->value; }
+    };
+
+    template <typename T>
+    class Task;
+
+    namespace detail {
+
+        struct TaskPromiseBase {
+            std::coroutine_handle<> continuation;
+            bool b_detached {false};
+
+            struct FinalAwaiter {
+                bool await_ready() const noexcept { return false; }
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+                    auto& p = h.promise();
+                    if (p.continuation) return p.continuation;
+                    // nobody owns this task anymore
+                    if (p.b_detached) h.destroy();
+                    return std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+
+            // tasks start eagerly and run until the first suspension point
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            FinalAwaiter final_suspend() const noexcept { return {}; }
+            void unhandled_exception() const { std::terminate(); }
+        };
+
+        template <typename T>
+        struct TaskPromise : TaskPromiseBase {
+            T value {};
+            Task<T> get_return_object();
+            void return_value(const T& v) { value = v; }
+            const T& result() const { return value; }
+        };
+
+        template <>
+        struct TaskPromise<void> : TaskPromiseBase {
+            Task<void> get_return_object();
+            void return_void() const {}
+            void result() const {}
+        };
+
+    }  // namespace detail
+
+    // coroutine return type, can be awaited from other coroutines or polled by done()
+    // if Task is destroyed before completion, the coroutine keeps running and cleans up itself
+    template <typename T>
+    class Task {
+    public:
+        using promise_type = detail::TaskPromise<T>;
+        using handle_type = std::coroutine_handle<promise_type>;
+
+    private:
+        handle_type handle;
+
+    public:
+        Task() = default;
+        explicit Task(handle_type h)
+        : handle(h) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        Task(Task&& t) noexcept
+        : handle(t.handle) { t.handle = nullptr; }
+        Task& operator=(Task&& t) noexcept {
+            if (this != &t) {
+                release();
+                handle = t.handle;
+                t.handle = nullptr;
+            }
+            return *this;
+        }
+        ~Task() { release(); }
+
+        bool done() const { return !handle || handle.done(); }
+        decltype(auto) result() const { return handle.promise().result(); }
+
+        bool await_ready() const noexcept { return done(); }
+        void await_suspend(std::coroutine_handle<> h) noexcept { handle.promise().continuation = h; }
+        decltype(auto) await_resume() const { return handle.promise().result(); }
+
+    private:
+        void release() {
+            if (!handle) return;
+            if (handle.done())
+                handle.destroy();
+            else
+                handle.promise().b_detached = true;
+            handle = nullptr;
+        }
+    };
+
+    namespace detail {
+
+        template <typename T>
+        inline Task<T> TaskPromise<T>::get_return_object() {
+            return Task<T>(Task<T>::handle_type::from_promise(*this));
+        }
+
+        inline Task<void> TaskPromise<void>::get_return_object() {
+            return Task<void>(Task<void>::handle_type::from_promise(*this));
+        }
+
+    }  // namespace detail
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ES920_COROUTINE_ENABLE
+
+#endif  // ARDUINO_ES920_COROUTINE_H
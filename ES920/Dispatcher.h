@@ -0,0 +1,231 @@
+#pragma once
+#ifndef ARDUINO_ES920_DISPATCHER_H
+#define ARDUINO_ES920_DISPATCHER_H
+
+#include "Constants.h"
+#include "Utils.h"
+#include "Stats.h"
+#include <ArxContainer.h>
+
+// max number of reply waiters (sendAsync() / send() with timeout) at the same time
+// further waiters are completed with timeout reply instead of evicting the oldest one
+#ifndef ES920_MAX_REPLY_WAITERS
+#if ARX_HAVE_LIBSTDCPLUSPLUS >= 201103L  // Have libstdc++11
+#define ES920_MAX_REPLY_WAITERS 64
+#else
+#define ES920_MAX_REPLY_WAITERS 4
+#endif
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    // data == nullptr means that the waiter has been timed out
+    using PacketCallbackType = std::function<void(const uint8_t index, const uint8_t* data, const size_t size)>;
+    using TimerCallbackType = std::function<void()>;
+
+    // keeps callbacks which are waiting for replies, packets or time
+    // everything is resolved from poll() (called in parse()), so nothing blocks
+    class Dispatcher {
+        struct ReplyWaiter {
+            uint32_t start_ms;
+            uint32_t timeout_ms;
+            uint8_t skip;  // replies of fire-and-forget sends before this waiter
+            ReplyCallbackType cb;
+        };
+        struct PacketWaiter {
+            uint8_t index;
+            uint32_t start_ms;
+            uint32_t timeout_ms;
+            PacketCallbackType cb;
+        };
+        struct TimerWaiter {
+            uint32_t start_ms;
+            uint32_t wait_ms;
+            TimerCallbackType cb;
+        };
+
+#if ARX_HAVE_LIBSTDCPLUSPLUS >= 201103L  // Have libstdc++11
+        using ReplyQueue = std::deque<ReplyWaiter>;
+        using PacketQueue = std::deque<PacketWaiter>;
+        using TimerQueue = std::deque<TimerWaiter>;
+#else
+        using ReplyQueue = arx::stdx::deque<ReplyWaiter, ES920_MAX_REPLY_WAITERS>;
+        using PacketQueue = arx::stdx::deque<PacketWaiter, 4>;
+        using TimerQueue = arx::stdx::deque<TimerWaiter, 4>;
+#endif
+
+        // replies come back in the same order as commands/data were sent
+        // fire-and-forget sends take no waiter, only their replies are counted to be skipped
+        ReplyQueue replies;
+        PacketQueue packets;
+        TimerQueue timers;
+        uint8_t tail_skip {0};  // replies of fire-and-forget sends after the last waiter
+        uint32_t tail_ms {0};
+        uint32_t tail_timeout_ms {0};
+
+        uint32_t reply_timeouts {0};
+        uint32_t rejected_waiters {0};
+        uint16_t max_replies {0};
+        uint16_t max_packets {0};
+
+    public:
+        // timeout_ms == 0 : wait forever
+        // if the queue is full, cb is called with timeout reply and false is returned
+        // (the reply is still expected, so it is skipped when it comes)
+        bool waitReply(const uint32_t now_ms, const uint32_t timeout_ms, const ReplyCallbackType& cb) {
+            if (!canWaitReply()) {
+                LOG_WARN("too many reply waiters, max =", ES920_MAX_REPLY_WAITERS);
+                ++rejected_waiters;
+                expectReply(now_ms, timeout_ms);
+                Reply r;
+                r.b_timeout = true;
+                if (cb) cb(r);
+                return false;
+            }
+            ReplyWaiter w;
+            w.start_ms = now_ms;
+            w.timeout_ms = timeout_ms;
+            w.skip = tail_skip;
+            w.cb = cb;
+            tail_skip = 0;
+            replies.push_back(w);
+            updateMax(max_replies, replies.size());
+            return true;
+        }
+
+        // reply of fire-and-forget send, skipped when it comes (forgotten after timeout_ms if no waiter follows)
+        void expectReply(const uint32_t now_ms, const uint32_t timeout_ms) {
+            if (tail_skip < 0xFF) ++tail_skip;
+            tail_ms = now_ms;
+            tail_timeout_ms = timeout_ms;
+        }
+
+        bool canWaitReply() const { return replies.size() < ES920_MAX_REPLY_WAITERS; }
+
+        // timeout_ms == 0 : wait forever
+        void waitPacket(const uint8_t index, const uint32_t now_ms, const uint32_t timeout_ms, const PacketCallbackType& cb) {
+            PacketWaiter w;
+            w.index = index;
+            w.start_ms = now_ms;
+            w.timeout_ms = timeout_ms;
+            w.cb = cb;
+            packets.push_back(w);
+            updateMax(max_packets, packets.size());
+        }
+
+        // wait_ms == 0 : resolved at next poll()
+        void waitTime(const uint32_t now_ms, const uint32_t wait_ms, const TimerCallbackType& cb) {
+            TimerWaiter w;
+            w.start_ms = now_ms;
+            w.wait_ms = wait_ms;
+            w.cb = cb;
+            timers.push_back(w);
+        }
+
+        void onReply(const Reply& r) {
+            if (replies.empty()) {
+                if (tail_skip) --tail_skip;
+                return;
+            }
+            if (replies.front().skip) {
+                --replies.front().skip;
+                return;
+            }
+            ReplyCallbackType cb = replies.front().cb;
+            replies.pop_front();
+            if (cb) cb(r);
+        }
+
+        void onPacket(const uint8_t index, const uint8_t* data, const size_t size) {
+            // callbacks may add new waiters, they will wait for the next packet
+            const size_t n = packets.size();
+            for (size_t i = 0; i < n; ++i) {
+                PacketWaiter w = packets.front();
+                packets.pop_front();
+                if (w.index == index) {
+                    if (w.cb) w.cb(index, data, size);
+                } else
+                    packets.push_back(w);
+            }
+        }
+
+        void poll(const uint32_t now_ms) {
+            while (!replies.empty()) {
+                const ReplyWaiter& w = replies.front();
+                if ((w.timeout_ms == 0) || (now_ms - w.start_ms < w.timeout_ms)) break;
+                ReplyCallbackType cb = w.cb;
+                replies.pop_front();
+                LOG_WARN("reply timeout");
+                ++reply_timeouts;
+                Reply r;
+                r.b_timeout = true;
+                if (cb) cb(r);
+            }
+            if (tail_skip && replies.empty() && (tail_timeout_ms != 0) && (now_ms - tail_ms >= tail_timeout_ms))
+                tail_skip = 0;
+
+            size_t n = packets.size();
+            for (size_t i = 0; i < n; ++i) {
+                PacketWaiter w = packets.front();
+                packets.pop_front();
+                if ((w.timeout_ms != 0) && (now_ms - w.start_ms >= w.timeout_ms)) {
+                    if (w.cb) w.cb(w.index, nullptr, 0);
+                } else
+                    packets.push_back(w);
+            }
+
+            n = timers.size();
+            for (size_t i = 0; i < n; ++i) {
+                TimerWaiter w = timers.front();
+                timers.pop_front();
+                if (now_ms - w.start_ms >= w.wait_ms) {
+                    if (w.cb) w.cb();
+                } else
+                    timers.push_back(w);
+            }
+        }
+
+        // fails all reply waiters (module was reset or reconfigured, their replies never come)
+        // waiters added by callbacks are kept
+        void abortReplies() {
+            tail_skip = 0;
+            const size_t n = replies.size();
+            for (size_t i = 0; i < n; ++i) {
+                ReplyCallbackType cb = replies.front().cb;
+                replies.pop_front();
+                Reply r;
+                r.b_aborted = true;
+                if (cb) cb(r);
+            }
+        }
+
+        void clear() {
+            tail_skip = 0;
+            replies.clear();
+            packets.clear();
+            timers.clear();
+        }
+
+        size_t pendingReplies() const { return replies.size(); }
+        size_t pendingPackets() const { return packets.size(); }
+        size_t pendingTimers() const { return timers.size(); }
+
+        // adds counters to s
+        void stats(Stats& s) const {
+            s.reply_timeouts += reply_timeouts;
+            s.rejected_waiters += rejected_waiters;
+            updateMax(s.max_reply_waiters, max_replies);
+            updateMax(s.max_packet_waiters, max_packets);
+        }
+
+        void resetStats() {
+            reply_timeouts = rejected_waiters = 0;
+            max_replies = max_packets = 0;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_DISPATCHER_H
@@ -0,0 +1,201 @@
+#pragma once
+#ifndef ARDUINO_ES920_DOWNLINK_H
+#define ARDUINO_ES920_DOWNLINK_H
+
+// store-and-forward downlink for sleeping end devices (coordinator side)
+// messages are held per node until an uplink from the node is parsed,
+// then sent one by one with sendToAsync() while the node keeps receiving after its transmission
+// binary format, TransMode::FRAME and rcvid must be enabled
+// ES920_DOWNLINK_NODES : max number of nodes which have queued messages
+// ES920_DOWNLINK_DEPTH : max number of messages queued per node
+
+#include "Constants.h"
+#include "Utils.h"
+#include "Stats.h"
+#include "Latency.h"
+
+#ifndef ES920_DOWNLINK_NODES
+#define ES920_DOWNLINK_NODES 8
+#endif
+
+#ifndef ES920_DOWNLINK_DEPTH
+#define ES920_DOWNLINK_DEPTH 4
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct DownlinkStats {
+        uint32_t queued {0};
+        uint32_t delivered {0};  // replied OK
+        uint32_t expired {0};
+        uint32_t rejected {0};  // queue was full
+        uint32_t failed {0};    // replied NG or timeout (message is kept for next window)
+        uint32_t wakeups {0};   // uplinks from nodes with queued messages
+        uint16_t max_fill {0};  // messages queued at once
+        LatencyHistogram latency;  // queued -> delivered [ms]
+
+        void clear() { *this = DownlinkStats(); }
+    };
+
+    template <typename Radio, typename Clock = DefaultClock>
+    class DownlinkQueue {
+        struct Message {
+            uint32_t queued_ms;
+            uint8_t index;
+            uint8_t size;
+            uint8_t data[Radio::payloadSize()];
+        };
+
+        struct Node {
+            uint16_t ownid {0};
+            uint32_t wake_ms {0};
+            bool b_awake {false};
+            uint8_t head {0};
+            uint8_t count {0};
+            Message messages[ES920_DOWNLINK_DEPTH];
+
+            Message& front() { return messages[head]; }
+            void pop() {
+                head = (head + 1) % ES920_DOWNLINK_DEPTH;
+                --count;
+            }
+        };
+
+        Radio& radio;
+        Node nodes[ES920_DOWNLINK_NODES];
+        uint16_t n_queued {0};
+        Node* inflight {nullptr};
+        DownlinkStats counters;
+
+        uint32_t window_ms {500};
+        uint32_t expire_ms {600000};
+        uint32_t reply_timeout_ms {2000};
+
+    public:
+        explicit DownlinkQueue(Radio& r)
+        : radio(r) {
+            radio.subscribeHeader([&](const uint16_t pan, const uint16_t own, const int16_t, const bool) {
+                if (pan != radio.panid()) return;
+                Node* n = find(own);
+                if (!n || (n->count == 0)) return;
+                n->wake_ms = Clock::ms();
+                n->b_awake = true;
+                ++counters.wakeups;
+            });
+        }
+
+        // time the node keeps receiving after its uplink
+        void window(const uint32_t ms) { window_ms = ms; }
+        // messages not delivered in this time are dropped
+        void expire(const uint32_t ms) { expire_ms = ms; }
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+
+        // false if the queue of the node (or the node table) is full
+        bool push(const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size) {
+            if (size > Radio::payloadSize()) {
+                LOG_WARN("downlink: too long data, must be <= ", Radio::payloadSize(), ". size = ", size);
+                return false;
+            }
+            Node* n = find(dst);
+            if (!n) n = add(dst);
+            if (!n || (n->count == ES920_DOWNLINK_DEPTH)) {
+                ++counters.rejected;
+                return false;
+            }
+            Message& m = n->messages[(n->head + n->count) % ES920_DOWNLINK_DEPTH];
+            m.queued_ms = Clock::ms();
+            m.index = index;
+            m.size = size;
+            for (uint8_t i = 0; i < size; ++i) m.data[i] = data[i];
+            ++n->count;
+            ++n_queued;
+            ++counters.queued;
+            updateMax(counters.max_fill, n_queued);
+            return true;
+        }
+
+        // call after parse() in main loop
+        void update() {
+            const uint32_t now_ms = Clock::ms();
+            for (auto& n : nodes) {
+                if (&n == inflight) continue;
+                while ((n.count > 0) && (now_ms - n.front().queued_ms > expire_ms)) {
+                    n.pop();
+                    --n_queued;
+                    ++counters.expired;
+                }
+                if (n.b_awake && ((n.count == 0) || (now_ms - n.wake_ms > window_ms))) n.b_awake = false;
+            }
+            if (inflight) return;
+
+            for (auto& n : nodes) {
+                if (!n.b_awake || (n.count == 0)) continue;
+                Node* node = &n;
+                const Message& m = n.front();
+                const bool b_sent = radio.sendToAsync(
+                    n.ownid, m.index, m.data, m.size, [&, node](const Reply& r) {
+                        inflight = nullptr;
+                        if (!r.success() || (node->count == 0)) {
+                            ++counters.failed;
+                            return;
+                        }
+                        counters.latency.record(Clock::ms() - node->front().queued_ms);
+                        ++counters.delivered;
+                        node->pop();
+                        --n_queued;
+                    },
+                    reply_timeout_ms);
+                if (b_sent) inflight = node;
+                return;
+            }
+        }
+
+        uint16_t size() const { return n_queued; }
+        uint8_t size(const uint16_t dst) const {
+            const Node* n = const_cast<DownlinkQueue*>(this)->find(dst);
+            return n ? n->count : 0;
+        }
+
+        // drops all queued messages (a message in flight is kept until replied)
+        void clear() {
+            for (auto& n : nodes) {
+                if (&n == inflight) {
+                    n_queued -= (uint16_t)(n.count - 1);
+                    n.count = 1;
+                } else {
+                    n_queued -= n.count;
+                    n.count = 0;
+                    n.b_awake = false;
+                }
+            }
+        }
+
+        const DownlinkStats& stats() const { return counters; }
+        void resetStats() { counters.clear(); }
+
+    private:
+        Node* find(const uint16_t ownid) {
+            for (auto& n : nodes)
+                if ((n.ownid == ownid) && (n.count > 0 || &n == inflight)) return &n;
+            return nullptr;
+        }
+
+        // reuses a node without queued messages
+        Node* add(const uint16_t ownid) {
+            for (auto& n : nodes) {
+                if ((n.count == 0) && (&n != inflight)) {
+                    n.ownid = ownid;
+                    n.head = 0;
+                    n.b_awake = false;
+                    return &n;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_DOWNLINK_H
@@ -0,0 +1,790 @@
+#pragma once
+#ifndef ARDUINO_ES920_EMULATOR_H
+#define ARDUINO_ES920_EMULATOR_H
+
+// in-process emulator of ES920 / ES920LR modules (host only)
+// VirtualModule has ofSerial compatible interface, so ES920_<VirtualModule> runs without hardware
+// modules attached to the same AirLink can talk to each other
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include "Airtime.h"
+
+namespace arduino {
+namespace es920 {
+
+    class AirLink;
+
+    // frame on the air
+    struct AirFrame {
+        uint8_t channel {1};
+        uint16_t panid {0x0001};
+        uint16_t srcid {0x0001};
+        uint16_t dstid {0x0000};
+        std::string data;
+    };
+
+    class VirtualModule {
+        friend class AirLink;
+
+    public:
+        enum class Model : uint8_t {
+            ES920,
+            ES920LR
+        };
+
+    private:
+        enum class State : uint8_t {
+            BOOTING,
+            SELECT,
+            PROCESSOR,
+            OPERATION
+        };
+
+        struct Output {
+            uint64_t ready_us;
+            std::string bytes;
+        };
+
+        const std::string line_config {"Select Mode [1.terminal or 2.processor]"};
+        const std::string line_operation {" ----- operation mode is ready ----- "};
+        const std::string line_trigger {"config\r\n"};
+
+        Model model_type;
+        Config flash;   // saved settings, restored at boot
+        Config active;  // current settings
+        AirLink* link {nullptr};
+
+        State state {State::BOOTING};
+        bool b_boot_config {false};  // "config" is received in operation mode
+        uint32_t boot_ms {100};
+        uint64_t boot_us {0};
+        uint64_t busy_until_us {0};
+        Baudrate uart {Baudrate::BD_115200};
+        uint32_t host_baud {0};  // 0 : closed
+        bool b_virtual_clock {false};
+
+        std::string input;
+        std::deque<Output> outputs;  // sorted by ready_us
+        std::deque<uint8_t> rx;      // can be read by host
+
+        size_t tx_frames {0};
+        size_t rx_frames {0};
+
+    public:
+        // module is powered on at construction and boots with saved settings
+        explicit VirtualModule(const Model m = Model::ES920, const Config& saved = Config())
+        : model_type(m), flash(saved), active(saved), uart(saved.baudrate) {
+            boot_us = nowUs() + (uint64_t)boot_ms * 1000;
+        }
+        VirtualModule(const VirtualModule&) = delete;
+        VirtualModule& operator=(const VirtualModule&) = delete;
+        ~VirtualModule();
+
+        // ofSerial compatible interface
+
+        bool setup(const std::string&, const int baud) {
+            host_baud = (uint32_t)baud;
+            return true;
+        }
+
+        void close() { host_baud = 0; }
+        bool isInitialized() const { return host_baud != 0; }
+
+        int available() {
+            update();
+            return (int)rx.size();
+        }
+
+        int readByte() {
+            update();
+            if (rx.empty()) return -1;
+            const uint8_t d = rx.front();
+            rx.pop_front();
+            return d;
+        }
+
+        int read() { return readByte(); }
+
+        bool writeByte(const uint8_t d) {
+            return writeBytes(&d, 1) == 1;
+        }
+
+        long writeBytes(const uint8_t* data, const size_t size) {
+            update();
+            // bytes are garbled if baudrate is not matched
+            if (baudMatched()) {
+                input.append((const char*)data, size);
+                process();
+            }
+            return (long)size;
+        }
+
+        long writeBytes(const char* data, const size_t size) {
+            return writeBytes((const uint8_t*)data, size);
+        }
+
+        void flush() {}
+
+        // same as pushing reset button
+        void reset();
+
+        // process boot sequence, replies and received frames which are due
+        void update();
+
+        // time when update() has something to do next (UINT64_MAX if nothing)
+        uint64_t nextEventUs() const {
+            uint64_t t = outputs.empty() ? UINT64_MAX : outputs.front().ready_us;
+            if (state == State::BOOTING) t = std::min(t, boot_us);
+            return t;
+        }
+
+        void bootTime(const uint32_t ms) { boot_ms = ms; }
+
+        // use VirtualClock if not attached to AirLink (AirLink decides clock otherwise)
+        void virtualClock(const bool b) {
+            b_virtual_clock = b;
+            if (state == State::BOOTING) boot_us = nowUs() + (uint64_t)boot_ms * 1000;
+        }
+
+        Model model() const { return model_type; }
+        const Config& config() const { return active; }
+        const Config& savedConfig() const { return flash; }
+        bool isOperating() const { return state == State::OPERATION; }
+        size_t txFrames() const { return tx_frames; }
+        size_t rxFrames() const { return rx_frames; }
+
+        // time on air of the data in current modulation
+        uint32_t airtimeUs(const size_t size) const {
+            return airtime::airUs(model_type == Model::ES920LR, active.rate, active.sf, active.bw, size);
+        }
+
+    private:
+        uint64_t nowUs() const;
+
+        bool baudMatched() const { return host_baud == toBaudrate(uart); }
+        uint8_t payloadSize() const { return (model_type == Model::ES920LR) ? PAYLOAD_SIZE_ES920LR : PAYLOAD_SIZE_ES920; }
+
+        void emit(const uint64_t ready_us, const std::string& bytes) {
+            const uint64_t t = ready_us + airtime::serialUs(uart, bytes.size());
+            auto it = std::upper_bound(outputs.begin(), outputs.end(), t, [](const uint64_t v, const Output& o) {
+                return v < o.ready_us;
+            });
+            outputs.insert(it, Output {t, bytes});
+        }
+
+        void boot() {
+            active = flash;
+            uart = flash.baudrate;
+            const bool b_config = b_boot_config || (flash.operation == Mode::CONFIG);
+            b_boot_config = false;
+
+            // noise which is output at reset depends on baudrate (same as AsciiParser expects)
+            emit(boot_us, resetNoise(uart) + "\r\n");
+            if (b_config) {
+                emit(boot_us, line_config + "\r\n");
+                state = State::SELECT;
+            } else {
+                emit(boot_us, line_operation + "\r\n");
+                state = State::OPERATION;
+            }
+        }
+
+        static std::string resetNoise(const Baudrate b) {
+            switch (b) {
+                case Baudrate::BD_19200:
+                    return "\xFF";
+                case Baudrate::BD_38400:
+                case Baudrate::BD_57600:
+                    return "\xFF\xFF\xFF";
+                case Baudrate::BD_115200:
+                    return "\xFC\xFC\xFC";
+                case Baudrate::BD_230400:
+                    return "\xE0\xE0\xE0";
+                default:
+                    return "";
+            }
+        }
+
+        void reply(const uint64_t ready_us, const ErrorCode e) {
+            const bool b_binary = (state == State::OPERATION) && (active.format == Format::BINARY);
+            char code[8];
+            std::snprintf(code, sizeof(code), "%03d", (int)e);
+            if (e == ErrorCode::None)
+                emit(ready_us, b_binary ? std::string("\x02OK") : std::string("OK\r\n"));
+            else
+                emit(ready_us, b_binary ? (std::string("\x06NG ") + code) : (std::string("NG ") + code + "\r\n"));
+        }
+
+        void process() {
+            while (!input.empty()) {
+                if ((state == State::OPERATION) && (active.format == Format::BINARY)) {
+                    // "config" is accepted also in binary format
+                    const size_t n = std::min(input.size(), line_trigger.size());
+                    if (input.compare(0, n, line_trigger, 0, n) != 0) {
+                        const size_t size = (uint8_t)input[0];
+                        if (input.size() < size + 1) break;
+                        const std::string frame = input.substr(1, size);
+                        input.erase(0, size + 1);
+                        operate(frame);
+                        continue;
+                    }
+                }
+
+                const size_t pos = input.find("\r\n");
+                if (pos == std::string::npos) break;
+                const std::string line = input.substr(0, pos);
+                input.erase(0, pos + 2);
+
+                if (state == State::SELECT)
+                    select(line);
+                else if (state == State::PROCESSOR)
+                    command(line);
+                else if (state == State::OPERATION) {
+                    if (line == "config")
+                        b_boot_config = true;
+                    else
+                        operate(line);
+                }
+            }
+        }
+
+        void select(const std::string& line) {
+            if (line == "2") {
+                state = State::PROCESSOR;
+                reply(nowUs(), ErrorCode::None);
+            } else if (line == "1")
+                LOG_WARN("virtual module: terminal mode is not supported");
+        }
+
+        void command(const std::string& line) {
+            if (line.empty()) return;
+            const size_t pos = line.find(' ');
+            const std::string cmd = line.substr(0, pos);
+            const std::string arg = (pos == std::string::npos) ? "" : line.substr(pos + 1);
+
+            if (cmd == "version") {
+                emit(nowUs(), "VER 1.00\r\n");
+                return;
+            }
+            const ErrorCode e = apply(cmd, arg);
+            // baudrate is changed right after the command, so reply cannot be read
+            if ((cmd == "baudrate") && (e == ErrorCode::None)) return;
+            reply(nowUs(), e);
+        }
+
+        ErrorCode apply(const std::string& cmd, const std::string& arg) {
+            const bool b_lr = (model_type == Model::ES920LR);
+            long v = 0;
+            const bool b_dec = toLong(arg, 10, v);
+            const bool b_hex = (arg.size() == 4) && toLong(arg, 16, v);
+            auto inRange = [&](const bool b, const long lo, const long hi) { return b && (v >= lo) && (v <= hi); };
+
+            if (cmd == "save") {
+                flash = active;
+                flash.baudrate = uart;
+                return ErrorCode::None;
+            } else if (cmd == "load") {
+                active = Config();
+                return ErrorCode::None;
+            } else if (cmd == "start") {
+                state = State::OPERATION;
+                return ErrorCode::None;
+            } else if (cmd == "senddata") {
+                if (arg.size() > PAYLOAD_SIZE_ES920LR) return ErrorCode::OptionValue;
+                active.senddata = arg;
+                return ErrorCode::None;
+            }
+
+            if (cmd == "node") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.node = (Node)v;
+            } else if (cmd == "channel") {
+                const long n = b_lr ? channelCount(active.bw) : channelCount(active.rate);
+                if (!inRange(b_dec, 1, n)) return ErrorCode::OptionValue;
+                active.channel = (uint8_t)v;
+            } else if (cmd == "panid") {
+                if (!inRange(b_hex, 0x0001, 0xFFFE)) return ErrorCode::OptionValue;
+                active.panid = (uint16_t)v;
+            } else if (cmd == "ownid") {
+                if (!inRange(b_hex, 0x0000, 0xFFFE)) return ErrorCode::OptionValue;
+                active.ownid = (uint16_t)v;
+            } else if (cmd == "dstid") {
+                if (!inRange(b_hex, 0x0000, 0xFFFF)) return ErrorCode::OptionValue;
+                active.dstid = (uint16_t)v;
+            } else if (cmd == "ack") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.ack = (v == 1);
+            } else if (cmd == "retry") {
+                if (!inRange(b_dec, 0, 10)) return ErrorCode::OptionValue;
+                active.retry = (uint8_t)v;
+            } else if (cmd == "transmode") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.transmode = (TransMode)v;
+            } else if (cmd == "rcvid") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.rcvid = (v == 1);
+            } else if (cmd == "rssi") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.rssi = (v == 1);
+            } else if (cmd == "operation") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.operation = (Mode)v;
+            } else if (cmd == "baudrate") {
+                if (!inRange(b_dec, 1, 6)) return ErrorCode::OptionValue;
+                active.baudrate = uart = (Baudrate)v;
+            } else if (cmd == "sleep") {
+                if (!inRange(b_dec, 1, 3)) return ErrorCode::OptionValue;
+                active.sleep = (SleepMode)v;
+            } else if (cmd == "sleeptime") {
+                if (!inRange(b_dec, 0, 0xFFFFFF)) return ErrorCode::OptionValue;
+                active.sleeptime = (uint32_t)v;
+            } else if (cmd == "power") {
+                if (!inRange(b_dec, -4, 13)) return ErrorCode::OptionValue;
+                active.power = (uint8_t)v;
+            } else if (cmd == "format") {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.format = (Format)v;
+            } else if (cmd == "sendtime") {
+                if (!inRange(b_dec, 0, 0xFFFF)) return ErrorCode::OptionValue;
+                active.sendtime = (uint32_t)v;
+            } else if (!b_lr && (cmd == "rate")) {
+                if (!inRange(b_dec, 1, 2)) return ErrorCode::OptionValue;
+                active.rate = (Rate)v;
+            } else if (!b_lr && (cmd == "hopcount")) {
+                if (!inRange(b_dec, 1, 4)) return ErrorCode::OptionValue;
+                active.hopcount = (uint8_t)v;
+            } else if (!b_lr && (cmd == "endid")) {
+                if (!inRange(b_hex, 0x0000, 0xFFFE)) return ErrorCode::OptionValue;
+                active.endid = (uint16_t)v;
+            } else if (!b_lr && ((cmd == "route1") || (cmd == "route2") || (cmd == "route3"))) {
+                if (!inRange(b_hex, 0x0001, 0xFFFE)) return ErrorCode::OptionValue;
+                uint16_t& route = (cmd == "route1") ? active.route1 : ((cmd == "route2") ? active.route2 : active.route3);
+                route = (uint16_t)v;
+            } else if (b_lr && (cmd == "bw")) {
+                if (!inRange(b_dec, 3, 6)) return ErrorCode::OptionValue;
+                active.bw = (BW)v;
+            } else if (b_lr && (cmd == "sf")) {
+                if (!inRange(b_dec, 7, 12)) return ErrorCode::OptionValue;
+                active.sf = (SF)v;
+            } else
+                return ErrorCode::UndefinedCommand;
+
+            return ErrorCode::None;
+        }
+
+        static bool toLong(const std::string& s, const int base, long& v) {
+            if (s.empty()) return false;
+            char* end = nullptr;
+            v = std::strtol(s.c_str(), &end, base);
+            return *end == '\0';
+        }
+
+        // data from host in operation mode
+        void operate(const std::string& line) {
+            AirFrame f;
+            f.channel = active.channel;
+            f.panid = active.panid;
+            f.srcid = active.ownid;
+            f.dstid = active.dstid;
+            if (active.transmode == TransMode::FRAME) {
+                long pan = 0, dst = 0;
+                if ((line.size() < 8) || !toLong(line.substr(0, 4), 16, pan) || !toLong(line.substr(4, 4), 16, dst)) {
+                    reply(nowUs(), ErrorCode::SendDataLength);
+                    return;
+                }
+                size_t head = 8;
+                if (model_type == Model::ES920) {
+                    // hop count and relays (relays are not emulated, frame is delivered directly)
+                    long hops = 0;
+                    if ((line.size() < 10) || !toLong(line.substr(8, 2), 16, hops) || (hops < 1) || (hops > 4) || (line.size() < 10 + 4 * (size_t)(hops - 1))) {
+                        reply(nowUs(), ErrorCode::SendDataLength);
+                        return;
+                    }
+                    head = 10 + 4 * (size_t)(hops - 1);
+                }
+                f.panid = (uint16_t)pan;
+                f.dstid = (uint16_t)dst;
+                f.data = line.substr(head);
+            } else
+                f.data = line;
+
+            const uint64_t now_us = nowUs();
+            if (f.data.empty() || (f.data.size() > payloadSize()))
+                reply(now_us, ErrorCode::SendDataLength);
+            else if (now_us < busy_until_us)
+                reply(now_us, ErrorCode::SendProcessError);
+            else
+                transmit(f, now_us + airtime::serialUs(uart, line.size() + 2));
+        }
+
+        void transmit(const AirFrame& f, const uint64_t start_us);
+
+        // result of transmission from AirLink
+        void finish(const uint64_t done_us, const ErrorCode e) {
+            busy_until_us = done_us;
+            reply(done_us, e);
+        }
+
+        // frame from AirLink
+        void receive(const AirFrame& f, const int16_t rssi, const uint64_t at_us) {
+            if (state != State::OPERATION) return;
+            ++rx_frames;
+
+            char buf[16];
+            std::string header;
+            if (active.rssi) {
+                if (model_type == Model::ES920LR)
+                    std::snprintf(buf, sizeof(buf), "%04d", (int)rssi);
+                else
+                    std::snprintf(buf, sizeof(buf), "%02X", (unsigned)((-rssi * 2) & 0xFF));
+                header += buf;
+            }
+            if (active.rcvid) {
+                std::snprintf(buf, sizeof(buf), "%04X", (unsigned)f.panid);
+                header += buf;
+                std::snprintf(buf, sizeof(buf), "%04X", (unsigned)f.srcid);
+                if (model_type == Model::ES920) header += buf;  // hop id (direct)
+                header += buf;
+            }
+
+            if (active.format == Format::BINARY)
+                emit(at_us, std::string(1, (char)(header.size() + f.data.size())) + header + f.data);
+            else
+                emit(at_us, header + f.data + "\r\n");
+        }
+    };
+
+    // shared air between virtual modules
+    // frames reach every module with the same model, modulation, channel and panid, addressed to it or broadcast
+    // frames overlapping on the same channel collide, and busy channel is detected by carrier sense
+    class AirLink {
+        enum class EventType : uint8_t {
+            START,  // carrier sense and start of an attempt
+            END,    // end of an attempt
+            DELIVER
+        };
+
+        struct Event {
+            EventType type;
+            uint32_t tx;  // START / END
+            VirtualModule* to;  // DELIVER
+            AirFrame frame;     // DELIVER
+        };
+
+        struct Transmission {
+            VirtualModule* from;
+            AirFrame frame;
+            uint64_t start_us {0};
+            uint64_t end_us {0};  // 0 : not on the air yet
+            uint8_t attempts {0};
+            uint8_t senses {0};
+            bool b_done {false};
+        };
+
+        std::vector<VirtualModule*> modules;
+        std::multimap<uint64_t, Event> events;  // same time events keep the order of insertion
+        std::map<uint32_t, Transmission> txs;
+        uint32_t next_tx {0};
+
+        uint32_t latency_us {0};
+        float loss_rate {0.f};
+        int16_t rssi_dbm {-60};
+        uint32_t ack_margin_us {5000};
+        uint32_t backoff_us {10000};  // max random backoff after carrier sense
+        uint8_t max_senses {4};
+        uint32_t rng;
+
+        bool b_virtual_clock {false};
+        uint64_t prev_prune_us {0};
+
+        size_t sent_frames {0};
+        size_t lost_frames {0};
+        size_t collided_frames {0};
+        size_t retried_frames {0};
+        size_t busy_channels {0};
+
+    public:
+        explicit AirLink(const uint32_t seed = 1)
+        : rng(seed ? seed : 1) {}
+        AirLink(const AirLink&) = delete;
+        AirLink& operator=(const AirLink&) = delete;
+
+        ~AirLink() {
+            for (auto* m : modules) m->link = nullptr;
+        }
+
+        void attach(VirtualModule& m) {
+            if (m.link) m.link->detach(m);
+            m.link = this;
+            modules.push_back(&m);
+            // boot time is counted from attached clock
+            if (m.state == VirtualModule::State::BOOTING) m.boot_us = now() + (uint64_t)m.boot_ms * 1000;
+        }
+
+        void detach(VirtualModule& m) {
+            modules.erase(std::remove(modules.begin(), modules.end(), &m), modules.end());
+            for (auto it = events.begin(); it != events.end();) {
+                const auto tx = txs.find(it->second.tx);
+                const bool b_from = (it->second.type != EventType::DELIVER) && (tx != txs.end()) && (tx->second.from == &m);
+                if ((it->second.to == &m) || b_from)
+                    it = events.erase(it);
+                else
+                    ++it;
+            }
+            for (auto it = txs.begin(); it != txs.end();) {
+                if (it->second.from == &m)
+                    it = txs.erase(it);
+                else
+                    ++it;
+            }
+            m.link = nullptr;
+        }
+
+        // propagation and processing delay
+        void latency(const uint32_t us) { latency_us = us; }
+        // probability that a frame (or an ack) is lost
+        void lossRate(const float p) { loss_rate = p; }
+        void rssi(const int16_t dbm) { rssi_dbm = dbm; }
+        void seed(const uint32_t s) { rng = s ? s : 1; }
+        // carrier sense is retried after random backoff, and NG 102 is replied if channel is still busy
+        void carrierSense(const uint8_t max_retry, const uint32_t max_backoff_us) {
+            max_senses = max_retry + 1;
+            backoff_us = max_backoff_us;
+        }
+
+        // use VirtualClock (shared with ES920_<..., VirtualClock>) instead of ELAPSED_TIME_MS()
+        // so simulation runs faster than real time
+        void virtualClock(const bool b) { b_virtual_clock = b; }
+        void advance(const uint64_t us) {
+            if (b_virtual_clock) VirtualClock::advanceTo(us);
+        }
+        uint64_t now() const { return b_virtual_clock ? VirtualClock::us() : (uint64_t)ELAPSED_TIME_MS() * 1000; }
+
+        // time of the next event in the air (UINT64_MAX if nothing)
+        uint64_t nextEventUs() const { return events.empty() ? UINT64_MAX : events.begin()->first; }
+
+        size_t sentFrames() const { return sent_frames; }
+        size_t lostFrames() const { return lost_frames; }
+        size_t collidedFrames() const { return collided_frames; }
+        size_t retriedFrames() const { return retried_frames; }
+        size_t busyChannels() const { return busy_channels; }
+
+        // module starts transmission including carrier sense and ack/retry
+        // result is replied to module with VirtualModule::finish()
+        void transmit(VirtualModule& from, const AirFrame& f, const uint64_t start_us) {
+            const uint32_t id = next_tx++;
+            Transmission& t = txs[id];
+            t.from = &from;
+            t.frame = f;
+            t.start_us = start_us;
+            events.emplace(start_us, Event {EventType::START, id, nullptr, AirFrame()});
+        }
+
+        // module was reset : its pending transmissions are dropped
+        // a frame already on the air still occupies the channel until its end, but is not received
+        void abort(VirtualModule& m) {
+            for (auto it = events.begin(); it != events.end();) {
+                const auto tx = txs.find(it->second.tx);
+                const bool b_from = (it->second.type != EventType::DELIVER) && (tx != txs.end()) && (tx->second.from == &m);
+                if (b_from)
+                    it = events.erase(it);
+                else
+                    ++it;
+            }
+            for (auto it = txs.begin(); it != txs.end();) {
+                if ((it->second.from == &m) && !it->second.b_done) {
+                    if (it->second.end_us == 0) {
+                        it = txs.erase(it);
+                        continue;
+                    }
+                    it->second.b_done = true;
+                }
+                ++it;
+            }
+        }
+
+        // process events which are due
+        void poll(const uint64_t now_us) {
+            while (!events.empty() && (events.begin()->first <= now_us)) {
+                const uint64_t at_us = events.begin()->first;
+                Event e = std::move(events.begin()->second);
+                events.erase(events.begin());
+                if (e.type == EventType::START)
+                    start(e.tx, at_us);
+                else if (e.type == EventType::END)
+                    end(e.tx, at_us);
+                else
+                    e.to->receive(e.frame, rssi_dbm, at_us);
+            }
+            prune(now_us);
+        }
+
+    private:
+        void start(const uint32_t id, const uint64_t at_us) {
+            Transmission& t = txs[id];
+            if (busy(t, at_us)) {
+                ++busy_channels;
+                if (++t.senses < max_senses) {
+                    events.emplace(at_us + random() % (backoff_us + 1), Event {EventType::START, id, nullptr, AirFrame()});
+                } else {
+                    t.start_us = t.end_us = at_us;  // never on the air
+                    complete(t, at_us, ErrorCode::CarriorSense);
+                }
+                return;
+            }
+            ++sent_frames;
+            t.senses = 0;
+            t.start_us = at_us;
+            t.end_us = at_us + t.from->airtimeUs(t.frame.data.size());
+            events.emplace(t.end_us, Event {EventType::END, id, nullptr, AirFrame()});
+        }
+
+        void end(const uint32_t id, const uint64_t at_us) {
+            Transmission& t = txs[id];
+            const bool b_ack = t.from->active.ack && (t.frame.dstid != 0xFFFF);
+            const bool b_collided = collided(id, t);
+            if (b_collided) ++collided_frames;
+
+            bool b_received = false;
+            for (auto* m : modules) {
+                if (!reachable(*t.from, *m, t.frame)) continue;
+                if (b_collided) continue;
+                if (lost()) {
+                    ++lost_frames;
+                    continue;
+                }
+                events.emplace(at_us + latency_us, Event {EventType::DELIVER, 0, m, t.frame});
+                if (m->active.ownid == t.frame.dstid) b_received = true;
+            }
+            ++t.attempts;
+
+            if (!b_ack) {
+                complete(t, at_us, ErrorCode::None);
+                return;
+            }
+            const uint64_t ack_us = t.from->airtimeUs(0) + 2 * latency_us;
+            if (b_received && !lost())
+                complete(t, at_us + ack_us, ErrorCode::None);
+            else if (t.attempts <= t.from->active.retry) {
+                ++retried_frames;
+                events.emplace(at_us + ack_us + ack_margin_us, Event {EventType::START, id, nullptr, AirFrame()});
+            } else
+                complete(t, at_us + ack_us + ack_margin_us, ErrorCode::MissingAck);
+        }
+
+        void complete(Transmission& t, const uint64_t at_us, const ErrorCode e) {
+            t.b_done = true;
+            t.from->finish(at_us, e);
+        }
+
+        // other frame is on the air on the same channel
+        bool busy(const Transmission& t, const uint64_t at_us) const {
+            for (const auto& o : txs) {
+                const Transmission& other = o.second;
+                if ((&other == &t) || (other.end_us == 0) || (other.frame.channel != t.frame.channel)) continue;
+                if ((other.start_us <= at_us) && (at_us < other.end_us)) return true;
+            }
+            return false;
+        }
+
+        bool collided(const uint32_t id, const Transmission& t) const {
+            for (const auto& o : txs) {
+                const Transmission& other = o.second;
+                if ((o.first == id) || (other.end_us == 0) || (other.frame.channel != t.frame.channel)) continue;
+                if ((other.start_us < t.end_us) && (t.start_us < other.end_us)) return true;
+            }
+            return false;
+        }
+
+        // forget finished transmissions which cannot overlap with frames on the air anymore
+        void prune(const uint64_t now_us) {
+            const uint64_t keep_us = 10000000;  // longer than max airtime
+            if (now_us < prev_prune_us + keep_us) return;
+            prev_prune_us = now_us;
+            for (auto it = txs.begin(); it != txs.end();) {
+                if (it->second.b_done && (it->second.end_us + keep_us < now_us))
+                    it = txs.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        bool reachable(const VirtualModule& from, const VirtualModule& to, const AirFrame& f) const {
+            if ((&from == &to) || (to.state != VirtualModule::State::OPERATION)) return false;
+            if (from.model_type != to.model_type) return false;
+            const Config& c = to.active;
+            if ((c.channel != f.channel) || (c.panid != f.panid)) return false;
+            if ((f.dstid != 0xFFFF) && (f.dstid != c.ownid)) return false;
+            if (from.model_type == VirtualModule::Model::ES920LR)
+                return (c.sf == from.active.sf) && (c.bw == from.active.bw);
+            else
+                return c.rate == from.active.rate;
+        }
+
+        // xorshift32, deterministic for the same seed
+        uint32_t random() {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            return rng;
+        }
+
+        bool lost() {
+            if (loss_rate <= 0.f) return false;
+            return ((float)random() / 4294967296.f) < loss_rate;
+        }
+    };
+
+    inline VirtualModule::~VirtualModule() {
+        if (link) link->detach(*this);
+    }
+
+    inline uint64_t VirtualModule::nowUs() const {
+        if (link) return link->now();
+        return b_virtual_clock ? VirtualClock::us() : (uint64_t)ELAPSED_TIME_MS() * 1000;
+    }
+
+    inline void VirtualModule::reset() {
+        state = State::BOOTING;
+        boot_us = nowUs() + (uint64_t)boot_ms * 1000;
+        busy_until_us = 0;
+        input.clear();
+        outputs.clear();
+        rx.clear();
+        // result of the transmission before reset is never replied
+        if (link) link->abort(*this);
+    }
+
+    inline void VirtualModule::update() {
+        const uint64_t now_us = nowUs();
+        if ((state == State::BOOTING) && (now_us >= boot_us)) boot();
+        if (link) link->poll(now_us);
+        while (!outputs.empty() && (outputs.front().ready_us <= now_us)) {
+            if (baudMatched()) rx.insert(rx.end(), outputs.front().bytes.begin(), outputs.front().bytes.end());
+            outputs.pop_front();
+        }
+    }
+
+    inline void VirtualModule::transmit(const AirFrame& f, const uint64_t start_us) {
+        ++tx_frames;
+        if (link) {
+            busy_until_us = UINT64_MAX;  // until finish() is called
+            link->transmit(*this, f, start_us);
+        } else
+            finish(start_us + airtimeUs(f.data.size()), ErrorCode::None);
+    }
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO
+
+#endif  // ARDUINO_ES920_EMULATOR_H
@@ -0,0 +1,118 @@
+#pragma once
+#ifndef ARDUINO_ES920_EXT_HEADER_H
+#define ARDUINO_ES920_EXT_HEADER_H
+
+// extension header of binary frames, placed before the packetized data : [flags][seq]
+// enabled by defining ES920_DEDUP_ENABLE and / or ES920_COMPRESS_ENABLE before including ES920.h (both sender and receiver),
+// payloadSize() is reduced by the size of the header ([seq] is sent only with ES920_DEDUP_ENABLE)
+// flags : FLAG_SEQ (seq is valid), FLAG_COMPRESSED (packetized data is compressed, see Compress.h),
+//         FLAG_RESTART (first SEQ_WINDOW frames after the sender started, seq counts from 0 again)
+// seq : 8 bit rolling sequence of the sender, incremented per frame (module retries keep the same seq)
+// the receiver keeps a sliding window of seq per source (panid, ownid) and drops duplicated frames
+// before callbacks. rcvid is required because sources are told apart by it (dedup is disabled without rcvid)
+// ES920_DEDUP_SOURCES : number of sources kept (2-way set associative, the least recently seen is replaced)
+
+#include "Constants.h"
+
+#ifdef ES920_DEDUP_ENABLE
+#define ES920_EXT_HEADER_SIZE 2
+#elif defined(ES920_COMPRESS_ENABLE)
+#define ES920_EXT_HEADER_SIZE 1
+#else
+#define ES920_EXT_HEADER_SIZE 0
+#endif
+
+#ifndef ES920_DEDUP_SOURCES
+#define ES920_DEDUP_SOURCES 16
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    namespace ext {
+        constexpr uint8_t FLAG_SEQ {0x01};
+        constexpr uint8_t FLAG_COMPRESSED {0x02};
+        constexpr uint8_t FLAG_RESTART {0x04};
+        constexpr uint8_t SEQ_WINDOW {32};
+    }  // namespace ext
+
+    template <uint8_t SOURCES>
+    class DedupTable {
+        static_assert((SOURCES >= 2) && ((SOURCES & (SOURCES - 1)) == 0), "DedupTable SOURCES must be power of 2 and >= 2");
+        static constexpr uint8_t WINDOW {ext::SEQ_WINDOW};
+        static constexpr uint8_t SETS {SOURCES / 2};
+
+        struct Entry {
+            bool b_used {false};
+            bool b_restart {false};  // window was started by FLAG_RESTART frame
+            uint8_t max_seq {0};
+            uint16_t panid {0};
+            uint16_t ownid {0};
+            uint16_t stamp {0};   // for replacement
+            uint32_t bitmap {0};  // bit i : max_seq - i received
+        };
+
+        Entry entries[SOURCES];
+        uint16_t stamp {0};
+
+    public:
+        // false if seq from the source is in the window and already received
+        // b_restart : frame has FLAG_RESTART, seq of the old window is discarded
+        // (also when seq goes back in a restarted window, the sender restarted again)
+        bool accept(const uint16_t panid, const uint16_t ownid, const uint8_t seq, const bool b_restart = false) {
+            Entry& e = find(panid, ownid);
+            e.stamp = ++stamp;
+            if (!e.b_used || (b_restart && (!e.b_restart || (seq < e.max_seq)))) {
+                reset(e, panid, ownid, seq);
+                e.b_restart = b_restart;
+                return true;
+            }
+            e.b_restart = b_restart;
+            const int8_t d = (int8_t)(uint8_t)(seq - e.max_seq);
+            if (d > 0) {
+                e.bitmap = (d >= WINDOW) ? 1 : ((e.bitmap << d) | 1);
+                e.max_seq = seq;
+                return true;
+            }
+            const uint8_t back = (uint8_t)(-d);
+            if (back >= WINDOW) {
+                reset(e, panid, ownid, seq);  // sender restarted or too old
+                return true;
+            }
+            const uint32_t bit = (uint32_t)1 << back;
+            if (e.bitmap & bit) return false;
+            e.bitmap |= bit;
+            return true;
+        }
+
+        void clear() {
+            for (auto& e : entries) e.b_used = false;
+        }
+
+    private:
+        Entry& find(const uint16_t panid, const uint16_t ownid) {
+            const uint8_t set = (uint8_t)((ownid ^ (ownid >> 8) ^ (panid * 31)) & (SETS - 1));
+            Entry& a = entries[set * 2];
+            Entry& b = entries[set * 2 + 1];
+            if (a.b_used && (a.panid == panid) && (a.ownid == ownid)) return a;
+            if (b.b_used && (b.panid == panid) && (b.ownid == ownid)) return b;
+            if (!a.b_used) return a;
+            if (!b.b_used) return b;
+            Entry& r = ((uint16_t)(stamp - a.stamp) >= (uint16_t)(stamp - b.stamp)) ? a : b;
+            r.b_used = false;
+            return r;
+        }
+
+        static void reset(Entry& e, const uint16_t panid, const uint16_t ownid, const uint8_t seq) {
+            e.b_used = true;
+            e.panid = panid;
+            e.ownid = ownid;
+            e.max_seq = seq;
+            e.bitmap = 1;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_EXT_HEADER_H
@@ -0,0 +1,498 @@
+#pragma once
+#ifndef ARDUINO_ES920_FEC_H
+#define ARDUINO_ES920_FEC_H
+
+// forward error correction across a block of binary frames (erasure code, Reed-Solomon over GF(256))
+// the sender sends k data frames as they are, then m parity frames of the block.
+// the receiver gets data frames immediately, and rebuilds lost ones from any k frames of the block without retransmission
+// (module drops corrupted frames by crc, so a frame is either received or lost)
+// parity rows are systematic Cauchy matrix rows, so any k of k + m frames can rebuild the block
+// a block is closed with parity frames after k data frames, or after flushTimeout() with fewer data frames
+// redundancy (k, m) is configured per index and / or per destination, other frames are sent as they are
+// module ack (Config::ack) should be disabled for frames with fec. the receiver assumes one sender
+//
+// DATA   : [block][i][index][size][data]    i < k
+// PARITY : [block][0x80 | r][k][parity]     r < m, parity of rows ([index][size][data] padded with 0)
+//
+// ES920_FEC_INDEX : binary index of fec frames
+// ES920_FEC_MAX_DATA : max k (<= 32)
+// ES920_FEC_MAX_PARITY : max m
+// ES920_FEC_STREAMS : blocks which can be filled at once (pairs of destination and index)
+// ES920_FEC_RX_BLOCKS : blocks which can be decoded at once on the receiver
+// ES920_FEC_RULES : redundancy settings
+// ES920_FEC_SUBSCRIBERS : indexes subscribed by subscribe()
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifndef ES920_FEC_INDEX
+#define ES920_FEC_INDEX 0xF5
+#endif
+
+#ifndef ES920_FEC_MAX_DATA
+#define ES920_FEC_MAX_DATA 8
+#endif
+
+#ifndef ES920_FEC_MAX_PARITY
+#define ES920_FEC_MAX_PARITY 4
+#endif
+
+#ifndef ES920_FEC_STREAMS
+#define ES920_FEC_STREAMS 2
+#endif
+
+#ifndef ES920_FEC_RX_BLOCKS
+#define ES920_FEC_RX_BLOCKS 2
+#endif
+
+#ifndef ES920_FEC_RULES
+#define ES920_FEC_RULES 4
+#endif
+
+#ifndef ES920_FEC_SUBSCRIBERS
+#define ES920_FEC_SUBSCRIBERS 4
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    static_assert(ES920_FEC_MAX_DATA >= 1 && ES920_FEC_MAX_DATA <= 32, "ES920_FEC_MAX_DATA must be 1 - 32");
+    static_assert(ES920_FEC_MAX_PARITY >= 1 && ES920_FEC_MAX_PARITY <= 32, "ES920_FEC_MAX_PARITY must be 1 - 32");
+
+    // arithmetic of GF(2^8), polynomial x^8 + x^4 + x^3 + x^2 + 1 (without tables to save RAM)
+    namespace gf256 {
+
+        inline uint8_t mul(uint8_t a, uint8_t b) {
+            uint8_t p = 0;
+            while (b) {
+                if (b & 1) p ^= a;
+                a = (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1D : 0));
+                b >>= 1;
+            }
+            return p;
+        }
+
+        // a^254 = a^-1 (a != 0)
+        inline uint8_t inv(const uint8_t a) {
+            uint8_t r = 1;
+            uint8_t x = a;
+            for (uint8_t e = 254; e; e >>= 1) {
+                if (e & 1) r = mul(r, x);
+                x = mul(x, x);
+            }
+            return r;
+        }
+
+        // coefficient of data row c in parity row r
+        inline uint8_t cauchy(const uint8_t r, const uint8_t c) {
+            return inv((uint8_t)(0x80 | r) ^ c);
+        }
+
+        // dst += coef * src
+        inline void addMul(uint8_t* dst, const uint8_t* src, const uint8_t coef, const uint8_t size) {
+            if (coef == 0) return;
+            for (uint8_t i = 0; i < size; ++i) dst[i] ^= mul(coef, src[i]);
+        }
+
+    }  // namespace gf256
+
+    struct FecStats {
+        // sender
+        uint32_t sent {0};    // data frames
+        uint32_t parity {0};  // parity frames
+        uint32_t plain {0};   // frames without fec
+        uint32_t failed {0};  // module replied NG or timeout
+        // receiver
+        uint32_t received {0};     // data frames received directly
+        uint32_t recovered {0};    // data frames rebuilt from parity
+        uint32_t unrecovered {0};  // data frames lost in closed blocks
+        uint32_t duplicates {0};  // already received or not needed
+
+        void clear() { *this = FecStats(); }
+    };
+
+    template <typename Radio, typename Clock = DefaultClock>
+    class FecCodec {
+        static constexpr uint8_t ROW_SIZE {Radio::payloadSize() - 3};
+        static constexpr uint8_t FLAG_PARITY {0x80};
+        static constexpr uint16_t ANY {0xFFFF};
+
+        struct Rule {
+            uint16_t dst;    // ANY : all destinations
+            uint16_t index;  // ANY : all indexes
+            uint8_t k;
+            uint8_t m;
+        };
+
+        // block being filled on the sender
+        struct Stream {
+            bool b_used {false};
+            bool b_to {false};  // sent with sendTo()
+            uint16_t dst {0};
+            uint8_t index {0};
+            uint8_t k {0};
+            uint8_t m {0};
+            uint8_t n {0};        // data frames sent
+            uint8_t pending {0};  // parity frames to be sent
+            uint8_t block {0};
+            uint8_t size {0};     // longest row
+            uint32_t begin_ms {0};
+            uint8_t rows[ES920_FEC_MAX_PARITY][ROW_SIZE];
+        };
+
+        // block being decoded on the receiver
+        struct Block {
+            bool b_used {false};
+            bool b_done {false};
+            uint8_t id {0};
+            uint8_t k {0};  // 0 : no parity received yet
+            uint8_t n {0};  // rows stored
+            uint8_t size {0};
+            uint32_t delivered {0};  // bit i : data frame i
+            uint32_t last_ms {0};
+            uint8_t ids[ES920_FEC_MAX_DATA];  // i or 0x80 | r
+            uint8_t rows[ES920_FEC_MAX_DATA][ROW_SIZE];
+        };
+
+        struct Subscriber {
+            uint8_t index;
+            BinaryCallbackType cb;
+        };
+
+        Radio& radio;
+        uint8_t fec_index;
+        FecStats counters;
+
+        Rule rules[ES920_FEC_RULES];
+        uint8_t n_rules {0};
+        Stream streams[ES920_FEC_STREAMS];
+        Block blocks[ES920_FEC_RX_BLOCKS];
+        Subscriber subscribers[ES920_FEC_SUBSCRIBERS];
+        uint8_t n_subscribers {0};
+
+        uint8_t next_block {0};
+        bool b_inflight {false};
+        uint32_t flush_ms {5000};
+        uint32_t reply_timeout_ms {3000};
+
+    public:
+        explicit FecCodec(Radio& r, const uint8_t idx = ES920_FEC_INDEX)
+        : radio(r), fec_index(idx), next_block((uint8_t)Clock::ms()) {
+            radio.subscribe(fec_index, [&](const uint8_t* data, const size_t size) {
+                receive(data, size);
+            });
+        }
+
+        // k data frames + m parity frames per block (k == 0 or m == 0 : without fec)
+        // for all frames / frames of an index / frames to a destination (sendTo()) / both
+        // the most specific setting is used (destination and index > destination > index > all)
+        bool redundancy(const uint8_t k, const uint8_t m) { return addRule(ANY, ANY, k, m); }
+        bool redundancy(const uint8_t index, const uint8_t k, const uint8_t m) { return addRule(ANY, index, k, m); }
+        bool redundancyTo(const uint16_t dst, const uint8_t k, const uint8_t m) { return addRule(dst, ANY, k, m); }
+        bool redundancyTo(const uint16_t dst, const uint8_t index, const uint8_t k, const uint8_t m) { return addRule(dst, index, k, m); }
+
+        // blocks not filled in this time are closed with parity frames
+        void flushTimeout(const uint32_t ms) { flush_ms = ms; }
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+
+        // max data size of a frame with fec
+        static constexpr uint8_t maxSize() { return ROW_SIZE - 2; }
+
+        // false while the previous frame or parity frames are being sent (call update() and try again)
+        bool send(const uint8_t index, const uint8_t* data, const uint8_t size) {
+            return send(false, 0, index, data, size);
+        }
+        // to a destination in TransMode::FRAME
+        bool sendTo(const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size) {
+            return send(true, dst, index, data, size);
+        }
+
+        // received and recovered frames of index (also subscribes radio for frames sent without fec)
+        void subscribe(const uint8_t index, const BinaryCallbackType& cb) {
+            radio.subscribe(index, cb);
+            uint8_t i = 0;
+            while ((i < n_subscribers) && (subscribers[i].index != index)) ++i;
+            if (i == ES920_FEC_SUBSCRIBERS) {
+                LOG_WARN("fec: too many subscribers, increase ES920_FEC_SUBSCRIBERS");
+                return;
+            }
+            if (i == n_subscribers) ++n_subscribers;
+            subscribers[i] = Subscriber {index, cb};
+        }
+
+        // call after parse() in main loop
+        void update() {
+            if (b_inflight) return;
+            for (auto& s : streams) {
+                if (s.b_used && s.pending) {
+                    sendParity(s);
+                    return;
+                }
+            }
+            const uint32_t now_ms = Clock::ms();
+            for (auto& s : streams) {
+                if (s.b_used && (s.n > 0) && (now_ms - s.begin_ms >= flush_ms)) {
+                    close(s);
+                    sendParity(s);
+                    return;
+                }
+            }
+        }
+
+        // closes all blocks being filled, parity frames are sent from update()
+        void flush() {
+            for (auto& s : streams)
+                if (s.b_used && (s.n > 0) && !s.pending) close(s);
+        }
+
+        bool busy() const {
+            if (b_inflight) return true;
+            for (const auto& s : streams)
+                if (s.b_used && s.pending) return true;
+            return false;
+        }
+
+        const FecStats& stats() const { return counters; }
+        void resetStats() { counters.clear(); }
+
+    private:
+        bool addRule(const uint16_t dst, const uint16_t index, uint8_t k, uint8_t m) {
+            if (k > ES920_FEC_MAX_DATA) {
+                LOG_WARN("fec: k must be <= ", ES920_FEC_MAX_DATA);
+                k = ES920_FEC_MAX_DATA;
+            }
+            if (m > ES920_FEC_MAX_PARITY) {
+                LOG_WARN("fec: m must be <= ", ES920_FEC_MAX_PARITY);
+                m = ES920_FEC_MAX_PARITY;
+            }
+            uint8_t i = 0;
+            while ((i < n_rules) && !((rules[i].dst == dst) && (rules[i].index == index))) ++i;
+            if (i == ES920_FEC_RULES) {
+                LOG_WARN("fec: too many redundancy settings, increase ES920_FEC_RULES");
+                return false;
+            }
+            if (i == n_rules) ++n_rules;
+            rules[i] = Rule {dst, index, k, m};
+            return true;
+        }
+
+        const Rule* findRule(const bool b_to, const uint16_t dst, const uint8_t index) const {
+            const Rule* best = nullptr;
+            uint8_t best_score = 0;
+            for (uint8_t i = 0; i < n_rules; ++i) {
+                const Rule& r = rules[i];
+                if ((r.dst != ANY) && (!b_to || (r.dst != dst))) continue;
+                if ((r.index != ANY) && (r.index != index)) continue;
+                const uint8_t score = 1 + ((r.dst != ANY) ? 2 : 0) + ((r.index != ANY) ? 1 : 0);
+                if (score > best_score) {
+                    best = &r;
+                    best_score = score;
+                }
+            }
+            return best;
+        }
+
+        bool send(const bool b_to, const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size) {
+            if (busy()) return false;
+            const Rule* rule = findRule(b_to, dst, index);
+            if (!rule || (rule->k == 0) || (rule->m == 0)) {
+                if (!transmit(b_to, dst, index, data, size)) return false;
+                ++counters.plain;
+                return true;
+            }
+            if (size > maxSize()) {
+                LOG_WARN("fec: too long data, must be <= ", maxSize(), ". size = ", size);
+                return false;
+            }
+
+            Stream* s = stream(b_to, dst, index);
+            if (!s) {
+                LOG_WARN("fec: too many streams, increase ES920_FEC_STREAMS");
+                return false;
+            }
+            if (s->n == 0) {
+                s->k = rule->k;
+                s->m = rule->m;
+                s->block = next_block++;
+                s->size = 0;
+                s->begin_ms = Clock::ms();
+                for (auto& row : s->rows)
+                    for (auto& b : row) b = 0;
+            }
+
+            uint8_t frame[Radio::payloadSize()];
+            frame[0] = s->block;
+            frame[1] = s->n;
+            uint8_t* row = frame + 2;
+            row[0] = index;
+            row[1] = size;
+            for (uint8_t i = 0; i < size; ++i) row[2 + i] = data[i];
+            const uint8_t row_size = size + 2;
+            if (!transmit(b_to, dst, fec_index, frame, row_size + 2)) return false;
+            ++counters.sent;
+
+            for (uint8_t r = 0; r < s->m; ++r) gf256::addMul(s->rows[r], row, gf256::cauchy(r, s->n), row_size);
+            if (row_size > s->size) s->size = row_size;
+            if (++s->n == s->k) close(*s);
+            return true;
+        }
+
+        Stream* stream(const bool b_to, const uint16_t dst, const uint8_t index) {
+            Stream* empty = nullptr;
+            for (auto& s : streams) {
+                if (s.b_used && (s.b_to == b_to) && (!b_to || (s.dst == dst)) && (s.index == index)) return &s;
+                if (!empty && (!s.b_used || ((s.n == 0) && !s.pending))) empty = &s;
+            }
+            if (empty) {
+                empty->b_used = true;
+                empty->b_to = b_to;
+                empty->dst = dst;
+                empty->index = index;
+                empty->n = 0;
+                empty->pending = 0;
+            }
+            return empty;
+        }
+
+        void close(Stream& s) {
+            s.k = s.n;
+            s.pending = s.m;
+        }
+
+        void sendParity(Stream& s) {
+            const uint8_t r = s.m - s.pending;
+            uint8_t frame[Radio::payloadSize()];
+            frame[0] = s.block;
+            frame[1] = FLAG_PARITY | r;
+            frame[2] = s.k;
+            for (uint8_t i = 0; i < s.size; ++i) frame[3 + i] = s.rows[r][i];
+            if (!transmit(s.b_to, s.dst, fec_index, frame, s.size + 3)) return;  // retried in next update()
+            ++counters.parity;
+            if (--s.pending == 0) s.n = 0;
+        }
+
+        bool transmit(const bool b_to, const uint16_t dst, const uint8_t index, const uint8_t* data, const uint8_t size) {
+            const auto cb = [&](const Reply& r) {
+                b_inflight = false;
+                if (!r.success()) ++counters.failed;
+            };
+            const bool b_sent = b_to
+                ? radio.sendToAsync(dst, index, data, size, cb, reply_timeout_ms)
+                : radio.sendAsync(index, data, size, cb, reply_timeout_ms);
+            if (b_sent) b_inflight = true;
+            return b_sent;
+        }
+
+        void receive(const uint8_t* data, const size_t size) {
+            if ((size < 4) || (size > Radio::payloadSize())) return;
+            const bool b_parity = data[1] & FLAG_PARITY;
+            const uint8_t i = data[1] & ~FLAG_PARITY;
+            if (b_parity ? ((i >= ES920_FEC_MAX_PARITY) || (data[2] == 0) || (data[2] > ES920_FEC_MAX_DATA)) : (i >= ES920_FEC_MAX_DATA)) return;
+
+            Block& b = block(data[0]);
+            b.last_ms = Clock::ms();
+            if (b.b_done || (!b_parity && (b.delivered & ((uint32_t)1 << i)))) {
+                ++counters.duplicates;
+                return;
+            }
+            for (uint8_t j = 0; j < b.n; ++j) {
+                if (b.ids[j] == data[1]) {
+                    ++counters.duplicates;
+                    return;
+                }
+            }
+
+            const uint8_t* row = data + (b_parity ? 3 : 2);
+            const uint8_t row_size = (uint8_t)(size - (b_parity ? 3 : 2));
+            if (b_parity) {
+                b.k = data[2];
+            } else {
+                ++counters.received;
+                deliver(row, row_size);
+                b.delivered |= (uint32_t)1 << i;
+            }
+            if (b.k && (b.delivered == (((uint64_t)1 << b.k) - 1))) {
+                b.b_done = true;  // nothing lost
+                return;
+            }
+            if (b.n == ES920_FEC_MAX_DATA) return;
+            b.ids[b.n] = data[1];
+            for (uint8_t j = 0; j < ROW_SIZE; ++j) b.rows[b.n][j] = (j < row_size) ? row[j] : 0;
+            if (row_size > b.size) b.size = row_size;
+            ++b.n;
+            if (b.k && (b.n >= b.k)) decode(b);
+        }
+
+        // reuses an unused or the least recently updated block for a new block id
+        Block& block(const uint8_t id) {
+            Block* oldest = &blocks[0];
+            for (auto& b : blocks) {
+                if (b.b_used && (b.id == id)) return b;
+                if (!b.b_used) oldest = &b;
+                else if (oldest->b_used && (b.last_ms - oldest->last_ms > 0x7FFFFFFF)) oldest = &b;
+            }
+            if (oldest->b_used && !oldest->b_done && oldest->k) {
+                for (uint8_t i = 0; i < oldest->k; ++i)
+                    if (!(oldest->delivered & ((uint32_t)1 << i))) ++counters.unrecovered;
+            }
+            *oldest = Block();
+            oldest->b_used = true;
+            oldest->id = id;
+            return *oldest;
+        }
+
+        // solves rows of k stored frames for data rows with Gauss-Jordan elimination
+        void decode(Block& b) {
+            const uint8_t k = b.k;
+            uint8_t a[ES920_FEC_MAX_DATA][ES920_FEC_MAX_DATA];
+            for (uint8_t j = 0; j < k; ++j) {
+                const uint8_t id = b.ids[j];
+                for (uint8_t c = 0; c < k; ++c)
+                    a[j][c] = (id & FLAG_PARITY) ? gf256::cauchy(id & ~FLAG_PARITY, c) : (uint8_t)(id == c);
+            }
+            for (uint8_t c = 0; c < k; ++c) {
+                uint8_t p = c;
+                while ((p < k) && (a[p][c] == 0)) ++p;
+                if (p == k) return;  // not solvable (data frame of index >= k)
+                if (p != c) {
+                    swapRows(a[p], a[c], k);
+                    swapRows(b.rows[p], b.rows[c], b.size);
+                }
+                const uint8_t s = gf256::inv(a[c][c]);
+                for (uint8_t i = 0; i < k; ++i) a[c][i] = gf256::mul(a[c][i], s);
+                for (uint8_t i = 0; i < b.size; ++i) b.rows[c][i] = gf256::mul(b.rows[c][i], s);
+                for (uint8_t j = 0; j < k; ++j) {
+                    if ((j == c) || (a[j][c] == 0)) continue;
+                    const uint8_t f = a[j][c];
+                    gf256::addMul(a[j], a[c], f, k);
+                    gf256::addMul(b.rows[j], b.rows[c], f, b.size);
+                }
+            }
+            for (uint8_t i = 0; i < k; ++i) {
+                if (b.delivered & ((uint32_t)1 << i)) continue;
+                if (b.rows[i][1] + 2 > b.size) continue;  // broken row
+                ++counters.recovered;
+                deliver(b.rows[i], b.rows[i][1] + 2);
+            }
+            b.b_done = true;
+        }
+
+        static void swapRows(uint8_t* a, uint8_t* b, const uint8_t size) {
+            for (uint8_t i = 0; i < size; ++i) {
+                const uint8_t t = a[i];
+                a[i] = b[i];
+                b[i] = t;
+            }
+        }
+
+        void deliver(const uint8_t* row, const uint8_t size) {
+            if ((size < 2) || (row[1] + 2 > size)) return;
+            for (uint8_t i = 0; i < n_subscribers; ++i)
+                if (subscribers[i].index == row[0]) subscribers[i].cb(row + 2, row[1]);
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_FEC_H
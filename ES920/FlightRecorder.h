@@ -0,0 +1,154 @@
+#pragma once
+#ifndef ARDUINO_ES920_FLIGHT_RECORDER_H
+#define ARDUINO_ES920_FLIGHT_RECORDER_H
+
+// always-on ring of the last raw serial bytes and parse events, for post-mortem analysis
+// enabled by defining ES920_FLIGHT_RECORDER_ENABLE before including ES920.h
+// ES920_FLIGHT_RECORDER_SIZE : number of entries (power of 2, 2 bytes each)
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+#define ES920_FLIGHT_RECORD(kind, value) \
+    if (flight_recorder) flight_recorder->record(kind, value)
+#else
+#define ES920_FLIGHT_RECORD(kind, value)
+#endif
+
+#ifndef ES920_FLIGHT_RECORDER_SIZE
+#define ES920_FLIGHT_RECORDER_SIZE 256
+#endif
+
+#ifndef ARDUINO
+#include <ostream>
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    enum class FlightEvent : uint8_t {
+        RX = 0,              // value : byte from module
+        TX,                  // value : byte to module
+        REPLY_OK,            //
+        REPLY_NG,            // value : error code
+        RESET,               //
+        WAKEUP,              // value : detected mode
+        VERSION,             //
+        PACKET,              // value : size byte (binary) or payload size (ascii)
+        BEGIN_FAILED,        //
+        RECONFIGURE_FAILED,  //
+    };
+
+    struct FlightEntry {
+        FlightEvent kind;
+        uint8_t value;
+    };
+
+    template <uint16_t SIZE>
+    class FlightRecorderRing {
+        static_assert((SIZE != 0) && ((SIZE & (SIZE - 1)) == 0), "ES920_FLIGHT_RECORDER_SIZE must be power of 2");
+
+        uint16_t ring[SIZE];
+        uint16_t head {0};
+        uint16_t count {0};
+
+    public:
+        // hot path : one store and one mask per byte
+        void record(const FlightEvent kind, const uint8_t value) {
+            ring[head] = (uint16_t)(((uint16_t)kind << 8) | value);
+            head = (head + 1) & (SIZE - 1);
+            if (count < SIZE) ++count;
+        }
+
+        void clear() { head = count = 0; }
+        uint16_t size() const { return count; }
+        static constexpr uint16_t capacity() { return SIZE; }
+
+        // i == 0 : oldest
+        FlightEntry at(const uint16_t i) const {
+            const uint16_t e = ring[(head - count + i) & (SIZE - 1)];
+            return FlightEntry {(FlightEvent)(e >> 8), (uint8_t)(e & 0xFF)};
+        }
+
+        template <typename F>
+        void forEach(const F& f) const {
+            for (uint16_t i = 0; i < count; ++i) f(at(i));
+        }
+
+        // text dump, consecutive bytes of the same direction in one line
+        // RX 4F 4B 0D 0A
+        // -- REPLY_NG 102
+#ifdef ARDUINO
+        void dump(Print& out) const {
+            dumpTo([&](const char* s) { out.print(s); });
+        }
+#else
+        void dump(std::ostream& out) const {
+            dumpTo([&](const char* s) { out << s; });
+        }
+#endif
+
+        template <typename Put>
+        void dumpTo(const Put& put) const {
+            char buf[8];
+            bool b_line = false;
+            FlightEvent prev = FlightEvent::BEGIN_FAILED;
+            for (uint16_t i = 0; i < count; ++i) {
+                const FlightEntry e = at(i);
+                if ((e.kind == FlightEvent::RX) || (e.kind == FlightEvent::TX)) {
+                    if (!b_line || (e.kind != prev)) {
+                        if (b_line) put("\n");
+                        put((e.kind == FlightEvent::RX) ? "RX" : "TX");
+                        b_line = true;
+                    }
+                    snprintf(buf, sizeof(buf), " %02X", e.value);
+                    put(buf);
+                } else {
+                    if (b_line) put("\n");
+                    b_line = false;
+                    put("-- ");
+                    put(name(e.kind));
+                    snprintf(buf, sizeof(buf), " %u\n", (unsigned)e.value);
+                    put(buf);
+                }
+                prev = e.kind;
+            }
+            if (b_line) put("\n");
+        }
+
+        static const char* name(const FlightEvent e) {
+            switch (e) {
+                case FlightEvent::RX:
+                    return "RX";
+                case FlightEvent::TX:
+                    return "TX";
+                case FlightEvent::REPLY_OK:
+                    return "REPLY_OK";
+                case FlightEvent::REPLY_NG:
+                    return "REPLY_NG";
+                case FlightEvent::RESET:
+                    return "RESET";
+                case FlightEvent::WAKEUP:
+                    return "WAKEUP";
+                case FlightEvent::VERSION:
+                    return "VERSION";
+                case FlightEvent::PACKET:
+                    return "PACKET";
+                case FlightEvent::BEGIN_FAILED:
+                    return "BEGIN_FAILED";
+                case FlightEvent::RECONFIGURE_FAILED:
+                    return "RECONFIGURE_FAILED";
+                default:
+                    return "UNKNOWN";
+            }
+        }
+    };
+
+    using FlightRecorder = FlightRecorderRing<ES920_FLIGHT_RECORDER_SIZE>;
+    using FlightRecorderCallbackType = std::function<void(const FlightRecorder& recorder)>;
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_FLIGHT_RECORDER_H
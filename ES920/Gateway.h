@@ -0,0 +1,258 @@
+#pragma once
+#ifndef ARDUINO_ES920_GATEWAY_H
+#define ARDUINO_ES920_GATEWAY_H
+
+// drives many ES920_ / ES920LR_ modules from one event loop (host only)
+// all sends are asynchronous, so one busy module never stalls the others
+
+#ifndef ARDUINO
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#define ES920_GATEWAY_POLL_ENABLE
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    using GatewayCallbackType = std::function<void(const uint8_t module, const uint8_t index, const uint8_t* data, const size_t size)>;
+
+    class Gateway {
+        // type-erased module, ES920_ and ES920LR_ (and any stream type) can be mixed
+        struct Module {
+            uint8_t id {0};
+            size_t inflight {0};  // sent but not replied yet
+
+            virtual ~Module() {}
+            virtual bool begin(const Config& cfg) = 0;
+            virtual size_t parse() = 0;
+            virtual int fd() const = 0;
+            virtual bool sendAsync(const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms) = 0;
+            virtual bool sendAsync(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms) = 0;
+            virtual const Config& getConfigs() const = 0;
+            virtual uint8_t payloadSize() const = 0;
+            virtual Stats stats() const = 0;
+            virtual void resetStats() = 0;
+        };
+
+        template <typename Radio, typename Stream>
+        struct ModuleImpl : public Module {
+            Radio radio;
+            Stream* stream;
+
+            explicit ModuleImpl(Stream& s)
+            : stream(&s) {}
+
+            virtual bool begin(const Config& cfg) override { return radio.begin(*stream, cfg); }
+            virtual size_t parse() override { return radio.parse(); }
+            virtual int fd() const override { return streamFd(*stream, 0); }
+            virtual bool sendAsync(const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms) override {
+                return radio.sendAsync(index, data, size, cb, timeout_ms);
+            }
+            virtual bool sendAsync(const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms) override {
+                return radio.sendAsync(pan, own, index, data, size, cb, timeout_ms);
+            }
+            virtual const Config& getConfigs() const override { return radio.getConfigs(); }
+            virtual uint8_t payloadSize() const override { return radio.payloadSize(); }
+            virtual Stats stats() const override { return radio.stats(); }
+            virtual void resetStats() override { radio.resetStats(); }
+
+        private:
+            // use file descriptor only if the stream has one (e.g. PosixSerial)
+            template <typename S>
+            static auto streamFd(S& s, int) -> decltype(s.fd()) { return s.fd(); }
+            template <typename S>
+            static int streamFd(S&, long) { return -1; }
+        };
+
+        struct Subscriber {
+            int module;   // -1 : any
+            int channel;  // -1 : any
+            int index;    // -1 : any
+            GatewayCallbackType cb;
+        };
+
+        std::vector<std::unique_ptr<Module>> modules;
+        std::vector<Subscriber> subscribers;
+#ifdef ES920_GATEWAY_POLL_ENABLE
+        std::vector<pollfd> pollfds;
+#endif
+        uint32_t housekeeping_ms {10};
+        uint32_t prev_housekeeping_ms {0};
+
+    public:
+        // add module which is driven by this gateway, returns typed radio to configure it directly
+        template <typename Radio, typename Stream>
+        Radio& add(const uint8_t id, Stream& s) {
+            ModuleImpl<Radio, Stream>* m = new ModuleImpl<Radio, Stream>(s);
+            m->id = id;
+            m->radio.subscribe([this, m](const uint8_t index, const uint8_t* data, const size_t size) {
+                dispatch(*m, index, data, size);
+            });
+            modules.emplace_back(m);
+            return m->radio;
+        }
+
+        bool begin(const uint8_t id, const Config& cfg) {
+            Module* m = find(id);
+            return m ? m->begin(cfg) : false;
+        }
+
+        bool begin(const Config& cfg) {
+            bool b = true;
+            for (auto& m : modules) b &= m->begin(cfg);
+            return b;
+        }
+
+        size_t size() const { return modules.size(); }
+        bool has(const uint8_t module) const { return find(module) != nullptr; }
+
+        // number of sent packets which are waiting for reply
+        size_t inflight(const uint8_t module) const {
+            Module* m = find(module);
+            return m ? m->inflight : 0;
+        }
+
+        // max binary data size which can be sent at once
+        uint8_t payloadSize(const uint8_t module) const {
+            Module* m = find(module);
+            return m ? m->payloadSize() : 0;
+        }
+
+        // received packets from every module
+        void subscribe(const GatewayCallbackType& cb) {
+            subscribers.push_back(Subscriber {-1, -1, -1, cb});
+        }
+
+        // received packets from a module with index
+        void subscribe(const uint8_t module, const uint8_t index, const GatewayCallbackType& cb) {
+            subscribers.push_back(Subscriber {module, -1, index, cb});
+        }
+
+        // received packets from any module on the channel with index
+        void subscribeChannel(const uint8_t channel, const uint8_t index, const GatewayCallbackType& cb) {
+            subscribers.push_back(Subscriber {-1, channel, index, cb});
+        }
+
+        // send via specified module
+        bool send(const uint8_t module, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb = nullptr, const uint32_t timeout_ms = 0) {
+            Module* m = find(module);
+            if (!m) {
+                LOG_WARN("no such module :", module);
+                return false;
+            }
+            return send(*m, index, data, size, cb, timeout_ms);
+        }
+
+        // send to pan/own via specified module (TransMode::FRAME)
+        bool send(const uint8_t module, const uint16_t pan, const uint16_t own, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb = nullptr, const uint32_t timeout_ms = 0) {
+            Module* m = find(module);
+            if (!m) {
+                LOG_WARN("no such module :", module);
+                return false;
+            }
+            bool b = m->sendAsync(pan, own, index, data, size, wrapReply(*m, cb), timeout_ms);
+            if (b) m->inflight++;
+            return b;
+        }
+
+        // send via the module on the channel which has the fewest packets in flight
+        bool sendChannel(const uint8_t channel, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb = nullptr, const uint32_t timeout_ms = 0) {
+            Module* best = nullptr;
+            for (auto& m : modules) {
+                if (m->getConfigs().channel != channel) continue;
+                if (!best || (m->inflight < best->inflight)) best = m.get();
+            }
+            if (!best) {
+                LOG_WARN("no module on channel :", channel);
+                return false;
+            }
+            return send(*best, index, data, size, cb, timeout_ms);
+        }
+
+        // parse modules which have incoming data
+        // blocks up to timeout_ms if modules have file descriptors (e.g. PosixSerial)
+        void update(const uint32_t timeout_ms = 0) {
+            const uint32_t now_ms = ELAPSED_TIME_MS();
+            // modules without incoming data are parsed periodically to handle reply timeouts
+            const bool b_housekeeping = (now_ms - prev_housekeeping_ms >= housekeeping_ms);
+            if (b_housekeeping) prev_housekeeping_ms = now_ms;
+
+#ifdef ES920_GATEWAY_POLL_ENABLE
+            pollfds.clear();
+            bool b_all_fds = true;
+            for (auto& m : modules) {
+                pollfd p;
+                p.fd = m->fd();
+                p.events = POLLIN;
+                p.revents = 0;
+                pollfds.push_back(p);
+                if (p.fd < 0) b_all_fds = false;
+            }
+            // if some modules cannot be polled, they have to be checked without blocking
+            const int wait_ms = b_all_fds ? (int)(b_housekeeping ? 0 : std::min(timeout_ms, housekeeping_ms)) : 0;
+            ::poll(pollfds.data(), pollfds.size(), wait_ms);
+
+            for (size_t i = 0; i < modules.size(); ++i) {
+                const bool b_ready = (pollfds[i].fd < 0) || (pollfds[i].revents & POLLIN);
+                if (b_ready || b_housekeeping) modules[i]->parse();
+            }
+#else
+            (void)timeout_ms;
+            for (auto& m : modules) m->parse();
+#endif
+        }
+
+        // interval to parse idle modules (to handle reply timeouts)
+        void housekeeping(const uint32_t ms) { housekeeping_ms = ms; }
+
+        // snapshot of module's runtime counters (empty if no such module)
+        Stats stats(const uint8_t module) const {
+            Module* m = find(module);
+            return m ? m->stats() : Stats();
+        }
+
+        void resetStats() {
+            for (auto& m : modules) m->resetStats();
+        }
+
+    private:
+        Module* find(const uint8_t id) const {
+            for (auto& m : modules)
+                if (m->id == id) return m.get();
+            return nullptr;
+        }
+
+        bool send(Module& m, const uint8_t index, const uint8_t* data, const uint8_t size, const ReplyCallbackType& cb, const uint32_t timeout_ms) {
+            bool b = m.sendAsync(index, data, size, wrapReply(m, cb), timeout_ms);
+            if (b) m.inflight++;
+            return b;
+        }
+
+        ReplyCallbackType wrapReply(Module& m, const ReplyCallbackType& cb) {
+            Module* pm = &m;
+            return [pm, cb](const Reply& r) {
+                if (pm->inflight) pm->inflight--;
+                if (cb) cb(r);
+            };
+        }
+
+        void dispatch(const Module& m, const uint8_t index, const uint8_t* data, const size_t size) {
+            for (auto& s : subscribers) {
+                if ((s.module >= 0) && (s.module != m.id)) continue;
+                if ((s.channel >= 0) && (s.channel != m.getConfigs().channel)) continue;
+                if ((s.index >= 0) && (s.index != index)) continue;
+                s.cb(m.id, index, data, size);
+            }
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO
+
+#endif  // ARDUINO_ES920_GATEWAY_H
@@ -0,0 +1,166 @@
+#pragma once
+#ifndef ARDUINO_ES920_LATENCY_H
+#define ARDUINO_ES920_LATENCY_H
+
+// send -> OK / NG latency histograms per TransMode and per destination
+// enabled by defining ES920_LATENCY_ENABLE before including ES920.h
+// ES920_LATENCY_DESTINATIONS : number of destinations tracked (first come, first served)
+// ES920_LATENCY_PENDING : number of sends waiting for reply (oldest is dropped if full)
+
+#include "Constants.h"
+
+#ifndef ES920_LATENCY_DESTINATIONS
+#define ES920_LATENCY_DESTINATIONS 4
+#endif
+
+#ifndef ES920_LATENCY_PENDING
+#define ES920_LATENCY_PENDING 8
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    // log-bucketed histogram of milliseconds, 4 buckets per octave (<= 25% error) up to 65535 ms
+    class LatencyHistogram {
+    public:
+        static constexpr uint8_t SUB_BITS {2};
+        static constexpr uint8_t SUB_SIZE {1 << SUB_BITS};
+        static constexpr uint8_t BUCKET_SIZE {SUB_SIZE * 15};
+
+    private:
+        uint32_t buckets[BUCKET_SIZE] {};
+        uint32_t n {0};
+        uint16_t min_ms {0xFFFF};
+        uint16_t max_ms {0};
+
+    public:
+        void record(const uint32_t ms) {
+            const uint16_t v = (ms > 0xFFFF) ? 0xFFFF : (uint16_t)ms;
+            ++buckets[bucket(v)];
+            ++n;
+            if (v < min_ms) min_ms = v;
+            if (v > max_ms) max_ms = v;
+        }
+
+        void clear() { *this = LatencyHistogram(); }
+
+        uint32_t count() const { return n; }
+        uint16_t min() const { return n ? min_ms : 0; }
+        uint16_t max() const { return max_ms; }
+        uint32_t countAt(const uint8_t b) const { return buckets[b]; }
+
+        // upper bound of the bucket which contains p percent of samples (capped by max())
+        uint16_t percentile(const float p) const {
+            if (n == 0) return 0;
+            uint32_t rank = (uint32_t)(p / 100.f * (float)n + 0.999f);
+            if (rank < 1) rank = 1;
+            if (rank > n) rank = n;
+            uint32_t sum = 0;
+            for (uint8_t b = 0; b < BUCKET_SIZE; ++b) {
+                sum += buckets[b];
+                if (sum >= rank) return (upper(b) < max_ms) ? upper(b) : max_ms;
+            }
+            return max_ms;
+        }
+        uint16_t p50() const { return percentile(50.f); }
+        uint16_t p99() const { return percentile(99.f); }
+
+        static uint8_t bucket(const uint16_t v) {
+            if (v < SUB_SIZE) return (uint8_t)v;
+            uint8_t msb = 0;
+            for (uint16_t x = v; x >>= 1;) ++msb;
+            return (uint8_t)(((msb - SUB_BITS + 1) << SUB_BITS) + ((v >> (msb - SUB_BITS)) & (SUB_SIZE - 1)));
+        }
+
+        static uint16_t lower(const uint8_t b) {
+            if (b < SUB_SIZE) return b;
+            const uint8_t octave = b >> SUB_BITS;
+            return (uint16_t)((SUB_SIZE + (b & (SUB_SIZE - 1))) << (octave - 1));
+        }
+
+        static uint16_t upper(const uint8_t b) {
+            if (b < SUB_SIZE) return b;
+            const uint8_t octave = b >> SUB_BITS;
+            return (uint16_t)(lower(b) + ((1u << (octave - 1)) - 1));
+        }
+    };
+
+    // matches sends and replies in order (module replies to every send in the same order)
+    class LatencyTracker {
+        struct Pending {
+            uint32_t ms;
+            uint16_t dst;
+            TransMode mode;
+        };
+
+        Pending pending[ES920_LATENCY_PENDING];
+        uint8_t head {0};
+        uint8_t n_pending {0};
+
+        LatencyHistogram modes[2];  // PAYLOAD, FRAME
+        LatencyHistogram dsts[ES920_LATENCY_DESTINATIONS];
+        uint16_t dst_ids[ES920_LATENCY_DESTINATIONS];
+        uint8_t n_dsts {0};
+
+    public:
+        void sent(const uint32_t now_ms, const TransMode mode, const uint16_t dst) {
+            if (n_pending == ES920_LATENCY_PENDING) drop();
+            pending[(head + n_pending) % ES920_LATENCY_PENDING] = Pending {now_ms, dst, mode};
+            ++n_pending;
+        }
+
+        void replied(const uint32_t now_ms) {
+            if (n_pending == 0) return;  // reply to command
+            const Pending& p = pending[head];
+            const uint32_t ms = now_ms - p.ms;
+            modes[modeSlot(p.mode)].record(ms);
+            LatencyHistogram* h = findOrAdd(p.dst);
+            if (h) h->record(ms);
+            drop();
+        }
+
+        // forget sends which will never be replied (e.g. module reset)
+        void abandon() { head = n_pending = 0; }
+
+        void clear() {
+            abandon();
+            for (auto& h : modes) h.clear();
+            for (auto& h : dsts) h.clear();
+            n_dsts = 0;
+        }
+
+        const LatencyHistogram& mode(const TransMode m) const { return modes[modeSlot(m)]; }
+
+        // nullptr if the destination is not tracked
+        const LatencyHistogram* destination(const uint16_t id) const {
+            for (uint8_t i = 0; i < n_dsts; ++i)
+                if (dst_ids[i] == id) return &dsts[i];
+            return nullptr;
+        }
+
+        uint8_t destinations() const { return n_dsts; }
+        uint16_t destinationId(const uint8_t i) const { return dst_ids[i]; }
+        const LatencyHistogram& destinationAt(const uint8_t i) const { return dsts[i]; }
+        uint8_t pendings() const { return n_pending; }
+
+    private:
+        static uint8_t modeSlot(const TransMode m) { return (m == TransMode::FRAME) ? 1 : 0; }
+
+        void drop() {
+            head = (head + 1) % ES920_LATENCY_PENDING;
+            --n_pending;
+        }
+
+        LatencyHistogram* findOrAdd(const uint16_t id) {
+            for (uint8_t i = 0; i < n_dsts; ++i)
+                if (dst_ids[i] == id) return &dsts[i];
+            if (n_dsts == ES920_LATENCY_DESTINATIONS) return nullptr;
+            dst_ids[n_dsts] = id;
+            return &dsts[n_dsts++];
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_LATENCY_H
@@ -0,0 +1,171 @@
+#pragma once
+#ifndef ARDUINO_ES920_LINK_TABLE_H
+#define ARDUINO_ES920_LINK_TABLE_H
+
+// per-node link quality from received packets (rcvid must be enabled, rssi is optional)
+// fixed capacity, the least recently seen node is replaced when full
+// enabled in ES920Base by defining ES920_LINK_TABLE_ENABLE before including ES920.h
+// ES920_LINK_TABLE_SIZE : number of nodes
+
+#include "Constants.h"
+
+#ifndef ES920_LINK_TABLE_SIZE
+#define ES920_LINK_TABLE_SIZE 8
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct LinkEntry {
+        uint16_t panid {0};
+        uint16_t ownid {0};
+        int16_t rssi_x16 {0};          // EWMA of rssi [dBm / 16]
+        int16_t last_rssi {0};         // [dBm]
+        bool b_rssi {false};           // rssi has been received
+        bool b_seq {false};            // sequence has been received
+        uint8_t last_seq {0};          //
+        uint32_t first_ms {0};         //
+        uint32_t last_ms {0};          // last seen
+        uint32_t interval_x16_ms {0};  // EWMA of packet interval [ms / 16]
+        uint32_t packets {0};          //
+        uint32_t lost {0};             // estimated from sequence gaps
+
+        int16_t rssi() const { return rssi_x16 / 16; }
+
+        // packets per second from EWMA interval
+        float packetRate() const {
+            return interval_x16_ms ? 16000.f / (float)interval_x16_ms : 0.f;
+        }
+
+        // lost / (received + lost), 0 if no sequence is given
+        float lossRate() const {
+            const uint32_t total = packets + lost;
+            return total ? (float)lost / (float)total : 0.f;
+        }
+
+        uint32_t age(const uint32_t now_ms) const { return now_ms - last_ms; }
+    };
+
+    template <uint8_t SIZE>
+    class LinkTable {
+        static_assert(SIZE != 0, "LinkTable SIZE must be > 0");
+
+        LinkEntry entries[SIZE];
+        uint8_t n {0};
+
+        static constexpr uint8_t EWMA_SHIFT {3};  // alpha = 1/8
+        static constexpr uint32_t MAX_INTERVAL_MS {0x7FFFFFFFUL >> 4};  // ~37 h, keeps interval x16 in int32_t
+
+    public:
+        // called with every received packet
+        LinkEntry& update(const uint16_t panid, const uint16_t ownid, const int16_t rssi, const bool b_rssi, const uint32_t now_ms) {
+            LinkEntry* e = find(panid, ownid);
+            if (!e) e = &add(panid, ownid, now_ms);
+            else {
+                uint32_t interval_ms = now_ms - e->last_ms;
+                if (interval_ms > MAX_INTERVAL_MS) interval_ms = MAX_INTERVAL_MS;
+                const int32_t interval_x16 = (int32_t)(interval_ms << 4);
+                if (e->packets == 1)
+                    e->interval_x16_ms = (uint32_t)interval_x16;
+                else
+                    e->interval_x16_ms = (uint32_t)((int32_t)e->interval_x16_ms + ((interval_x16 - (int32_t)e->interval_x16_ms) >> EWMA_SHIFT));
+            }
+            if (b_rssi) {
+                if (!e->b_rssi)
+                    e->rssi_x16 = (int16_t)(rssi * 16);
+                else
+                    e->rssi_x16 = (int16_t)(e->rssi_x16 + ((rssi * 16 - e->rssi_x16) >> EWMA_SHIFT));
+                e->last_rssi = rssi;
+                e->b_rssi = true;
+            }
+            e->last_ms = now_ms;
+            ++e->packets;
+            return *e;
+        }
+
+        // 8 bit rolling sequence of packet from node, gaps are counted as lost
+        void sequence(const uint16_t panid, const uint16_t ownid, const uint8_t seq) {
+            LinkEntry* e = find(panid, ownid);
+            if (!e) return;
+            if (e->b_seq) {
+                const uint8_t gap = (uint8_t)(seq - e->last_seq - 1);
+                if (gap < 0x80) e->lost += gap;  // otherwise duplicated or reordered
+            }
+            e->last_seq = seq;
+            e->b_seq = true;
+        }
+
+        LinkEntry* find(const uint16_t panid, const uint16_t ownid) {
+            for (uint8_t i = 0; i < n; ++i)
+                if ((entries[i].panid == panid) && (entries[i].ownid == ownid)) return &entries[i];
+            return nullptr;
+        }
+
+        const LinkEntry* find(const uint16_t panid, const uint16_t ownid) const {
+            return const_cast<LinkTable*>(this)->find(panid, ownid);
+        }
+
+        // remove nodes not seen for age_ms
+        void expire(const uint32_t now_ms, const uint32_t age_ms) {
+            for (uint8_t i = 0; i < n;) {
+                if (entries[i].age(now_ms) > age_ms)
+                    entries[i] = entries[--n];
+                else
+                    ++i;
+            }
+        }
+
+        void clear() { n = 0; }
+        uint8_t size() const { return n; }
+        static constexpr uint8_t capacity() { return SIZE; }
+        const LinkEntry& at(const uint8_t i) const { return entries[i]; }
+
+        // nodes from the best link (lowest loss, then highest rssi)
+        template <typename F>
+        void ranked(const F& f) const {
+            const LinkEntry* order[SIZE];
+            for (uint8_t i = 0; i < n; ++i) {
+                uint8_t j = i;
+                for (; (j > 0) && better(entries[i], *order[j - 1]); --j) order[j] = order[j - 1];
+                order[j] = &entries[i];
+            }
+            for (uint8_t i = 0; i < n; ++i) f(*order[i]);
+        }
+
+        // nullptr if empty
+        const LinkEntry* best() const {
+            const LinkEntry* b = nullptr;
+            for (uint8_t i = 0; i < n; ++i)
+                if (!b || better(entries[i], *b)) b = &entries[i];
+            return b;
+        }
+
+    private:
+        LinkEntry& add(const uint16_t panid, const uint16_t ownid, const uint32_t now_ms) {
+            uint8_t i = n;
+            if (n < SIZE)
+                ++n;
+            else {
+                // replace the least recently seen node
+                i = 0;
+                for (uint8_t k = 1; k < n; ++k)
+                    if (entries[k].age(now_ms) > entries[i].age(now_ms)) i = k;
+            }
+            entries[i] = LinkEntry();
+            entries[i].panid = panid;
+            entries[i].ownid = ownid;
+            entries[i].first_ms = now_ms;
+            return entries[i];
+        }
+
+        static bool better(const LinkEntry& a, const LinkEntry& b) {
+            const float la = a.lossRate(), lb = b.lossRate();
+            if (la != lb) return la < lb;
+            return a.rssi_x16 > b.rssi_x16;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_LINK_TABLE_H
@@ -0,0 +1,250 @@
+#pragma once
+#ifndef ARDUINO_ES920_MESSAGE_H
+#define ARDUINO_ES920_MESSAGE_H
+
+// typed binary messages : a struct is bound to a binary index at compile time by ES920_MESSAGE(index, fields...)
+// and sent / received with send(msg) and subscribe<T>(cb) instead of packing uint8_t* by hand
+//
+// struct Reading {
+//     uint16_t node;
+//     int16_t temp;
+//     bool b_alarm;
+//     ES920_MESSAGE(0x10, node, temp, b_alarm);
+// };
+//
+// wire encoding of fields in declaration order (no field tags, both sides must share the struct)
+// uint16_t / uint32_t / uint64_t   : varint (LEB128, 7 bits per byte)
+// int16_t / int32_t / int64_t      : zigzag + varint (small negative values are short too)
+// uint8_t / int8_t / char          : 1 byte
+// bool                             : 1 bit, up to 8 bools share a byte
+// float / double                   : raw little endian
+// char[N]                          : varint length + bytes (up to the first '\0')
+// T[N]                             : N fields
+// nested struct with ES920_MESSAGE : its fields (index of nested struct is not used)
+//
+// fields are decoded directly from the packet buffer of the parser,
+// trailing bytes are ignored so that new fields can be appended to the end of a message
+// message structs must be declared at namespace scope (local classes cannot have member templates)
+
+#include "Constants.h"
+
+#define ES920_MESSAGE(idx, ...)                                                     \
+    static constexpr uint8_t es920_message_index() { return idx; }                 \
+    template <typename Visitor>                                                     \
+    void es920_fields(Visitor& es920_visitor) { es920_visitor(__VA_ARGS__); }       \
+    template <typename Visitor>                                                     \
+    void es920_fields(Visitor& es920_visitor) const { es920_visitor(__VA_ARGS__); }
+
+namespace arduino {
+namespace es920 {
+
+    template <typename T>
+    using MessageCallbackType = std::function<void(const T& msg)>;
+
+    namespace message {
+
+        template <typename U, typename S>
+        inline U zigzag(const S v) {
+            return (U)(((U)v << 1) ^ (U)((v < 0) ? ~(U)0 : (U)0));
+        }
+
+        template <typename S, typename U>
+        inline S unzigzag(const U u) {
+            return (S)((U)(u >> 1) ^ (U)(-(S)(u & 1)));
+        }
+
+    }  // namespace message
+
+    class MessageWriter {
+        uint8_t* buffer;
+        size_t capacity;
+        size_t pos {0};
+        size_t bits_pos {0};
+        uint8_t n_bits {8};
+        bool b_overflow {false};
+
+    public:
+        MessageWriter(uint8_t* buf, const size_t cap)
+        : buffer(buf), capacity(cap) {}
+
+        template <typename... Args>
+        void operator()(const Args&... args) {
+            const int unused[] {0, (field(args), 0)...};
+            (void)unused;
+        }
+
+        size_t size() const { return pos; }
+        bool ok() const { return !b_overflow; }
+
+        void field(const bool b) {
+            if (n_bits == 8) {
+                bits_pos = pos;
+                if (!put(0)) return;
+                n_bits = 0;
+            }
+            if (b) buffer[bits_pos] |= (uint8_t)(1 << n_bits);
+            ++n_bits;
+        }
+        void field(const uint8_t v) { put(v); }
+        void field(const int8_t v) { put((uint8_t)v); }
+        void field(const char v) { put((uint8_t)v); }
+        void field(const uint16_t v) { varint(v); }
+        void field(const uint32_t v) { varint(v); }
+        void field(const uint64_t v) { varint(v); }
+        void field(const int16_t v) { varint(message::zigzag<uint16_t>(v)); }
+        void field(const int32_t v) { varint(message::zigzag<uint32_t>(v)); }
+        void field(const int64_t v) { varint(message::zigzag<uint64_t>(v)); }
+        void field(const float v) { raw(&v, sizeof(v)); }
+        void field(const double v) { raw(&v, sizeof(v)); }
+
+        template <size_t N>
+        void field(const char (&s)[N]) {
+            size_t n = 0;
+            while ((n < N) && s[n]) ++n;
+            varint((uint32_t)n);
+            raw(s, n);
+        }
+
+        template <typename T, size_t N>
+        void field(const T (&a)[N]) {
+            for (size_t i = 0; i < N; ++i) field(a[i]);
+        }
+
+        template <typename M>
+        void field(const M& m) {
+            m.es920_fields(*this);
+        }
+
+    private:
+        bool put(const uint8_t b) {
+            if (pos >= capacity) {
+                b_overflow = true;
+                return false;
+            }
+            buffer[pos++] = b;
+            return true;
+        }
+
+        template <typename U>
+        void varint(U v) {
+            while (v >= 0x80) {
+                put((uint8_t)(v | 0x80));
+                v >>= 7;
+            }
+            put((uint8_t)v);
+        }
+
+        void raw(const void* data, const size_t size) {
+            const uint8_t* p = (const uint8_t*)data;
+            for (size_t i = 0; i < size; ++i) put(p[i]);
+        }
+    };
+
+    class MessageReader {
+        const uint8_t* data;
+        size_t size;
+        size_t pos {0};
+        uint8_t bits {0};
+        uint8_t n_bits {8};
+        bool b_error {false};
+
+    public:
+        MessageReader(const uint8_t* d, const size_t s)
+        : data(d), size(s) {}
+
+        template <typename... Args>
+        void operator()(Args&... args) {
+            const int unused[] {0, (field(args), 0)...};
+            (void)unused;
+        }
+
+        bool ok() const { return !b_error; }
+
+        void field(bool& b) {
+            if (n_bits == 8) {
+                bits = get();
+                n_bits = 0;
+            }
+            b = (bits >> n_bits) & 1;
+            ++n_bits;
+        }
+        void field(uint8_t& v) { v = get(); }
+        void field(int8_t& v) { v = (int8_t)get(); }
+        void field(char& v) { v = (char)get(); }
+        void field(uint16_t& v) { v = varint<uint16_t>(); }
+        void field(uint32_t& v) { v = varint<uint32_t>(); }
+        void field(uint64_t& v) { v = varint<uint64_t>(); }
+        void field(int16_t& v) { v = message::unzigzag<int16_t>(varint<uint16_t>()); }
+        void field(int32_t& v) { v = message::unzigzag<int32_t>(varint<uint32_t>()); }
+        void field(int64_t& v) { v = message::unzigzag<int64_t>(varint<uint64_t>()); }
+        void field(float& v) { raw(&v, sizeof(v)); }
+        void field(double& v) { raw(&v, sizeof(v)); }
+
+        template <size_t N>
+        void field(char (&s)[N]) {
+            const uint32_t n = varint<uint32_t>();
+            if (n > N) {
+                b_error = true;
+                return;
+            }
+            raw(s, n);
+            if (n < N) s[n] = '\0';
+        }
+
+        template <typename T, size_t N>
+        void field(T (&a)[N]) {
+            for (size_t i = 0; i < N; ++i) field(a[i]);
+        }
+
+        template <typename M>
+        void field(M& m) {
+            m.es920_fields(*this);
+        }
+
+    private:
+        uint8_t get() {
+            if (pos >= size) {
+                b_error = true;
+                return 0;
+            }
+            return data[pos++];
+        }
+
+        template <typename U>
+        U varint() {
+            U v = 0;
+            for (uint8_t shift = 0; shift < sizeof(U) * 8; shift += 7) {
+                const uint8_t b = get();
+                v |= (U)(b & 0x7F) << shift;
+                if (!(b & 0x80)) return v;
+            }
+            b_error = true;  // too long for U
+            return v;
+        }
+
+        void raw(void* dst, const size_t n) {
+            uint8_t* p = (uint8_t*)dst;
+            for (size_t i = 0; i < n; ++i) p[i] = get();
+        }
+    };
+
+    // returns encoded size, or 0 if msg exceeds capacity
+    template <typename T>
+    inline size_t encodeMessage(const T& msg, uint8_t* buffer, const size_t capacity) {
+        MessageWriter w(buffer, capacity);
+        msg.es920_fields(w);
+        return w.ok() ? w.size() : 0;
+    }
+
+    // false if data is shorter than the fields of T
+    template <typename T>
+    inline bool decodeMessage(const uint8_t* data, const size_t size, T& msg) {
+        MessageReader r(data, size);
+        msg.es920_fields(r);
+        return r.ok();
+    }
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_MESSAGE_H
@@ -4,77 +4,123 @@
 
 #include "Constants.h"
 #include "Utils.h"
+#include "FlightRecorder.h"
+#include "Stats.h"
+#include "Tracer.h"
+#include "ExtHeader.h"
+#include "Compress.h"
 #include <Packetizer.h>
 
 namespace arduino {
 namespace es920 {
 
-    template <typename Stream, uint8_t PAYLOAD_SIZE>
+    template <typename Stream, uint8_t PAYLOAD_SIZE, typename Tracer = NoTracer>
     class Operator {
         Stream* stream;
         Packetizer::Encoder<Packetizer::encoding::COBS> packer;
+        TapCallbackType tap_cb;
+        uint32_t tx_bytes {0};
+#ifdef ES920_DEDUP_ENABLE
+        uint8_t tx_seq {0};
+        uint8_t restart_frames {ext::SEQ_WINDOW};  // frames sent with FLAG_RESTART
+#endif
+#ifdef ES920_COMPRESS_ENABLE
+        uint8_t compressed[ES920_COMPRESS_MAX_SIZE];
+        uint32_t compressed_count {0};
+        uint32_t compress_saved {0};
+#endif
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        FlightRecorder* flight_recorder {nullptr};
+#endif
 
     public:
         void attach(const Stream& s) {
             stream = (Stream*)&s;
         }
 
+        // called with every bytes written to module
+        void tap(const TapCallbackType& cb) {
+            tap_cb = cb;
+        }
+
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        void flightRecorder(FlightRecorder* r) { flight_recorder = r; }
+#endif
+
         bool sendPayload(const StringType& str) {
             if (ES920_STRING_SIZE(str) + 2 > PAYLOAD_SIZE)  // exclude "\r\n"
             {
                 LOG_WARN("too long data, must be <= ", PAYLOAD_SIZE - 2, ". size = ", ES920_STRING_SIZE(str));
                 return false;
             } else {
-                ES920_WRITE_BYTES(str.c_str(), ES920_STRING_SIZE(str));
-                ES920_WRITE_BYTES("\r\n", 2);
+                write(str.c_str(), ES920_STRING_SIZE(str));
+                write("\r\n", 2);
+                Tracer::send(0, (uint8_t)ES920_STRING_SIZE(str));
                 return true;
             }
         }
 
         bool sendPayload(const uint8_t* data, const uint8_t size, const uint8_t index) {
-            if (size + 4 > PAYLOAD_SIZE)  // exclude header, index, size, footer
-                LOG_WARN("too long input data, must be <= ", PAYLOAD_SIZE - 4, ". size = ", size);
+            const uint8_t* body = data;
+            uint8_t body_size = size;
+            const uint8_t flags = deflate(body, body_size);
+            if (body_size + 4 + ES920_EXT_HEADER_SIZE > PAYLOAD_SIZE)  // exclude header, index, size, footer (and extension header)
+                LOG_WARN("too long input data, must be <= ", PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE, ". size = ", body_size);
             else {
-                packer.encode(index, data, size, true);
-                if (packer.size() > PAYLOAD_SIZE)
-                    LOG_WARN("too long packetized data, must be <= ", PAYLOAD_SIZE, ". size = ", size);
+                packer.encode(index, body, body_size, true);
+                if (packer.size() + ES920_EXT_HEADER_SIZE > PAYLOAD_SIZE)
+                    LOG_WARN("too long packetized data, must be <= ", PAYLOAD_SIZE, ". size = ", body_size);
                 else {
-                    ES920_WRITE_BYTE((uint8_t)packer.size());
-                    ES920_WRITE_BYTES(packer.data(), packer.size());
+                    write((uint8_t)(packer.size() + ES920_EXT_HEADER_SIZE));
+                    writeExtHeader(flags);
+                    write(packer.data(), packer.size());
+                    countCompressed(flags, size, body_size);
+                    Tracer::send(index, size);
                     return true;
                 }
             }
             return false;
         }
 
-        // TODO: extend to ES920 format
-        bool sendFrame(const uint16_t pan, const uint16_t own, const StringType& str) {
+        // header is panid + dstid (+ hop count + relays for ES920)
+        bool sendFrame(const uint16_t pan, const uint16_t own, const StringType& str, const FrameRoute& route = FrameRoute()) {
             if (ES920_STRING_SIZE(str) + 2 > PAYLOAD_SIZE)  // exclude "\r\n"
                 LOG_WARN("too long data, must be <= ", PAYLOAD_SIZE - 2, ". size = ", ES920_STRING_SIZE(str));
+            else if (!validRoute(route))
+                LOG_WARN("hop count is out of range : ", route.hops);
             else {
-                StringType header = arx::str::to_hex(pan) + arx::str::to_hex(own);
-                ES920_WRITE_BYTES(header.c_str(), ES920_STRING_SIZE(header));
-                ES920_WRITE_BYTES(str.c_str(), ES920_STRING_SIZE(str));
-                ES920_WRITE_BYTES("\r\n", 2);
+                const StringType header = frameHeader(pan, own, route);
+                write(header.c_str(), ES920_STRING_SIZE(header));
+                write(str.c_str(), ES920_STRING_SIZE(str));
+                write("\r\n", 2);
+                Tracer::send(0, (uint8_t)ES920_STRING_SIZE(str));
                 return true;
             }
             return false;
         }
 
-        // TODO: extend to ES920 format
-        bool sendFrame(const uint16_t pan, const uint16_t own, const uint8_t* data, const uint8_t size, const uint8_t index) {
-            if (size > PAYLOAD_SIZE)
-                LOG_WARN("too long data, must be <= ", PAYLOAD_SIZE, ". size = ", size);
+        bool sendFrame(const uint16_t pan, const uint16_t own, const uint8_t* data, const uint8_t size, const uint8_t index, const FrameRoute& route = FrameRoute()) {
+            const uint8_t* body = data;
+            uint8_t body_size = size;
+            const uint8_t flags = deflate(body, body_size);
+            if (body_size + 4 + ES920_EXT_HEADER_SIZE > PAYLOAD_SIZE)  // exclude header, index, size, footer (and extension header)
+                LOG_WARN("too long input data, must be <= ", PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE, ". size = ", body_size);
+            else if (!validRoute(route))
+                LOG_WARN("hop count is out of range : ", route.hops);
             else {
-                StringType header = arx::str::to_hex(pan) + arx::str::to_hex(own);
-                uint8_t size_ext = (uint8_t)ES920_STRING_SIZE(header) + size;
-                ES920_WRITE_BYTE(size_ext);
-                ES920_WRITE_BYTES(header.c_str(), ES920_STRING_SIZE(header));
-                packer.encode(index, data, size, true);
-                if (packer.size() > PAYLOAD_SIZE)
-                    LOG_WARN("too long packetized data, must be <= ", PAYLOAD_SIZE, ". size = ", size);
+                const StringType header = frameHeader(pan, own, route);
+                packer.encode(index, body, body_size, true);
+                if (packer.size() + ES920_EXT_HEADER_SIZE > PAYLOAD_SIZE)
+                    LOG_WARN("too long packetized data, must be <= ", PAYLOAD_SIZE, ". size = ", body_size);
                 else {
-                    ES920_WRITE_BYTES(packer.data(), packer.size());
+                    // size byte counts header and packetized data
+                    uint8_t size_ext = (uint8_t)(ES920_STRING_SIZE(header) + ES920_EXT_HEADER_SIZE + packer.size());
+                    write(size_ext);
+                    write(header.c_str(), ES920_STRING_SIZE(header));
+                    writeExtHeader(flags);
+                    write(packer.data(), packer.size());
+                    countCompressed(flags, size, body_size);
+                    Tracer::send(index, size);
                     return true;
                 }
             }
@@ -82,6 +128,106 @@ namespace es920 {
         }
 
         uint8_t size() const { return packer.size(); }
+
+        // adds counters to s
+        void stats(Stats& s) const {
+            s.tx_bytes += tx_bytes;
+#ifdef ES920_COMPRESS_ENABLE
+            s.compressed += compressed_count;
+            s.compress_saved += compress_saved;
+#endif
+        }
+
+        void resetStats() {
+            tx_bytes = 0;
+#ifdef ES920_COMPRESS_ENABLE
+            compressed_count = compress_saved = 0;
+#endif
+        }
+
+    private:
+        static constexpr bool isES920() { return PAYLOAD_SIZE == PAYLOAD_SIZE_ES920; }
+
+        static bool validRoute(const FrameRoute& route) {
+            return !isES920() || ((route.hops >= 1) && (route.hops <= 4));
+        }
+
+        static StringType frameHeader(const uint16_t pan, const uint16_t own, const FrameRoute& route) {
+            StringType header = arx::str::to_hex(pan) + arx::str::to_hex(own);
+            if (isES920()) {
+                header += arx::str::to_hex(route.hops);
+                for (uint8_t i = 0; i + 1 < route.hops; ++i) header += arx::str::to_hex(route.routes[i]);
+            }
+            return header;
+        }
+
+        // replaces body with compressed data if it gets smaller, returns flags of extension header
+        uint8_t deflate(const uint8_t*& body, uint8_t& body_size) {
+#ifdef ES920_COMPRESS_ENABLE
+            const size_t n = compress::encode(body, body_size, compressed, sizeof(compressed));
+            if (n == 0) return 0;
+            body = compressed;
+            body_size = (uint8_t)n;
+            return ext::FLAG_COMPRESSED;
+#else
+            (void)body;
+            (void)body_size;
+            return 0;
+#endif
+        }
+
+        void countCompressed(const uint8_t flags, const uint8_t size, const uint8_t body_size) {
+#ifdef ES920_COMPRESS_ENABLE
+            if (!(flags & ext::FLAG_COMPRESSED)) return;
+            ++compressed_count;
+            compress_saved += (uint32_t)(size - body_size);
+#else
+            (void)flags;
+            (void)size;
+            (void)body_size;
+#endif
+        }
+
+        void writeExtHeader(const uint8_t flags) {
+#ifdef ES920_DEDUP_ENABLE
+            uint8_t f = (uint8_t)(flags | ext::FLAG_SEQ);
+            if (restart_frames) {
+                f |= ext::FLAG_RESTART;
+                --restart_frames;
+            }
+            const uint8_t header[ES920_EXT_HEADER_SIZE] {f, tx_seq++};
+            write(header, ES920_EXT_HEADER_SIZE);
+#elif ES920_EXT_HEADER_SIZE > 0
+            write(flags);
+#else
+            (void)flags;
+#endif
+        }
+
+        template <typename T>
+        void write(const T* data, const size_t size) {
+            ES920_WRITE_BYTES(data, size);
+            tx_bytes += (uint32_t)size;
+            record((const uint8_t*)data, size);
+            if (tap_cb) tap_cb(Direction::TX, (const uint8_t*)data, size);
+        }
+
+        void write(const uint8_t data) {
+            ES920_WRITE_BYTE(data);
+            ++tx_bytes;
+            record(&data, 1);
+            if (tap_cb) tap_cb(Direction::TX, &data, 1);
+        }
+
+        void record(const uint8_t* data, const size_t size) {
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+            if (!flight_recorder) return;
+            for (size_t i = 0; i < size; ++i) flight_recorder->record(FlightEvent::TX, data[i]);
+#else
+            (void)data;
+            (void)size;
+#endif
+        }
     };
 
 }  // namespace es920
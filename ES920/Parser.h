@@ -3,17 +3,24 @@
 #define ARDUINO_ES920_PARSER_H
 
 #include "Constants.h"
+#include "Utils.h"
 #include "Parser/AsciiParser.h"
 #include "Parser/BinaryParser.h"
+#include "Tracer.h"
 
 namespace arduino {
 namespace es920 {
 
-    template <typename Stream, uint8_t PAYLOAD_SIZE>
+    template <typename Stream, uint8_t PAYLOAD_SIZE, typename Clock = DefaultClock, typename Tracer = NoTracer>
     class Parser {
         Stream* stream;
-        AsciiParser<PAYLOAD_SIZE> asc_parser;
-        BinaryParser<PAYLOAD_SIZE> bin_parser;
+        AsciiParser<PAYLOAD_SIZE, Tracer> asc_parser;
+        BinaryParser<PAYLOAD_SIZE, Tracer> bin_parser;
+        TapCallbackType tap_cb;
+        uint32_t rx_bytes {0};
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        FlightRecorder* flight_recorder {nullptr};
+#endif
 
     public:
         void attach(const Stream& s, const Baudrate b) {
@@ -33,14 +40,59 @@ namespace es920 {
             bin_parser.subscribe(cb);
         }
 
+        // every accepted binary packet, also with parse(false)
+        void subscribeBinaryFrame(const BinaryAlwaysCallbackType& cb) {
+            bin_parser.subscribeFrame(cb);
+        }
+
+        void subscribeReply(const ReplyCallbackType& cb) {
+            asc_parser.subscribeReply(cb);
+            bin_parser.subscribeReply(cb);
+        }
+
+        void subscribeHeader(const HeaderCallbackType& cb) {
+            asc_parser.subscribeHeader(cb);
+            bin_parser.subscribeHeader(cb);
+        }
+
+        // called with every byte read from module
+        void tap(const TapCallbackType& cb) {
+            tap_cb = cb;
+        }
+
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        void flightRecorder(FlightRecorder* r) {
+            flight_recorder = r;
+            asc_parser.flightRecorder(r);
+            bin_parser.flightRecorder(r);
+        }
+#endif
+
         void clear() {
             asc_parser.clear();
             bin_parser.clear();
         }
 
+        // adds counters to s
+        void stats(Stats& s) const {
+            s.rx_bytes += rx_bytes;
+            asc_parser.stats(s);
+            bin_parser.stats(s);
+        }
+
+        void resetStats() {
+            rx_bytes = 0;
+            asc_parser.resetStats();
+            bin_parser.resetStats();
+        }
+
         size_t parseAscii(const bool b_rssi, const bool b_rcvid, const bool b_exec_cb = true) {
             while (stream->available()) {
                 uint8_t d = ES920_READ_BYTE();
+                ++rx_bytes;
+                Tracer::ingest(d);
+                ES920_FLIGHT_RECORD(FlightEvent::RX, d);
+                if (tap_cb) tap_cb(Direction::RX, &d, 1);
                 asc_parser.feed(d, b_rssi, b_rcvid, b_exec_cb);
             }
             return availableAscii();
@@ -49,6 +101,10 @@ namespace es920 {
         size_t parseBinary(const bool b_rssi, const bool b_rcvid, const bool b_exec_cb = true) {
             while (stream->available()) {
                 uint8_t d = ES920_READ_BYTE();
+                ++rx_bytes;
+                Tracer::ingest(d);
+                ES920_FLIGHT_RECORD(FlightEvent::RX, d);
+                if (tap_cb) tap_cb(Direction::RX, &d, 1);
                 bin_parser.feed(d, b_rssi, b_rcvid, b_exec_cb);
             }
             return availableBinary();
@@ -158,20 +214,22 @@ namespace es920 {
 
     private:
         bool waitResponseAscii(const uint32_t timeout_ms) {
-            uint32_t start_ms = ELAPSED_TIME_MS();
-            while (ELAPSED_TIME_MS() < start_ms + timeout_ms) {
+            uint32_t start_ms = Clock::ms();
+            while (Clock::ms() - start_ms < timeout_ms) {
                 parseAscii(false, false);
                 if (hasReplyAscii()) return true;
+                Clock::idle();
             }
             LOG_INFO("no reply from ascii parser");
             return false;
         }
 
         bool waitResponseBinary(const uint32_t timeout_ms) {
-            uint32_t start_ms = ELAPSED_TIME_MS();
-            while (ELAPSED_TIME_MS() < start_ms + timeout_ms) {
+            uint32_t start_ms = Clock::ms();
+            while (Clock::ms() - start_ms < timeout_ms) {
                 parseBinary(false, false);
                 if (hasReplyBinary()) return true;
+                Clock::idle();
             }
             LOG_ERROR("no reply from binary parser");
             return false;
@@ -3,6 +3,9 @@
 #define ARDUINO_ES920_ASCII_PARSER_H
 
 #include "../Constants.h"
+#include "../FlightRecorder.h"
+#include "../Stats.h"
+#include "../Tracer.h"
 #include <ArxContainer.h>
 
 namespace arduino {
@@ -16,7 +19,7 @@ namespace es920 {
     // typedef void (*AsciiCallbackType)(const StringType& str);
     using AsciiCallbackType = std::function<void(const StringType& str)>;
 
-    template <uint8_t PAYLOAD_SIZE>
+    template <uint8_t PAYLOAD_SIZE, typename Tracer = NoTracer>
     class AsciiParser {
         const StringType line_ok {"OK"};
         const StringType line_ng {"NG "};
@@ -49,6 +52,10 @@ namespace es920 {
         bool b_reset {false};
 
         size_t error_count {0};
+        uint32_t packet_count {0};
+        uint32_t resync_count {0};
+        uint32_t discarded_bytes {0};
+        uint16_t max_queued {0};
         StringType error_code {"000"};
         StringType version_str {""};
         int16_t remote_rssi;
@@ -60,6 +67,11 @@ namespace es920 {
         Buffer payloads;
         StringType buffer;
         AsciiCallbackType asc_callback;
+        ReplyCallbackType reply_callback;
+        HeaderCallbackType header_callback;
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        FlightRecorder* flight_recorder {nullptr};
+#endif
 
     public:
         void feed(const uint8_t* data, const uint8_t size, const bool b_rssi, const bool b_rcvid, const bool b_exec_cb = true) {
@@ -70,6 +82,8 @@ namespace es920 {
             if (c == '\n') {
                 if (buffer[ES920_STRING_SIZE(buffer) - 1] != '\r') {
                     LOG_ERROR("packet format is wrong, reset buffer : ", buffer);
+                    ++resync_count;
+                    discarded_bytes += ES920_STRING_SIZE(buffer) + 1;
                 } else {
                     ES920_STRING_POP_BACK(buffer);  // remove '\r'
                     parseReply(buffer, b_rssi, b_rcvid);
@@ -96,7 +110,13 @@ namespace es920 {
             if (!payloads.empty()) payloads.pop_front();
         }
 
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        void flightRecorder(FlightRecorder* r) { flight_recorder = r; }
+#endif
+
         void subscribe(const AsciiCallbackType& cb) { asc_callback = cb; }
+        void subscribeReply(const ReplyCallbackType& cb) { reply_callback = cb; }
+        void subscribeHeader(const HeaderCallbackType& cb) { header_callback = cb; }
         void callback() {
             if (asc_callback && available()) asc_callback(data());
         }
@@ -110,6 +130,19 @@ namespace es920 {
             error_count = 0;
         }
 
+        // adds counters to s
+        void stats(Stats& s) const {
+            s.rx_packets += packet_count;
+            s.resyncs += resync_count;
+            s.discarded_bytes += discarded_bytes;
+            updateMax(s.max_rx_queue, max_queued);
+        }
+
+        void resetStats() {
+            packet_count = resync_count = discarded_bytes = 0;
+            max_queued = 0;
+        }
+
         bool hasReply() { return disableAndReturn(b_reply); }
         bool hasError() { return disableAndReturn(b_error); }
         bool hasVersion() { return disableAndReturn(b_version); }
@@ -142,6 +175,21 @@ namespace es920 {
         }
 
     private:
+        void notifyHeader(const bool b_rssi) {
+            if (!header_callback) return;
+            const uint16_t pan = (uint16_t)strtol(remote_panid.c_str(), 0, 16);
+            const uint16_t own = (uint16_t)strtol(remote_ownid.c_str(), 0, 16);
+            header_callback(pan, own, remote_rssi, b_rssi);
+        }
+
+        void notifyReply() {
+            if (!reply_callback) return;
+            Reply r;
+            r.b_error = b_error;
+            r.code = b_error ? (ErrorCode)ES920_STRING_TO_INT(error_code) : ErrorCode::None;
+            reply_callback(r);
+        }
+
         void parseReply(const StringType& str, const bool b_rssi, const bool b_rcvid) {
             const size_t str_size = ES920_STRING_SIZE(str);
             if (str == line_ok) {
@@ -149,6 +197,8 @@ namespace es920 {
                 b_error = false;
                 error_code = "000";
                 LOG_INFO("received OK");
+                ES920_FLIGHT_RECORD(FlightEvent::REPLY_OK, 0);
+                notifyReply();
             } else if (
                 (str_size == 6) &&
                 (ES920_STRING_SUBSTR(str, 0, 3) == line_ng)) {
@@ -157,6 +207,8 @@ namespace es920 {
                 error_code = ES920_STRING_SUBSTR(str, 3, 3);
                 error_count++;
                 LOG_ERROR("received error :", error_code, ", error count =", error_count);
+                ES920_FLIGHT_RECORD(FlightEvent::REPLY_NG, (uint8_t)ES920_STRING_TO_INT(error_code));
+                notifyReply();
             } else if (
                 (str_size == 8) &&
                 (ES920_STRING_SUBSTR(str, 0, 3) == line_ver)) {
@@ -164,14 +216,17 @@ namespace es920 {
                 b_version = true;
                 version_str = ES920_STRING_SUBSTR(str, 3, 4);
                 LOG_INFO("version message is detected!!! ver =", version_str);
+                ES920_FLIGHT_RECORD(FlightEvent::VERSION, 0);
             } else if (str == line_config) {
                 b_wakeup = true;
                 mode = Mode::CONFIG;
                 LOG_INFO("wakeup message (config) is detected!!! mode =", (int)mode);
+                ES920_FLIGHT_RECORD(FlightEvent::WAKEUP, (uint8_t)mode);
             } else if (str == line_operation) {
                 b_wakeup = true;
                 mode = Mode::OPERATION;
                 LOG_INFO("wakeup message (operation) is detected!!! mode =", (int)mode);
+                ES920_FLIGHT_RECORD(FlightEvent::WAKEUP, (uint8_t)mode);
             } else if (
                 (str_size >= 3) &&
                 ((ES920_STRING_SUBSTR(str, 0, 3) == line_reset) ||
@@ -179,11 +234,16 @@ namespace es920 {
                 b_reset = true;
                 b_wakeup = false;
                 LOG_INFO("reset message is detected!!!");
+                ES920_FLIGHT_RECORD(FlightEvent::RESET, 0);
             } else {
+                ES920_FLIGHT_RECORD(FlightEvent::PACKET, (uint8_t)str_size);
                 if (PAYLOAD_SIZE == PAYLOAD_SIZE_ES920)
                     parsePayloadES920(str, b_rssi, b_rcvid);
                 else
                     parsePayloadES920LR(str, b_rssi, b_rcvid);
+                ++packet_count;
+                updateMax(max_queued, payloads.size());
+                Tracer::frame((uint8_t)str_size);
             }
         }
 
@@ -199,9 +259,7 @@ namespace es920 {
                     remote_hopid = ES920_STRING_SUBSTR(str, data_head + 4, 4);
                     remote_ownid = ES920_STRING_SUBSTR(str, data_head + 8, 4);
                     data_head += 12;
-                    LOG_INFO("got remote panid :", remote_panid);
-                    LOG_INFO("got remote hopid :", remote_hopid);
-                    LOG_INFO("got remote ownid :", remote_ownid);
+                    notifyHeader(b_rssi);
                 }
                 payloads.push_back(ES920_STRING_SUBSTR(str, data_head, ES920_STRING_SIZE(str) - data_head));
             } else {
@@ -215,14 +273,12 @@ namespace es920 {
                 if (b_rssi) {
                     remote_rssi = ES920_STRING_TO_INT(ES920_STRING_SUBSTR(str, data_head, 4));
                     data_head += 4;
-                    LOG_INFO("got rssi :", remote_rssi);
                 }
                 if (b_rcvid) {
                     remote_panid = ES920_STRING_SUBSTR(str, data_head, 4);
                     remote_ownid = ES920_STRING_SUBSTR(str, data_head + 4, 4);
                     data_head += 8;
-                    LOG_INFO("got remote panid :", remote_panid);
-                    LOG_INFO("got remote ownid :", remote_ownid);
+                    notifyHeader(b_rssi);
                 }
                 payloads.push_back(ES920_STRING_SUBSTR(str, data_head, ES920_STRING_SIZE(str) - data_head));
             } else {
@@ -3,6 +3,11 @@
 #define ARDUINO_ES920_BINARY_PARSER_H
 
 #include "../Constants.h"
+#include "../FlightRecorder.h"
+#include "../Stats.h"
+#include "../Tracer.h"
+#include "../ExtHeader.h"
+#include "../Compress.h"
 #include <Packetizer.h>
 
 namespace arduino {
@@ -11,7 +16,7 @@ namespace es920 {
     using BinaryCallbackType = Packetizer::CallbackType;
     using BinaryAlwaysCallbackType = Packetizer::CallbackAlwaysType;
 
-    template <uint8_t PAYLOAD_SIZE>
+    template <uint8_t PAYLOAD_SIZE, typename Tracer = NoTracer>
     class BinaryParser {
         Packetizer::Decoder<Packetizer::encoding::COBS> unpacker;
 
@@ -25,6 +30,11 @@ namespace es920 {
         bool b_error {false};
 
         size_t error_count {0};
+        uint32_t frame_count {0};
+        uint32_t resync_count {0};
+        uint32_t discarded_bytes {0};
+        uint16_t max_queued {0};
+        uint8_t frame_size {0};  // size byte of current frame
         StringType error_code {"000"};
         StringType version_str {""};
         int16_t remote_rssi;
@@ -36,9 +46,36 @@ namespace es920 {
                            VAGUE,
                            REPLY,
                            HEADER,
+                           EXT,
                            DATA };
-        State state;
+        State state {State::SIZE};
         StringType buffer;
+        ReplyCallbackType reply_callback;
+        HeaderCallbackType header_callback;
+        BinaryAlwaysCallbackType frame_callback;
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        FlightRecorder* flight_recorder {nullptr};
+#endif
+#if ES920_EXT_HEADER_SIZE > 0
+        // frames with extension header are decoded by checker first (COBS + crc),
+        // and only accepted ones are encoded again and fed to unpacker
+        // so that rejected frames never take a slot of the packet queue
+        Packetizer::Decoder<Packetizer::encoding::COBS> checker;
+        Packetizer::Encoder<Packetizer::encoding::COBS> repacker;
+        uint8_t ext_flags {0};
+#endif
+#ifdef ES920_DEDUP_ENABLE
+        DedupTable<ES920_DEDUP_SOURCES> dedup;
+        uint8_t ext_seq {0};
+        uint16_t ext_panid {0};
+        uint16_t ext_ownid {0};
+        bool b_ext_rcvid {false};  // sources are known only with rcvid, otherwise frames are not deduplicated
+        uint32_t duplicate_count {0};
+#endif
+#ifdef ES920_COMPRESS_ENABLE
+        uint8_t inflated[ES920_COMPRESS_MAX_SIZE];
+        uint32_t inflate_errors {0};
+#endif
 
     public:
         void feed(const uint8_t* data, const uint8_t size, const bool b_rssi, const bool b_rcvid, const bool b_exec_cb = true) {
@@ -46,21 +83,45 @@ namespace es920 {
         }
 
         void feed(const uint8_t d, const bool b_rssi, const bool b_rcvid, const bool b_exec_cb = true) {
+#if ES920_EXT_HEADER_SIZE > 0
+            if (checker.parsing()) {
+                checker.feed(&d, 1, false);
+                if (d == 0x00) {  // end of COBS frame
+                    acceptFrame(b_exec_cb);
+                    endFrame();
+                }
+                return;
+            }
+#endif
             if (unpacker.parsing()) {
-                unpacker.feed(&d, 1, b_exec_cb);
+                if (d == 0x00) {  // end of COBS frame
+                    const uint32_t errors = unpacker.errors();
+                    unpacker.feed(&d, 1, false);
+                    if (unpacker.errors() == errors) notifyFrame(unpacker.index_latest(), unpacker.data_latest(), unpacker.size_latest());
+                    if (b_exec_cb) unpacker.callback();
+                    endFrame();
+                } else {
+                    unpacker.feed(&d, 1, b_exec_cb);
+                }
             } else {
                 buffer += (char)d;
 
                 if (state == State::SIZE) {
                     if (isFirstByteReply())
                         state = State::VAGUE;
-                    else
+                    else {
                         state = State::HEADER;
+                        frame_size = (uint8_t)buffer[0];
+                        ES920_FLIGHT_RECORD(FlightEvent::PACKET, frame_size);
+                    }
                 } else if (state == State::VAGUE) {
                     if (isSecondByteReply())
                         state = State::REPLY;
-                    else
+                    else {
                         state = State::HEADER;
+                        frame_size = (uint8_t)buffer[0];
+                        ES920_FLIGHT_RECORD(FlightEvent::PACKET, frame_size);
+                    }
                 }
 
                 switch (state) {
@@ -69,6 +130,7 @@ namespace es920 {
                             LOG_ERROR("won't come here! curr buffer = ", buffer);
                             for (size_t i = 0; i < ES920_STRING_SIZE(buffer); ++i) LOG_ERROR((int)buffer[i]);
 
+                            resync(ES920_STRING_SIZE(buffer));
                             ES920_STRING_CLEAR(buffer);
                             state = State::SIZE;
                         }
@@ -80,6 +142,11 @@ namespace es920 {
                     }
                     case State::HEADER: {
                         if (parseHeader(b_rssi, b_rcvid)) {
+#if ES920_EXT_HEADER_SIZE > 0
+                            // buffer is not empty if the size byte was vague
+                            state = State::EXT;
+                            parseExt(b_rcvid);
+#else
                             // if buffer is not zero, feed to unpacker
                             if (ES920_STRING_SIZE(buffer) != 0) {
                                 if (ES920_STRING_SIZE(buffer) != 1)
@@ -91,11 +158,22 @@ namespace es920 {
                             } else {
                                 state = State::DATA;
                             }
+#endif
                         }
                         break;
                     }
+#if ES920_EXT_HEADER_SIZE > 0
+                    case State::EXT: {
+                        parseExt(b_rcvid);
+                        break;
+                    }
+#endif
                     case State::DATA: {
+#if ES920_EXT_HEADER_SIZE > 0
+                        checker.feed(&d, 1, false);
+#else
                         unpacker.feed(&d, 1, b_exec_cb);
+#endif
                         state = State::SIZE;
                         ES920_STRING_CLEAR(buffer);
                         break;
@@ -106,6 +184,7 @@ namespace es920 {
                         for (size_t i = 0; i < ES920_STRING_SIZE(buffer); ++i)
                             LOG_ERROR((int)buffer[i]);
 
+                        resync(ES920_STRING_SIZE(buffer));
                         ES920_STRING_CLEAR(buffer);
                         state = State::SIZE;
                         break;
@@ -114,6 +193,10 @@ namespace es920 {
             }
         }
 
+#ifdef ES920_FLIGHT_RECORDER_ENABLE
+        void flightRecorder(FlightRecorder* r) { flight_recorder = r; }
+#endif
+
         void subscribe(const uint8_t id, const BinaryCallbackType& cb) {
             unpacker.subscribe(id, cb);
         }
@@ -122,11 +205,28 @@ namespace es920 {
             unpacker.subscribe(cb);
         }
 
+        void subscribeReply(const ReplyCallbackType& cb) {
+            reply_callback = cb;
+        }
+
+        void subscribeHeader(const HeaderCallbackType& cb) {
+            header_callback = cb;
+        }
+
+        // called with every accepted packet when it is queued, also if callbacks are not executed
+        void subscribeFrame(const BinaryAlwaysCallbackType& cb) {
+            frame_callback = cb;
+        }
+
         void callback() {
             unpacker.callback();
         }
 
+#if ES920_EXT_HEADER_SIZE > 0
+        bool isParsing() const { return checker.parsing() || unpacker.parsing(); }
+#else
         bool isParsing() const { return unpacker.parsing(); }
+#endif
         size_t available() const { return unpacker.available(); }
 
         uint8_t index() const { return unpacker.index(); }
@@ -139,7 +239,12 @@ namespace es920 {
         size_t size_latest() const { return unpacker.size_latest(); }
         void pop_back() { unpacker.pop_back(); }
 
-        void clear() { unpacker.reset(); }
+        void clear() {
+            unpacker.reset();
+#if ES920_EXT_HEADER_SIZE > 0
+            checker.reset();
+#endif
+        }
 
         int16_t remoteRssi() const { return remote_rssi; }
         const StringType& remotePanid() const { return remote_panid; }
@@ -152,7 +257,110 @@ namespace es920 {
         const StringType& errorCode() const { return error_code; }
         size_t errorCount() const { return error_count; }
 
+        // adds counters to s
+        void stats(Stats& s) const {
+            s.rx_packets += frame_count;
+            s.resyncs += resync_count;
+            s.discarded_bytes += discarded_bytes;
+#ifdef ES920_DEDUP_ENABLE
+            s.duplicates += duplicate_count;
+#endif
+#ifdef ES920_COMPRESS_ENABLE
+            s.inflate_errors += inflate_errors;
+#endif
+            updateMax(s.max_rx_queue, max_queued);
+        }
+
+        void resetStats() {
+            frame_count = resync_count = discarded_bytes = 0;
+#ifdef ES920_DEDUP_ENABLE
+            duplicate_count = 0;
+#endif
+#ifdef ES920_COMPRESS_ENABLE
+            inflate_errors = 0;
+#endif
+            max_queued = 0;
+        }
+
     private:
+        void endFrame() {
+            ++frame_count;
+            updateMax(max_queued, unpacker.available());
+            Tracer::frame(frame_size);
+        }
+
+#if ES920_EXT_HEADER_SIZE > 0
+        // rest of buffer after the extension header is the beginning of COBS frame
+        void parseExt(const bool b_rcvid) {
+            const size_t size = ES920_STRING_SIZE(buffer);
+            if (size < ES920_EXT_HEADER_SIZE) return;
+            parseExtHeader(b_rcvid);
+            if (size > ES920_EXT_HEADER_SIZE) {
+                checker.feed((const uint8_t*)buffer.c_str() + ES920_EXT_HEADER_SIZE, size - ES920_EXT_HEADER_SIZE, false);
+                state = State::SIZE;
+            } else {
+                state = State::DATA;
+            }
+            ES920_STRING_CLEAR(buffer);
+        }
+
+        void parseExtHeader(const bool b_rcvid) {
+            ext_flags = (uint8_t)buffer[0];
+#ifdef ES920_DEDUP_ENABLE
+            ext_seq = (uint8_t)buffer[1];
+            b_ext_rcvid = b_rcvid;
+            ext_panid = b_rcvid ? (uint16_t)strtol(remote_panid.c_str(), 0, 16) : 0;
+            ext_ownid = b_rcvid ? (uint16_t)strtol(remote_ownid.c_str(), 0, 16) : 0;
+#else
+            (void)b_rcvid;
+#endif
+        }
+
+        // called at the end of a frame with extension header (broken frame is not queued in checker)
+        void acceptFrame(const bool b_exec_cb) {
+            if (!checker.available()) return;
+#ifdef ES920_DEDUP_ENABLE
+            if (b_ext_rcvid && (ext_flags & ext::FLAG_SEQ) && !dedup.accept(ext_panid, ext_ownid, ext_seq, ext_flags & ext::FLAG_RESTART)) {
+                ++duplicate_count;
+                checker.pop();
+                return;
+            }
+#endif
+#ifdef ES920_COMPRESS_ENABLE
+            if (ext_flags & ext::FLAG_COMPRESSED) {
+                inflateFrame(b_exec_cb);
+                checker.pop();
+                return;
+            }
+#endif
+            notifyFrame(checker.index(), checker.data(), checker.size());
+            repacker.encode(checker.index(), checker.data(), checker.size(), true);
+            checker.pop();
+            unpacker.feed(repacker.data(), repacker.size(), b_exec_cb);
+        }
+#endif
+
+#ifdef ES920_COMPRESS_ENABLE
+        // decompressed packet is fed to unpacker so that callbacks and pop() see the original data
+        void inflateFrame(const bool b_exec_cb) {
+            const uint8_t index = checker.index();
+            const size_t size = compress::decode(checker.data(), checker.size(), inflated, sizeof(inflated));
+            if (size == 0) {
+                LOG_WARN("failed to decompress binary frame, index = ", (int)index);
+                ++inflate_errors;
+                return;
+            }
+            notifyFrame(index, inflated, size);
+            repacker.encode(index, inflated, size, true);
+            unpacker.feed(repacker.data(), repacker.size(), b_exec_cb);
+        }
+#endif
+
+        void resync(const size_t discarded) {
+            ++resync_count;
+            discarded_bytes += (uint32_t)discarded;
+        }
+
         bool isOkFirstByte() const { return (ES920_STRING_SIZE(buffer) < 1) ? false : (buffer[0] == line_ok_bin[0]); }
         bool isNgFirstByte() const { return (ES920_STRING_SIZE(buffer) < 1) ? false : (buffer[0] == line_ng_bin[0]); }
         bool isOkSecondByte() const { return (ES920_STRING_SIZE(buffer) < 2) ? false : (buffer[1] == line_ok_bin[1]); }
@@ -174,10 +382,30 @@ namespace es920 {
             return s;
         }
 
+        void notifyFrame(const uint8_t index, const uint8_t* data, const size_t size) {
+            if (frame_callback) frame_callback(index, data, size);
+        }
+
+        void notifyHeader(const bool b_rssi) {
+            if (!header_callback) return;
+            const uint16_t pan = (uint16_t)strtol(remote_panid.c_str(), 0, 16);
+            const uint16_t own = (uint16_t)strtol(remote_ownid.c_str(), 0, 16);
+            header_callback(pan, own, remote_rssi, b_rssi);
+        }
+
+        void notifyReply() {
+            if (!reply_callback) return;
+            Reply r;
+            r.b_error = b_error;
+            r.code = b_error ? (ErrorCode)ES920_STRING_TO_INT(error_code) : ErrorCode::None;
+            reply_callback(r);
+        }
+
         bool parseReply() {
             // delete unexpcted first data
             // ignore rssi & rcvid because first byte varies depending on data size
             if (ES920_STRING_SIZE(buffer) > MAX_HEADER_SIZE) {
+                const size_t prev_size = ES920_STRING_SIZE(buffer);
                 while (ES920_STRING_SIZE(buffer)) {
                     if (!isFirstByteReply()) {
                         LOG_ERROR("first letter is out of range (int) : ", (int)buffer[0]);
@@ -185,6 +413,7 @@ namespace es920 {
                     } else
                         break;
                 }
+                if (ES920_STRING_SIZE(buffer) != prev_size) resync(prev_size - ES920_STRING_SIZE(buffer));
             }
 
             if (ES920_STRING_SIZE(buffer) == 0) {
@@ -201,6 +430,8 @@ namespace es920 {
                 error_code = "000";
                 ES920_STRING_ERASE(buffer, 0, 3);
                 LOG_INFO("send OK, BINARY");
+                ES920_FLIGHT_RECORD(FlightEvent::REPLY_OK, 0);
+                notifyReply();
                 return true;
             }
 
@@ -213,6 +444,8 @@ namespace es920 {
                 error_count++;
                 ES920_STRING_ERASE(buffer, 0, 7);
                 LOG_ERROR("send error (BINARY):", error_code, ", error count =", error_count);
+                ES920_FLIGHT_RECORD(FlightEvent::REPLY_NG, (uint8_t)ES920_STRING_TO_INT(error_code));
+                notifyReply();
                 return true;
             }
 
@@ -238,9 +471,7 @@ namespace es920 {
                     remote_panid = ES920_STRING_SUBSTR(buffer, data_head + 0, 4);
                     remote_hopid = ES920_STRING_SUBSTR(buffer, data_head + 4, 4);
                     remote_ownid = ES920_STRING_SUBSTR(buffer, data_head + 8, 4);
-                    LOG_INFO("got remote panid :", remote_panid);
-                    LOG_INFO("got remote hopid :", remote_hopid);
-                    LOG_INFO("got remote ownid :", remote_ownid);
+                    notifyHeader(b_rssi);
                 }
                 ES920_STRING_ERASE(buffer, 0, header_size);
                 return true;
@@ -255,13 +486,11 @@ namespace es920 {
                 if (b_rssi) {
                     remote_rssi = ES920_STRING_TO_INT(ES920_STRING_SUBSTR(buffer, data_head, 4));
                     data_head += 4;
-                    LOG_INFO("got rssi :", remote_rssi);
                 }
                 if (b_rcvid) {
                     remote_panid = ES920_STRING_SUBSTR(buffer, data_head, 4);
                     remote_ownid = ES920_STRING_SUBSTR(buffer, data_head + 4, 4);
-                    LOG_INFO("got remote panid :", remote_panid);
-                    LOG_INFO("got remote ownid :", remote_ownid);
+                    notifyHeader(b_rssi);
                 }
                 ES920_STRING_ERASE(buffer, 0, header_size);
                 return true;
@@ -0,0 +1,139 @@
+#pragma once
+#ifndef ARDUINO_ES920_POSIX_SERIAL_H
+#define ARDUINO_ES920_POSIX_SERIAL_H
+
+// ofSerial compatible serial port for plain POSIX hosts (Linux, macOS)
+// ES920::ES920_<ES920::PosixSerial> can be used without openFrameworks
+
+#if !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+
+#include <cerrno>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <string>
+
+namespace arduino {
+namespace es920 {
+
+    class PosixSerial {
+        int port_fd {-1};
+
+    public:
+        PosixSerial() = default;
+        PosixSerial(const PosixSerial&) = delete;
+        PosixSerial& operator=(const PosixSerial&) = delete;
+        ~PosixSerial() { close(); }
+
+        bool setup(const std::string& device, const int baud) {
+            close();
+            port_fd = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+            if (port_fd < 0) {
+                LOG_ERROR("cannot open serial device :", device);
+                return false;
+            }
+
+            termios tio;
+            if (tcgetattr(port_fd, &tio) != 0) {
+                close();
+                return false;
+            }
+            cfmakeraw(&tio);
+            tio.c_cflag |= (CLOCAL | CREAD);
+            tio.c_cc[VMIN] = 0;
+            tio.c_cc[VTIME] = 0;
+            const speed_t speed = toSpeed(baud);
+            cfsetispeed(&tio, speed);
+            cfsetospeed(&tio, speed);
+            if (tcsetattr(port_fd, TCSANOW, &tio) != 0) {
+                LOG_ERROR("cannot set baudrate :", baud);
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close() {
+            if (port_fd >= 0) ::close(port_fd);
+            port_fd = -1;
+        }
+
+        bool isInitialized() const { return port_fd >= 0; }
+
+        // file descriptor to be watched by poll() / select()
+        int fd() const { return port_fd; }
+
+        int available() const {
+            if (port_fd < 0) return 0;
+            int n = 0;
+            if (ioctl(port_fd, FIONREAD, &n) != 0) return 0;
+            return n;
+        }
+
+        int readByte() {
+            uint8_t d = 0;
+            if ((port_fd < 0) || (::read(port_fd, &d, 1) != 1)) return -1;
+            return d;
+        }
+
+        long readBytes(uint8_t* data, const size_t size) {
+            if (port_fd < 0) return -1;
+            return ::read(port_fd, data, size);
+        }
+
+        bool writeByte(const uint8_t d) {
+            return writeBytes(&d, 1) == 1;
+        }
+
+        long writeBytes(const uint8_t* data, const size_t size) {
+            if (port_fd < 0) return -1;
+            size_t sent = 0;
+            while (sent < size) {
+                const ssize_t n = ::write(port_fd, data + sent, size - sent);
+                if (n > 0)
+                    sent += n;
+                else if (n < 0 && errno != EAGAIN && errno != EINTR)
+                    return -1;
+                else
+                    tcdrain(port_fd);  // output buffer is full
+            }
+            return (long)sent;
+        }
+
+        long writeBytes(const char* data, const size_t size) {
+            return writeBytes((const uint8_t*)data, size);
+        }
+
+        // wait until all output has been transmitted
+        void flush() {
+            if (port_fd >= 0) tcdrain(port_fd);
+        }
+
+    private:
+        static speed_t toSpeed(const int baud) {
+            switch (baud) {
+                case 9600:
+                    return B9600;
+                case 19200:
+                    return B19200;
+                case 38400:
+                    return B38400;
+                case 57600:
+                    return B57600;
+                case 115200:
+                    return B115200;
+                case 230400:
+                    return B230400;
+                default:
+                    return B115200;
+            }
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif
+
+#endif  // ARDUINO_ES920_POSIX_SERIAL_H
@@ -0,0 +1,524 @@
+#pragma once
+#ifndef ARDUINO_ES920_ROUTE_H
+#define ARDUINO_ES920_ROUTE_H
+
+// automatic multihop route of ES920 (binary format, rcvid, rssi and ack must be enabled)
+// every node keeps rssi of its neighbors from hop id of received packets,
+// and nodes report them to the coordinator periodically on a reserved binary index
+// coordinator computes minimum hop routes (best bottleneck rssi for the same hops) to the target end device,
+// and changes routes of itself and the end device only with route commands (ES920_::route())
+//
+// REPORT  : [1][count]([id (2 bytes, little endian)][rssi (int8)]) * count  node -> coordinator
+// ROUTE   : [2][seq][hops][end id (2)][route1 (2)][route2 (2)][route3 (2)]  coordinator -> end device
+// CONFIRM : [3][seq]                                                          end device -> coordinator (new route)
+//
+// coordinator switches delay ms after ROUTE is replied OK (ROUTE is resent if not), end device delay ms after receiving it
+// if CONFIRM does not arrive in fallback_ms (or is not acked), both sides return to the previous route
+//
+// ES920_ROUTE_NODES : max number of nodes (including coordinator) in route computation
+// ES920_ROUTE_LINKS : max number of links reported
+
+#include "Constants.h"
+#include "Utils.h"
+#include "LinkTable.h"
+
+#ifndef ES920_ROUTE_NODES
+#define ES920_ROUTE_NODES 16
+#endif
+
+#ifndef ES920_ROUTE_LINKS
+#define ES920_ROUTE_LINKS 32
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct RouteInfo {
+        uint8_t hops {0};  // 0 : no route
+        uint16_t end {0};
+        uint16_t routes[3] {0x0001, 0x0001, 0x0001};  // relays from the coordinator
+        int16_t rssi {-128};                          // worst link on the route [dBm]
+
+        bool valid() const { return hops != 0; }
+        bool operator==(const RouteInfo& o) const {
+            return (hops == o.hops) && (end == o.end) && (routes[0] == o.routes[0]) && (routes[1] == o.routes[1]) && (routes[2] == o.routes[2]);
+        }
+        bool operator!=(const RouteInfo& o) const { return !(*this == o); }
+
+        // the same path from the end device to the coordinator
+        RouteInfo reversed(const uint16_t coordinator) const {
+            RouteInfo r = *this;
+            r.end = coordinator;
+            for (uint8_t i = 0; i + 1 < hops; ++i) r.routes[i] = routes[hops - 2 - i];
+            return r;
+        }
+    };
+
+    // links reported to the coordinator (rssi of both directions is merged to the worse one)
+    class RouteGraph {
+        struct Link {
+            uint16_t a;
+            uint16_t b;
+            int8_t rssi;
+            uint32_t ms;
+        };
+
+        Link links[ES920_ROUTE_LINKS];
+        uint8_t n {0};
+
+    public:
+        void update(const uint16_t from, const uint16_t to, const int8_t rssi, const uint32_t now_ms) {
+            for (uint8_t i = 0; i < n; ++i) {
+                Link& l = links[i];
+                if (((l.a == from) && (l.b == to)) || ((l.a == to) && (l.b == from))) {
+                    // the other direction reported recently : keep the worse one
+                    const bool b_other = (l.a != from) && (now_ms - l.ms < 1000);
+                    l.rssi = (b_other && (l.rssi < rssi)) ? l.rssi : rssi;
+                    l.a = from;
+                    l.b = to;
+                    l.ms = now_ms;
+                    return;
+                }
+            }
+            uint8_t i = n;
+            if (n < ES920_ROUTE_LINKS)
+                ++n;
+            else {
+                i = 0;
+                for (uint8_t k = 1; k < n; ++k)
+                    if ((now_ms - links[k].ms) > (now_ms - links[i].ms)) i = k;
+            }
+            links[i] = Link {from, to, rssi, now_ms};
+        }
+
+        void expire(const uint32_t now_ms, const uint32_t age_ms) {
+            for (uint8_t i = 0; i < n;) {
+                if (now_ms - links[i].ms > age_ms)
+                    links[i] = links[--n];
+                else
+                    ++i;
+            }
+        }
+
+        void clear() { n = 0; }
+        uint8_t size() const { return n; }
+
+        // -128 if unknown
+        int8_t rssi(const uint16_t a, const uint16_t b) const {
+            for (uint8_t i = 0; i < n; ++i)
+                if (((links[i].a == a) && (links[i].b == b)) || ((links[i].a == b) && (links[i].b == a))) return links[i].rssi;
+            return -128;
+        }
+
+        // minimum hops (1 - 4) from src to dst over links with rssi >= min_rssi, then the best bottleneck rssi
+        RouteInfo route(const uint16_t src, const uint16_t dst, const int16_t min_rssi) const {
+            RouteInfo r;
+            uint16_t ids[ES920_ROUTE_NODES];
+            uint8_t n_ids = 0;
+            const int8_t s = index(ids, n_ids, src);
+            const int8_t d = index(ids, n_ids, dst);
+            for (uint8_t i = 0; i < n; ++i) {
+                index(ids, n_ids, links[i].a);
+                index(ids, n_ids, links[i].b);
+            }
+            if ((s < 0) || (d < 0)) return r;
+
+            // best[h][v] : best bottleneck rssi to v with h hops, prev[h][v] : previous node
+            int16_t best[5][ES920_ROUTE_NODES];
+            int8_t prev[5][ES920_ROUTE_NODES];
+            for (uint8_t h = 0; h < 5; ++h)
+                for (uint8_t v = 0; v < n_ids; ++v) {
+                    best[h][v] = INT16_MIN;
+                    prev[h][v] = -1;
+                }
+            best[0][s] = INT16_MAX;
+
+            for (uint8_t h = 1; h < 5; ++h) {
+                for (uint8_t i = 0; i < n; ++i) {
+                    if (links[i].rssi < min_rssi) continue;
+                    const int8_t a = find(ids, n_ids, links[i].a);
+                    const int8_t b = find(ids, n_ids, links[i].b);
+                    relax(best, prev, h, a, b, links[i].rssi);
+                    relax(best, prev, h, b, a, links[i].rssi);
+                }
+                if (best[h][d] == INT16_MIN) continue;
+
+                r.hops = h;
+                r.end = dst;
+                r.rssi = best[h][d];
+                int8_t v = prev[h][d];
+                for (uint8_t k = h - 1; k > 0; --k) {
+                    r.routes[k - 1] = ids[v];
+                    v = prev[k][v];
+                }
+                return r;
+            }
+            return r;
+        }
+
+    private:
+        static int8_t find(const uint16_t* ids, const uint8_t n_ids, const uint16_t id) {
+            for (uint8_t i = 0; i < n_ids; ++i)
+                if (ids[i] == id) return (int8_t)i;
+            return -1;
+        }
+
+        static int8_t index(uint16_t* ids, uint8_t& n_ids, const uint16_t id) {
+            const int8_t i = find(ids, n_ids, id);
+            if ((i >= 0) || (n_ids == ES920_ROUTE_NODES)) return i;
+            ids[n_ids] = id;
+            return (int8_t)n_ids++;
+        }
+
+        static void relax(int16_t (&best)[5][ES920_ROUTE_NODES], int8_t (&prev)[5][ES920_ROUTE_NODES], const uint8_t h, const int8_t from, const int8_t to, const int16_t rssi) {
+            if ((from < 0) || (to < 0) || (best[h - 1][from] == INT16_MIN)) return;
+            const int16_t bottleneck = (best[h - 1][from] < rssi) ? best[h - 1][from] : rssi;
+            if (bottleneck > best[h][to]) {
+                best[h][to] = bottleneck;
+                prev[h][to] = from;
+            }
+        }
+    };
+
+    template <typename Radio, typename Clock = DefaultClock>
+    class RouteManager {
+    public:
+        enum class Role : uint8_t {
+            COORDINATOR,
+            NODE  // routers and end devices
+        };
+
+    private:
+        enum class MessageType : uint8_t {
+            REPORT = 1,
+            ROUTE,
+            CONFIRM
+        };
+
+        enum class State : uint8_t {
+            IDLE,
+            REQUESTED,   // coordinator : waiting reply of ROUTE
+            SWITCHING,   // waiting switchover time
+            CONFIRMING,  // switched, waiting CONFIRM (coordinator) or its ack (end device)
+        };
+
+        Radio& radio;
+        Role role;
+        uint8_t index;
+
+        LinkTable<ES920_ROUTE_NODES> neighbors;  // keyed by hop id
+        RouteGraph graph;
+
+        uint16_t target {0};
+        State state {State::IDLE};
+        RouteInfo pending;
+        RouteInfo previous;
+        uint8_t seq {0};
+        uint8_t attempts {0};
+        bool b_resend {false};
+        bool b_confirm_pending {false};
+        uint32_t state_ms {0};
+        uint32_t switch_ms {0};
+        uint32_t confirm_sent_ms {0};
+        uint32_t report_ms {0};
+        uint32_t changed_ms {0};
+
+        // parameters
+        uint32_t report_interval_ms {30000};
+        uint32_t expire_ms {120000};
+        uint32_t hold_ms {60000};
+        uint16_t delay_ms {500};
+        int16_t min_rssi {-100};
+        uint8_t hysteresis_db {6};
+        uint32_t request_timeout_ms {3000};
+        uint8_t max_attempts {3};
+        uint32_t fallback_ms {30000};
+        uint32_t confirm_interval_ms {1000};
+
+        size_t n_changes {0};
+        size_t n_fallbacks {0};
+
+    public:
+        RouteManager(Radio& r, const Role rl, const uint8_t idx = 0xF2)
+        : radio(r), role(rl), index(idx) {
+            radio.subscribe(index, [&](const uint8_t* data, const size_t size) {
+                receive(data, size);
+            });
+            radio.subscribeHeader([&](const uint16_t pan, const uint16_t, const int16_t rssi, const bool b_rssi) {
+                const uint16_t hop = (uint16_t)strtol(radio.remoteHopid().c_str(), 0, 16);
+                neighbors.update(pan, hop, rssi, b_rssi, Clock::ms());
+            });
+            changed_ms = Clock::ms();
+        }
+
+        // end device which coordinator keeps the route to (default : endid of current configuration)
+        void destination(const uint16_t end) { target = end; }
+        // interval of neighbor reports from nodes
+        void reportInterval(const uint32_t ms) { report_interval_ms = ms; }
+        // neighbors and reported links not heard for this time are removed
+        void expire(const uint32_t ms) { expire_ms = ms; }
+        // minimum interval between route changes
+        void hold(const uint32_t ms) { hold_ms = ms; }
+        // links weaker than this are not used
+        void minRssi(const int16_t dbm) { min_rssi = dbm; }
+        // route with the same hops is changed only if bottleneck rssi improves by this
+        void hysteresis(const uint8_t db) { hysteresis_db = db; }
+        // time from ROUTE message to route change
+        void switchDelay(const uint16_t ms) { delay_ms = ms; }
+        // reply timeout of ROUTE message and number of sends before giving up
+        void requestTimeout(const uint32_t ms) { request_timeout_ms = ms; }
+        void attemptLimit(const uint8_t n) { max_attempts = n ? n : 1; }
+        // time to receive CONFIRM after switchover (must cover reconfiguration of both modules)
+        void fallback(const uint32_t ms) { fallback_ms = ms; }
+
+        // call after parse() in main loop, route change blocks while reconfiguring
+        void update() {
+            const uint32_t now_ms = Clock::ms();
+            neighbors.expire(now_ms, expire_ms);
+
+            switch (state) {
+                case State::IDLE: {
+                    if (role == Role::NODE) {
+                        if (now_ms - report_ms >= report_interval_ms) report(now_ms);
+                    } else
+                        evaluate(now_ms);
+                    break;
+                }
+                case State::REQUESTED: {
+                    if (b_resend)
+                        sendRoute();
+                    else if (now_ms - state_ms >= request_timeout_ms) {
+                        // reply was not reported (e.g. lost waiter), do not wait forever
+                        LOG_WARN("route: no reply of ROUTE");
+                        retry();
+                    }
+                    break;
+                }
+                case State::SWITCHING: {
+                    if ((int32_t)(now_ms - switch_ms) >= 0) {
+                        previous = current();
+                        if (!apply(pending)) {
+                            LOG_ERROR("route: failed to change route");
+                            apply(previous);
+                            finish(Clock::ms());
+                            break;
+                        }
+                        enter(State::CONFIRMING, Clock::ms());
+                        b_confirm_pending = false;
+                        confirm_sent_ms = 0;
+                    }
+                    break;
+                }
+                case State::CONFIRMING: {
+                    if (now_ms - state_ms >= fallback_ms) {
+                        LOG_WARN("route: no confirmation, fall back to previous route");
+                        ++n_fallbacks;
+                        apply(previous);
+                        finish(Clock::ms());
+                    } else if ((role == Role::NODE) && !b_confirm_pending && (now_ms - confirm_sent_ms >= confirm_interval_ms)) {
+                        sendConfirm(now_ms);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // route from the coordinator to the destination on current links (hops == 0 if not found)
+        RouteInfo route() const {
+            const uint16_t end = target ? target : radio.endid();
+            RouteGraph g = graph;
+            const uint32_t now_ms = Clock::ms();
+            for (uint8_t i = 0; i < neighbors.size(); ++i) {
+                const LinkEntry& e = neighbors.at(i);
+                if (e.b_rssi) g.update(radio.ownid(), e.ownid, clamp(e.rssi()), now_ms);
+            }
+            return g.route(radio.ownid(), end, min_rssi);
+        }
+
+        RouteInfo current() const {
+            RouteInfo r;
+            r.hops = radio.hopcount();
+            r.end = radio.endid();
+            r.routes[0] = radio.route1();
+            r.routes[1] = radio.route2();
+            r.routes[2] = radio.route3();
+            return r;
+        }
+
+        const LinkTable<ES920_ROUTE_NODES>& neighborTable() const { return neighbors; }
+        const RouteGraph& links() const { return graph; }
+        bool busy() const { return state != State::IDLE; }
+        size_t changes() const { return n_changes; }
+        size_t fallbacks() const { return n_fallbacks; }
+
+    private:
+        static int8_t clamp(const int16_t rssi) {
+            return (rssi < -128) ? -128 : ((rssi > 127) ? 127 : (int8_t)rssi);
+        }
+
+        bool shouldChange(const RouteInfo& next) const {
+            const RouteInfo cur = current();
+            if (next == cur) return false;
+            if ((cur.end != next.end) || (next.hops < cur.hops)) return true;
+            // bottleneck rssi of the current route
+            int16_t cur_rssi = INT16_MAX;
+            uint16_t from = radio.ownid();
+            for (uint8_t i = 0; i < cur.hops; ++i) {
+                const uint16_t to = (i + 1 < cur.hops) ? cur.routes[i] : cur.end;
+                const int16_t r = linkRssi(from, to);
+                if (r < cur_rssi) cur_rssi = r;
+                from = to;
+            }
+            if (next.hops == cur.hops) return next.rssi >= cur_rssi + hysteresis_db;
+            return cur_rssi < min_rssi;  // more hops only if current route is broken
+        }
+
+        int16_t linkRssi(const uint16_t a, const uint16_t b) const {
+            if (a == radio.ownid()) {
+                const LinkEntry* e = neighbors.find(radio.panid(), b);
+                if (e && e->b_rssi) return e->rssi();
+            }
+            return graph.rssi(a, b);
+        }
+
+        void enter(const State s, const uint32_t now_ms) {
+            state = s;
+            state_ms = now_ms;
+        }
+
+        // back to idle, next change is evaluated after hold_ms
+        void finish(const uint32_t now_ms) {
+            enter(State::IDLE, now_ms);
+            changed_ms = now_ms;
+        }
+
+        void evaluate(const uint32_t now_ms) {
+            graph.expire(now_ms, expire_ms);
+            if (now_ms - changed_ms < hold_ms) return;
+            changed_ms = now_ms;
+
+            const RouteInfo next = route();
+            if (!next.valid() || !shouldChange(next)) return;
+
+            // end device first (over current route), then coordinator itself after ROUTE is replied
+            LOG_INFO("route: change route to", next.end, "hops", next.hops);
+            pending = next;
+            ++seq;
+            attempts = 0;
+            enter(State::REQUESTED, now_ms);
+            sendRoute();
+        }
+
+        void sendRoute() {
+            b_resend = false;
+            ++attempts;
+            const RouteInfo r = pending.reversed(radio.ownid());
+            uint8_t msg[11] {
+                (uint8_t)MessageType::ROUTE, seq, r.hops,
+                (uint8_t)(r.end & 0xFF), (uint8_t)(r.end >> 8),
+                (uint8_t)(r.routes[0] & 0xFF), (uint8_t)(r.routes[0] >> 8),
+                (uint8_t)(r.routes[1] & 0xFF), (uint8_t)(r.routes[1] >> 8),
+                (uint8_t)(r.routes[2] & 0xFF), (uint8_t)(r.routes[2] >> 8)};
+            const uint8_t sent_seq = seq;
+            const uint8_t sent_attempt = attempts;
+            state_ms = Clock::ms();
+            const bool b_sent = radio.sendAsync(
+                index, msg, sizeof(msg), [&, sent_seq, sent_attempt](const Reply& r) {
+                    if ((state != State::REQUESTED) || (seq != sent_seq) || (attempts != sent_attempt)) return;
+                    if (r.success()) {
+                        switch_ms = Clock::ms() + delay_ms;
+                        enter(State::SWITCHING, Clock::ms());
+                    } else
+                        retry();
+                },
+                request_timeout_ms);
+            if (!b_sent) retry();
+        }
+
+        // ROUTE is resent from update() (not from reply callback)
+        void retry() {
+            if (attempts < max_attempts) {
+                b_resend = true;
+                return;
+            }
+            LOG_WARN("route: ROUTE was not delivered to end device");
+            finish(Clock::ms());
+        }
+
+        void sendConfirm(const uint32_t now_ms) {
+            uint8_t msg[2] {(uint8_t)MessageType::CONFIRM, seq};
+            confirm_sent_ms = now_ms;
+            b_confirm_pending = radio.sendAsync(
+                index, msg, sizeof(msg), [&](const Reply& r) {
+                    b_confirm_pending = false;
+                    if (r.success() && (state == State::CONFIRMING)) {
+                        ++n_changes;
+                        LOG_INFO("route: changed, hops", pending.hops);
+                        finish(Clock::ms());
+                    }
+                },
+                confirm_interval_ms);
+        }
+
+        bool apply(const RouteInfo& r) {
+            return radio.route(r.hops, r.end, r.routes[0], r.routes[1], r.routes[2]);
+        }
+
+        void report(const uint32_t now_ms) {
+            report_ms = now_ms;
+            uint8_t msg[Radio::payloadSize()];
+            uint8_t count = 0;
+            const uint8_t max_count = (uint8_t)((sizeof(msg) - 2) / 3);
+            for (uint8_t i = 0; (i < neighbors.size()) && (count < max_count); ++i) {
+                const LinkEntry& e = neighbors.at(i);
+                if (!e.b_rssi || (e.panid != radio.panid())) continue;
+                msg[2 + count * 3 + 0] = (uint8_t)(e.ownid & 0xFF);
+                msg[2 + count * 3 + 1] = (uint8_t)(e.ownid >> 8);
+                msg[2 + count * 3 + 2] = (uint8_t)clamp(e.rssi());
+                ++count;
+            }
+            if (count == 0) return;
+            msg[0] = (uint8_t)MessageType::REPORT;
+            msg[1] = count;
+            radio.send(index, msg, (uint8_t)(2 + count * 3));
+        }
+
+        void receive(const uint8_t* data, const size_t size) {
+            if (size < 2) return;
+            const MessageType type = (MessageType)data[0];
+            const uint32_t now_ms = Clock::ms();
+
+            if ((role == Role::COORDINATOR) && (type == MessageType::REPORT)) {
+                const uint16_t from = (uint16_t)strtol(radio.remoteOwnid().c_str(), 0, 16);
+                const uint8_t count = data[1];
+                if (size < (size_t)(2 + count * 3)) return;
+                for (uint8_t i = 0; i < count; ++i) {
+                    const uint8_t* p = data + 2 + i * 3;
+                    const uint16_t id = (uint16_t)(p[0] | (p[1] << 8));
+                    if (id == radio.ownid()) continue;  // already known from own neighbors
+                    graph.update(from, id, (int8_t)p[2], now_ms);
+                }
+            } else if ((role == Role::COORDINATOR) && (type == MessageType::CONFIRM) && (state == State::CONFIRMING) && (data[1] == seq)) {
+                ++n_changes;
+                LOG_INFO("route: changed, hops", pending.hops);
+                finish(now_ms);
+            } else if ((role == Role::NODE) && (type == MessageType::ROUTE) && (size >= 11)) {
+                if ((state != State::IDLE) && (data[1] == seq)) return;  // duplicated (resent ROUTE)
+                if (state == State::CONFIRMING) return;                  // previous change is not confirmed yet
+                RouteInfo r;
+                r.hops = data[2];
+                r.end = (uint16_t)(data[3] | (data[4] << 8));
+                for (uint8_t i = 0; i < 3; ++i) r.routes[i] = (uint16_t)(data[5 + i * 2] | (data[6 + i * 2] << 8));
+                if ((r.hops < 1) || (r.hops > 4) || (r == current())) return;
+                seq = data[1];
+                pending = r;
+                switch_ms = now_ms + delay_ms;
+                enter(State::SWITCHING, now_ms);
+            }
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_ROUTE_H
@@ -0,0 +1,243 @@
+#pragma once
+#ifndef ARDUINO_ES920_SIMULATOR_H
+#define ARDUINO_ES920_SIMULATOR_H
+
+// discrete-event simulation of many library stacks contending for one channel (host only)
+// every node is ES920_<VirtualModule> or ES920LR_<VirtualModule> on a shared AirLink with virtual clock,
+// end devices send binary packets to the coordinator (ownid 0) at random (poisson) intervals
+
+#ifndef ARDUINO
+
+#include <cmath>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "Emulator.h"
+
+namespace arduino {
+namespace es920 {
+
+    struct SimulationParams {
+        size_t nodes {100};  // end devices (coordinator is added)
+        uint8_t channel {1};
+        Rate rate {Rate::RATE_50KBPS};  // ES920 only
+        BW bw {BW::BW_125_KHZ};         // ES920LR only
+        SF sf {SF::SF_7};               // ES920LR only
+        bool ack {true};
+        uint8_t retry {3};
+        uint8_t size {16};               // data bytes per packet (>= 6)
+        uint32_t interval_ms {60000};    // mean sending interval of each end device
+        uint32_t duration_ms {600000};  // traffic is generated during this time
+        uint32_t latency_us {0};
+        float loss_rate {0.f};
+        uint32_t seed {1};
+    };
+
+    struct SimulationResult {
+        size_t nodes {0};
+        size_t offered {0};     // generated packets
+        size_t sent {0};        // replied "OK"
+        size_t missing_ack {0};  // replied "NG 103"
+        size_t busy {0};        // replied "NG 102"
+        size_t delivered {0};   // received by coordinator (without duplicates)
+        size_t duplicated {0};  // received again because ack was lost
+        size_t frames {0};      // frames on the air (including retries)
+        size_t retries {0};
+        size_t collisions {0};
+        double goodput_bps {0.};
+        double delivery_ratio {0.};
+        double retries_per_packet {0.};
+        // from generation to "OK" (including queueing in the node)
+        double latency_p50_ms {0.};
+        double latency_p90_ms {0.};
+        double latency_p99_ms {0.};
+        double latency_max_ms {0.};
+
+        static std::string csvHeader() {
+            return "nodes,offered,sent,missing_ack,busy,delivered,duplicated,frames,retries,collisions,"
+                   "goodput_bps,delivery_ratio,retries_per_packet,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms";
+        }
+
+        std::string csv() const {
+            char buf[256];
+            std::snprintf(buf, sizeof(buf), "%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.1f,%.4f,%.3f,%.1f,%.1f,%.1f,%.1f",
+                nodes, offered, sent, missing_ack, busy, delivered, duplicated, frames, retries, collisions,
+                goodput_bps, delivery_ratio, retries_per_packet, latency_p50_ms, latency_p90_ms, latency_p99_ms, latency_max_ms);
+            return buf;
+        }
+    };
+
+    template <typename Radio>
+    class Simulator {
+        static constexpr uint8_t INDEX {0x01};
+
+        struct Station {
+            VirtualModule module;
+            Radio radio;
+            uint16_t id;
+            uint32_t seq {0};
+            std::deque<uint64_t> queue;  // generated time of packets waiting to be sent
+            bool b_sending {false};
+            uint64_t next_us {UINT64_MAX};
+
+            Station(const VirtualModule::Model m, const Config& c)
+            : module(m, c), id(c.ownid) {}
+        };
+
+        SimulationParams params;
+        AirLink air;
+        std::vector<std::unique_ptr<Station>> nodes;  // [0] : coordinator
+        SimulationResult result;
+        std::vector<uint64_t> latencies;
+        std::set<uint64_t> received;  // node id and sequence number
+        size_t delivered_bytes {0};
+        uint32_t rng;
+
+    public:
+        explicit Simulator(const SimulationParams& p)
+        : params(p), air(p.seed), rng(p.seed ? p.seed : 1) {
+            air.virtualClock(true);
+            air.latency(params.latency_us);
+            air.lossRate(params.loss_rate);
+            params.size = std::max<uint8_t>(params.size, 6);
+            params.size = std::min<uint8_t>(params.size, Radio::payloadSize());
+
+            const VirtualModule::Model model = (Radio::modulePayloadSize() == PAYLOAD_SIZE_ES920LR) ? VirtualModule::Model::ES920LR : VirtualModule::Model::ES920;
+            for (size_t i = 0; i <= params.nodes; ++i) {
+                Config c;
+                c.operation = Mode::OPERATION;
+                c.format = Format::BINARY;
+                c.channel = params.channel;
+                c.rate = params.rate;
+                c.bw = params.bw;
+                c.sf = params.sf;
+                c.ack = params.ack;
+                c.retry = params.retry;
+                c.node = (i == 0) ? Node::COORDINATOR : Node::ENDDEVICE;
+                c.ownid = (uint16_t)i;
+                c.dstid = 0x0000;
+
+                Station* n = new Station(model, c);
+                air.attach(n->module);
+                n->radio.attach(n->module, c);
+                nodes.emplace_back(n);
+            }
+
+            nodes[0]->radio.subscribe(INDEX, [&](const uint8_t* data, const size_t size) {
+                if (size < 6) return;
+                const uint64_t key = ((uint64_t)(data[0] | (data[1] << 8)) << 32) | ((uint32_t)data[2] | ((uint32_t)data[3] << 8) | ((uint32_t)data[4] << 16) | ((uint32_t)data[5] << 24));
+                if (received.insert(key).second) {
+                    ++result.delivered;
+                    delivered_bytes += size;
+                } else
+                    ++result.duplicated;
+            });
+        }
+
+        Simulator(const Simulator&) = delete;
+        Simulator& operator=(const Simulator&) = delete;
+
+        // run until all generated packets are replied
+        SimulationResult run() {
+            // boot messages are discarded as begin() does
+            const uint64_t start_us = air.now() + 1000000;
+            const uint64_t end_us = start_us + (uint64_t)params.duration_ms * 1000;
+            air.advance(start_us);
+            for (auto& n : nodes)
+                while (n->module.available()) n->module.readByte();
+
+            for (size_t i = 1; i < nodes.size(); ++i) nodes[i]->next_us = start_us + interval();
+
+            while (true) {
+                uint64_t t = air.nextEventUs();
+                for (auto& n : nodes) {
+                    t = std::min(t, n->module.nextEventUs());
+                    if (n->next_us < end_us) t = std::min(t, n->next_us);
+                }
+                if (t == UINT64_MAX) break;
+                air.advance(t);
+
+                for (size_t i = 1; i < nodes.size(); ++i) {
+                    Station& n = *nodes[i];
+                    while ((n.next_us <= t) && (n.next_us < end_us)) {
+                        n.queue.push_back(n.next_us);
+                        ++result.offered;
+                        n.next_us += interval();
+                    }
+                    kick(n);
+                }
+                for (auto& n : nodes) n->radio.parse();
+                for (size_t i = 1; i < nodes.size(); ++i) kick(*nodes[i]);
+            }
+
+            result.nodes = params.nodes;
+            result.frames = air.sentFrames();
+            result.retries = air.retriedFrames();
+            result.collisions = air.collidedFrames();
+            result.goodput_bps = (double)delivered_bytes * 8. * 1000. / (double)params.duration_ms;
+            result.delivery_ratio = result.offered ? (double)result.delivered / (double)result.offered : 0.;
+            const size_t issued = result.sent + result.missing_ack + result.busy;
+            result.retries_per_packet = issued ? (double)result.retries / (double)issued : 0.;
+
+            std::sort(latencies.begin(), latencies.end());
+            result.latency_p50_ms = percentile(0.50);
+            result.latency_p90_ms = percentile(0.90);
+            result.latency_p99_ms = percentile(0.99);
+            result.latency_max_ms = latencies.empty() ? 0. : (double)latencies.back() / 1000.;
+            return result;
+        }
+
+        AirLink& link() { return air; }
+        Radio& radio(const size_t i) { return nodes[i]->radio; }
+        VirtualModule& module(const size_t i) { return nodes[i]->module; }
+
+    private:
+        void kick(Station& n) {
+            if (n.b_sending || n.queue.empty()) return;
+
+            uint8_t data[PAYLOAD_SIZE_ES920];
+            const uint32_t seq = n.seq++;
+            data[0] = (uint8_t)(n.id & 0xFF);
+            data[1] = (uint8_t)(n.id >> 8);
+            for (uint8_t i = 0; i < 4; ++i) data[2 + i] = (uint8_t)(seq >> (8 * i));
+            for (uint8_t i = 6; i < params.size; ++i) data[i] = (uint8_t)(seq + i);
+
+            const uint64_t generated_us = n.queue.front();
+            n.queue.pop_front();
+            n.b_sending = true;
+            Station* pn = &n;
+            n.radio.sendAsync(INDEX, data, params.size, [this, pn, generated_us](const Reply& r) {
+                pn->b_sending = false;
+                if (r.success()) {
+                    ++result.sent;
+                    latencies.push_back(air.now() - generated_us);
+                } else if (r.code == ErrorCode::CarriorSense)
+                    ++result.busy;
+                else
+                    ++result.missing_ack;
+            });
+        }
+
+        // exponential distribution (poisson arrival)
+        uint64_t interval() {
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            const double u = ((double)rng + 1.) / 4294967297.;
+            return (uint64_t)(-std::log(u) * (double)params.interval_ms * 1000.);
+        }
+
+        double percentile(const double q) const {
+            if (latencies.empty()) return 0.;
+            const size_t i = std::min(latencies.size() - 1, (size_t)(q * (double)latencies.size()));
+            return (double)latencies[i] / 1000.;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO
+
+#endif  // ARDUINO_ES920_SIMULATOR_H
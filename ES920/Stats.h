@@ -0,0 +1,88 @@
+#pragma once
+#ifndef ARDUINO_ES920_STATS_H
+#define ARDUINO_ES920_STATS_H
+
+// runtime counters of the radio stack, always enabled (a few increments per byte / packet)
+// ES920Base::stats() returns a snapshot, ES920Base::resetStats() clears all counters
+// ES920_STATS_INDEX_SIZE : number of per-index packet counters (indexes beyond share the last one)
+
+#include "Constants.h"
+
+#ifndef ES920_STATS_INDEX_SIZE
+#define ES920_STATS_INDEX_SIZE 16
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct Stats {
+        static constexpr uint8_t INDEX_SIZE {ES920_STATS_INDEX_SIZE};
+        static constexpr uint8_t ERROR_CODE_SIZE {10};  // see errorCodeSlot()
+
+        uint32_t rx_bytes {0};  // serial bytes read from module
+        uint32_t tx_bytes {0};  // serial bytes written to module (including commands)
+        uint32_t rx_packets {0};  // received lines (ascii) or frames (binary)
+        uint32_t tx_packets {0};
+        uint32_t rx_packets_index[INDEX_SIZE] {};  // binary packets accepted by parser (also with parse(false))
+        uint32_t tx_packets_index[INDEX_SIZE] {};
+        uint32_t replies_ok {0};
+        uint32_t replies_ng[ERROR_CODE_SIZE] {};
+        uint32_t reply_timeouts {0};
+        uint32_t rejected_waiters {0};  // reply waiters completed with timeout because too many were waiting
+        uint32_t resyncs {0};          // parser lost framing and restarted
+        uint32_t discarded_bytes {0};  // bytes dropped by resyncs
+        uint32_t duplicates {0};       // binary frames dropped by ES920_DEDUP_ENABLE
+        uint32_t compressed {0};       // binary frames sent compressed by ES920_COMPRESS_ENABLE
+        uint32_t compress_saved {0};   // bytes saved by compression
+        uint32_t inflate_errors {0};   // received compressed frames which could not be decompressed
+        uint16_t max_rx_queue {0};     // received packets waiting for pop()
+        uint16_t max_reply_waiters {0};
+        uint16_t max_packet_waiters {0};
+
+        uint32_t rxPackets(const uint8_t index) const { return rx_packets_index[indexSlot(index)]; }
+        uint32_t txPackets(const uint8_t index) const { return tx_packets_index[indexSlot(index)]; }
+        uint32_t ng(const ErrorCode e) const { return replies_ng[errorCodeSlot(e)]; }
+        uint32_t ngTotal() const {
+            uint32_t n = 0;
+            for (uint8_t i = 0; i < ERROR_CODE_SIZE; ++i) n += replies_ng[i];
+            return n;
+        }
+
+        void countRx(const uint8_t index) { ++rx_packets_index[indexSlot(index)]; }
+        void countTx(const uint8_t index) {
+            ++tx_packets;
+            ++tx_packets_index[indexSlot(index)];
+        }
+        void countReply(const Reply& r) {
+            if (r.b_timeout)
+                ++reply_timeouts;
+            else if (r.b_error)
+                ++replies_ng[errorCodeSlot(r.code)];
+            else
+                ++replies_ok;
+        }
+
+        void clear() { *this = Stats(); }
+
+        static uint8_t indexSlot(const uint8_t index) {
+            return (index < INDEX_SIZE) ? index : (uint8_t)(INDEX_SIZE - 1);
+        }
+
+        // 1-5 : command errors, 100-103 : send errors, others (unknown code) share the last slot
+        static uint8_t errorCodeSlot(const ErrorCode e) {
+            const uint8_t c = (uint8_t)e;
+            if ((c >= 1) && (c <= 5)) return c - 1;
+            if ((c >= 100) && (c <= 103)) return c - 95;
+            return ERROR_CODE_SIZE - 1;
+        }
+    };
+
+    template <typename T>
+    inline void updateMax(uint16_t& m, const T v) {
+        if (v > m) m = (v > 0xFFFF) ? 0xFFFF : (uint16_t)v;
+    }
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_STATS_H
@@ -0,0 +1,131 @@
+#pragma once
+#ifndef ARDUINO_ES920_TRACER_H
+#define ARDUINO_ES920_TRACER_H
+
+// tracing policy of Parser / Operator / Configurator / ES920Base (last template parameter)
+// hooks : ingest() every byte from module, frame() end of received packet, reply() OK / NG,
+//         send() packet written to module, configStep() command written to module
+// NoTracer (default) compiles to nothing, RingTracer keeps timestamped binary events for profiling
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifndef ARDUINO
+#include <chrono>
+#include <ostream>
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    struct NoTracer {
+        static void ingest(const uint8_t) {}
+        static void frame(const uint8_t) {}
+        static void reply(const Reply&) {}
+        static void send(const uint8_t, const uint8_t) {}
+        static void configStep(const char*, const size_t) {}
+    };
+
+    enum class TraceEvent : uint8_t {
+        INGEST = 1,   // a : byte
+        FRAME,        // a : size (size byte of binary frame or length of ascii line)
+        REPLY,        // a : error code (0 : OK)
+        SEND,         // a : index, b : size
+        CONFIG_STEP,  // a, b : first 3 characters of command (e.g. "cha" for channel)
+    };
+
+    // 8 bytes, little endian in binary dump
+    struct TraceRecord {
+        uint32_t us;
+        TraceEvent kind;
+        uint8_t a;
+        uint16_t b;
+    };
+
+    // ring of the last SIZE events, shared by all radios which use the same RingTracer type
+    template <uint16_t SIZE = 256>
+    struct RingTracer {
+        static_assert((SIZE != 0) && ((SIZE & (SIZE - 1)) == 0), "RingTracer SIZE must be power of 2");
+
+        static void ingest(const uint8_t d) { push(TraceEvent::INGEST, d, 0); }
+        static void frame(const uint8_t size) { push(TraceEvent::FRAME, size, 0); }
+        static void reply(const Reply& r) { push(TraceEvent::REPLY, (uint8_t)r.code, 0); }
+        static void send(const uint8_t index, const uint8_t size) { push(TraceEvent::SEND, index, size); }
+        static void configStep(const char* cmd, const size_t size) {
+            const uint8_t c0 = (size > 0) ? (uint8_t)cmd[0] : 0;
+            const uint8_t c1 = (size > 1) ? (uint8_t)cmd[1] : 0;
+            const uint8_t c2 = (size > 2) ? (uint8_t)cmd[2] : 0;
+            push(TraceEvent::CONFIG_STEP, c0, (uint16_t)(c1 | (c2 << 8)));
+        }
+
+        static void clear() { ring().head = ring().count = 0; }
+        static uint16_t size() { return ring().count; }
+        static constexpr uint16_t capacity() { return SIZE; }
+
+        // i == 0 : oldest
+        static const TraceRecord& at(const uint16_t i) {
+            const Ring& r = ring();
+            return r.records[(r.head - r.count + i) & (SIZE - 1)];
+        }
+
+        template <typename F>
+        static void forEach(const F& f) {
+            for (uint16_t i = 0; i < size(); ++i) f(at(i));
+        }
+
+        // packed 8 byte records from oldest, put(const uint8_t* data, size_t size)
+        template <typename Put>
+        static void dumpBinary(const Put& put) {
+            uint8_t buf[8];
+            forEach([&](const TraceRecord& e) {
+                buf[0] = (uint8_t)(e.us);
+                buf[1] = (uint8_t)(e.us >> 8);
+                buf[2] = (uint8_t)(e.us >> 16);
+                buf[3] = (uint8_t)(e.us >> 24);
+                buf[4] = (uint8_t)e.kind;
+                buf[5] = e.a;
+                buf[6] = (uint8_t)(e.b);
+                buf[7] = (uint8_t)(e.b >> 8);
+                put(buf, sizeof(buf));
+            });
+        }
+
+#ifndef ARDUINO
+        static void dumpBinary(std::ostream& out) {
+            dumpBinary([&](const uint8_t* data, const size_t size) { out.write((const char*)data, size); });
+        }
+#endif
+
+    private:
+        struct Ring {
+            TraceRecord records[SIZE];
+            uint16_t head {0};
+            uint16_t count {0};
+        };
+
+        static Ring& ring() {
+            static Ring r;
+            return r;
+        }
+
+        static uint32_t micros() {
+#ifdef ARDUINO
+            return ::micros();
+#else
+            static const auto start = std::chrono::steady_clock::now();
+            return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+#endif
+        }
+
+        static void push(const TraceEvent kind, const uint8_t a, const uint16_t b) {
+            Ring& r = ring();
+            r.records[r.head] = TraceRecord {micros(), kind, a, b};
+            r.head = (r.head + 1) & (SIZE - 1);
+            if (r.count < SIZE) ++r.count;
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_TRACER_H
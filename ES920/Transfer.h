@@ -0,0 +1,421 @@
+#pragma once
+#ifndef ARDUINO_ES920_TRANSFER_H
+#define ARDUINO_ES920_TRANSFER_H
+
+// reliable bulk transfer (files, logs, firmware images) with sliding-window selective repeat
+// on a reserved binary index (binary format only, same index and model on both sides)
+// sender streams up to `window` chunks back to back, and polls the receiver with the last chunk it can send.
+// radio is half duplex, so the receiver answers only to polls, when the sender has stopped and is listening.
+// ack tells the next expected chunk and which following chunks were received,
+// and the sender resends only missing ones. ack timeout (rto) follows rtt measured from polls (RFC 6298)
+// module ack (Config::ack) should be disabled on the sender, otherwise every chunk waits for module ack
+//
+// DATA : [1 | flags][transfer id][seq (2 bytes, little endian)][data]  flags : 0x10 poll, 0x20 last chunk
+// ACK  : [2][transfer id][next expected seq (2)][bitmap (4)]  bit i : seq (next + 1 + i) was received
+//
+// ES920_TRANSFER_INDEX : binary index of transfer packets
+// ES920_TRANSFER_WINDOW : max window (chunks), receiver buffers this number of chunks for reordering (<= 32)
+
+#include "Constants.h"
+#include "Utils.h"
+
+#ifndef ES920_TRANSFER_INDEX
+#define ES920_TRANSFER_INDEX 0xF4
+#endif
+
+#ifndef ES920_TRANSFER_WINDOW
+#define ES920_TRANSFER_WINDOW 8
+#endif
+
+namespace arduino {
+namespace es920 {
+
+    static_assert(ES920_TRANSFER_WINDOW >= 1 && ES920_TRANSFER_WINDOW <= 32, "ES920_TRANSFER_WINDOW must be 1 - 32");
+
+    // fills buf with data at offset, returns the number of bytes (must be `size` except for errors)
+    using TransferSourceType = std::function<size_t(const uint32_t offset, uint8_t* buf, const size_t size)>;
+    // received data in order
+    using TransferSinkType = std::function<void(const uint32_t offset, const uint8_t* data, const size_t size)>;
+    using TransferDoneCallbackType = std::function<void(const bool b_success, const uint32_t size)>;
+
+    struct TransferStats {
+        // sender
+        uint32_t chunks {0};    // new chunks sent
+        uint32_t resent {0};    // chunks sent again
+        uint32_t failed {0};    // module replied NG or timeout
+        uint32_t polls {0};
+        uint32_t timeouts {0};  // no ack for poll in rto
+        uint32_t acks {0};
+        uint32_t bytes {0};     // acknowledged
+        uint32_t elapsed_ms {0};  // of last completed transfer
+        uint32_t srtt_ms {0};
+        uint32_t rto_ms {0};
+        // receiver
+        uint32_t received {0};    // new chunks
+        uint32_t duplicates {0};  // already received or out of window
+
+        // new chunks / all chunks on the air
+        float efficiency() const { return (chunks + resent) ? (float)chunks / (float)(chunks + resent) : 0.f; }
+        // [bytes/s] of last completed transfer
+        float throughput() const { return elapsed_ms ? (float)bytes * 1000.f / (float)elapsed_ms : 0.f; }
+        void clear() { *this = TransferStats(); }
+    };
+
+    template <typename Radio, typename Clock = DefaultClock>
+    class BulkTransfer {
+        static constexpr uint8_t HEADER_SIZE {4};
+        static constexpr uint8_t CHUNK_SIZE {Radio::payloadSize() - HEADER_SIZE};
+        static constexpr uint8_t ACK_SIZE {8};
+        static constexpr uint8_t TYPE_DATA {1};
+        static constexpr uint8_t TYPE_ACK {2};
+        static constexpr uint8_t FLAG_POLL {0x10};
+        static constexpr uint8_t FLAG_LAST {0x20};
+
+        Radio& radio;
+        uint8_t index;
+        TransferStats counters;
+
+        uint8_t window_size {ES920_TRANSFER_WINDOW};
+        uint8_t max_retries {8};
+        uint32_t min_rto_ms {200};
+        uint32_t max_rto_ms {60000};
+        uint32_t initial_rto_ms {3000};
+        uint32_t reply_timeout_ms {3000};
+
+        // sender
+        TransferSourceType source;
+        TransferDoneCallbackType tx_done;
+        uint32_t tx_size {0};
+        uint32_t tx_begin_ms {0};
+        uint16_t tx_chunks {0};
+        uint16_t tx_base {0};     // oldest chunk not acknowledged
+        uint16_t tx_next {0};     // next new chunk
+        uint32_t tx_acked {0};    // bit i : tx_base + i
+        uint32_t tx_resend {0};   // bit i : tx_base + i
+        uint8_t tx_id {0};
+        bool b_tx_active {false};
+        bool b_tx_inflight {false};
+        bool b_wait_ack {false};
+        uint32_t poll_ms {0};
+        uint8_t n_retries {0};
+        uint32_t srtt_ms {0};
+        uint32_t rttvar_ms {0};
+        uint32_t rto_ms {0};
+
+        // receiver
+        TransferSinkType sink;
+        TransferDoneCallbackType rx_done;
+        uint8_t rx_id {0};
+        bool b_rx_active {false};
+        bool b_rx_done {false};
+        bool b_rx_last {false};
+        uint16_t rx_last {0};
+        uint16_t rx_next {0};    // next expected chunk
+        uint32_t rx_bitmap {0};  // bit i : rx_next + i
+        uint32_t rx_bytes {0};
+        uint8_t slots[ES920_TRANSFER_WINDOW][CHUNK_SIZE];
+        uint8_t slot_sizes[ES920_TRANSFER_WINDOW];
+
+    public:
+        explicit BulkTransfer(Radio& r, const uint8_t idx = ES920_TRANSFER_INDEX)
+        : radio(r), index(idx), tx_id((uint8_t)Clock::ms()), rto_ms(initial_rto_ms) {
+            radio.subscribe(index, [&](const uint8_t* data, const size_t size) {
+                if ((size < HEADER_SIZE) || (size > Radio::payloadSize())) return;
+                if ((data[0] & 0x0F) == TYPE_DATA)
+                    onData(data, size);
+                else if (((data[0] & 0x0F) == TYPE_ACK) && (size >= ACK_SIZE))
+                    onAck(data);
+            });
+        }
+
+        // chunks sent before waiting for ack (<= ES920_TRANSFER_WINDOW)
+        void window(const uint8_t n) { window_size = (n == 0) ? 1 : (n > ES920_TRANSFER_WINDOW) ? ES920_TRANSFER_WINDOW : n; }
+        // consecutive ack timeouts before giving up
+        void retries(const uint8_t n) { max_retries = n; }
+        // ack timeout before the first rtt sample, and its bounds
+        void rto(const uint32_t initial_ms, const uint32_t min_ms = 200, const uint32_t max_ms = 60000) {
+            initial_rto_ms = initial_ms;
+            min_rto_ms = min_ms;
+            max_rto_ms = max_ms;
+        }
+        void replyTimeout(const uint32_t ms) { reply_timeout_ms = ms; }
+
+        // data bytes per packet
+        static constexpr uint8_t chunkSize() { return CHUNK_SIZE; }
+
+        // starts sending `size` bytes read from source, false if another transfer is running
+        bool send(const uint32_t size, const TransferSourceType& src, const TransferDoneCallbackType& done = nullptr) {
+            if (b_tx_active) {
+                LOG_WARN("transfer: another transfer is running");
+                return false;
+            }
+            const uint32_t chunks = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            if (chunks > 0xFFFF) {
+                LOG_WARN("transfer: too large data, must be <= ", (uint32_t)0xFFFF * CHUNK_SIZE, ". size = ", size);
+                return false;
+            }
+            source = src;
+            tx_done = done;
+            tx_size = size;
+            tx_chunks = (chunks == 0) ? 1 : (uint16_t)chunks;  // empty data is sent as an empty last chunk
+            tx_base = tx_next = 0;
+            tx_acked = tx_resend = 0;
+            ++tx_id;
+            b_tx_active = true;
+            b_wait_ack = false;
+            n_retries = 0;
+            srtt_ms = rttvar_ms = 0;
+            rto_ms = initial_rto_ms;
+            tx_begin_ms = Clock::ms();
+            return true;
+        }
+
+        // data must be valid until the transfer is done
+        bool send(const uint8_t* data, const uint32_t size, const TransferDoneCallbackType& done = nullptr) {
+            return send(
+                size, [data](const uint32_t offset, uint8_t* buf, const size_t n) {
+                    for (size_t i = 0; i < n; ++i) buf[i] = data[offset + i];
+                    return n;
+                },
+                done);
+        }
+
+        // called in order for each received chunk, done is called when the last chunk is delivered
+        void receive(const TransferSinkType& s, const TransferDoneCallbackType& done = nullptr) {
+            sink = s;
+            rx_done = done;
+        }
+
+        // call after parse() in main loop
+        void update() {
+            if (!b_tx_active || b_tx_inflight) return;
+
+            if (b_wait_ack) {
+                if (Clock::ms() - poll_ms < rto_ms) return;
+                ++counters.timeouts;
+                if (++n_retries > max_retries) {
+                    LOG_WARN("transfer: no ack from receiver, abort");
+                    finish(false);
+                    return;
+                }
+                rto_ms = (rto_ms * 2 > max_rto_ms) ? max_rto_ms : rto_ms * 2;
+                b_wait_ack = false;
+                ++counters.resent;
+                sendChunk(tx_base, true);  // poll again with the oldest missing chunk
+                return;
+            }
+
+            uint16_t seq = 0;
+            bool b_resend = false;
+            if (tx_resend) {
+                uint8_t i = 0;
+                while (!(tx_resend & ((uint32_t)1 << i))) ++i;
+                tx_resend &= ~((uint32_t)1 << i);
+                seq = tx_base + i;
+                b_resend = true;
+            } else if (canSendNew())
+                seq = tx_next++;
+            else {
+                seq = tx_base;  // last poll was not sent
+                b_resend = true;
+            }
+            if (b_resend)
+                ++counters.resent;
+            else
+                ++counters.chunks;
+            sendChunk(seq, !tx_resend && !canSendNew());
+        }
+
+        // stops sending (the receiver keeps its state until the next transfer)
+        void abort() {
+            if (b_tx_active) finish(false);
+        }
+
+        bool busy() const { return b_tx_active; }
+        bool receiving() const { return b_rx_active && !b_rx_done; }
+        // acknowledged bytes of current transfer
+        uint32_t progress() const {
+            const uint32_t bytes = (uint32_t)tx_base * CHUNK_SIZE;
+            return (bytes > tx_size) ? tx_size : bytes;
+        }
+        uint32_t received() const { return rx_bytes; }
+
+        const TransferStats& stats() const { return counters; }
+        void resetStats() { counters.clear(); }
+
+    private:
+        bool canSendNew() const { return (tx_next < tx_chunks) && (tx_next - tx_base < window_size); }
+
+        void sendChunk(const uint16_t seq, const bool b_poll) {
+            uint8_t frame[Radio::payloadSize()];
+            const uint32_t offset = (uint32_t)seq * CHUNK_SIZE;
+            const uint32_t rest = tx_size - offset;
+            const uint8_t size = (rest > CHUNK_SIZE) ? CHUNK_SIZE : (uint8_t)rest;
+            if (source(offset, frame + HEADER_SIZE, size) != size) {
+                LOG_ERROR("transfer: failed to read source at", offset);
+                finish(false);
+                return;
+            }
+            frame[0] = TYPE_DATA | (b_poll ? FLAG_POLL : 0) | ((seq + 1 == tx_chunks) ? FLAG_LAST : 0);
+            frame[1] = tx_id;
+            frame[2] = (uint8_t)(seq & 0xFF);
+            frame[3] = (uint8_t)(seq >> 8);
+
+            const uint8_t id = tx_id;
+            const bool b_sent = radio.sendAsync(
+                index, frame, HEADER_SIZE + size, [&, seq, b_poll, id](const Reply& r) {
+                    b_tx_inflight = false;
+                    if (!b_tx_active || (id != tx_id)) return;
+                    if (!r.success()) {
+                        ++counters.failed;
+                        markResend(seq);
+                        return;
+                    }
+                    if (b_poll) {
+                        ++counters.polls;
+                        b_wait_ack = true;
+                        poll_ms = Clock::ms();
+                    }
+                },
+                reply_timeout_ms);
+            if (b_sent)
+                b_tx_inflight = true;
+            else
+                markResend(seq);
+        }
+
+        void markResend(const uint16_t seq) {
+            if ((seq < tx_base) || (seq >= tx_next)) return;
+            const uint32_t bit = (uint32_t)1 << (seq - tx_base);
+            if (!(tx_acked & bit)) tx_resend |= bit;
+        }
+
+        void onAck(const uint8_t* data) {
+            if (!b_tx_active || (data[1] != tx_id)) return;
+            ++counters.acks;
+            const uint16_t next = (uint16_t)data[2] | ((uint16_t)data[3] << 8);
+            const uint32_t bitmap = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+
+            // rtt of the first poll only (Karn's algorithm)
+            if (b_wait_ack && (n_retries == 0)) sample(Clock::ms() - poll_ms);
+
+            for (uint16_t seq = tx_base; seq < tx_next; ++seq) {
+                const uint16_t d = seq - next;
+                if ((seq < next) || ((seq > next) && (d <= 32) && (bitmap & ((uint32_t)1 << (d - 1))))) {
+                    tx_acked |= (uint32_t)1 << (seq - tx_base);
+                    tx_resend &= ~((uint32_t)1 << (seq - tx_base));
+                }
+            }
+            // the poll was the last chunk sent, so unacknowledged chunks before it are lost
+            if (b_wait_ack) {
+                for (uint16_t seq = tx_base; seq < tx_next; ++seq) markResend(seq);
+                b_wait_ack = false;
+                if (n_retries && srtt_ms) updateRto();  // receiver is reachable again, drop backoff
+                n_retries = 0;
+            }
+            while ((tx_base < tx_next) && (tx_acked & 1)) {
+                tx_acked >>= 1;
+                tx_resend >>= 1;
+                ++tx_base;
+            }
+            if (tx_base >= tx_chunks) finish(true);
+        }
+
+        // RFC 6298
+        void sample(const uint32_t rtt_ms) {
+            if (srtt_ms == 0) {
+                srtt_ms = rtt_ms ? rtt_ms : 1;
+                rttvar_ms = rtt_ms / 2;
+            } else {
+                const uint32_t err = (srtt_ms > rtt_ms) ? srtt_ms - rtt_ms : rtt_ms - srtt_ms;
+                rttvar_ms = (3 * rttvar_ms + err) / 4;
+                srtt_ms = (7 * srtt_ms + rtt_ms) / 8;
+            }
+            counters.srtt_ms = srtt_ms;
+            updateRto();
+        }
+
+        void updateRto() {
+            rto_ms = srtt_ms + 4 * rttvar_ms;
+            if (rto_ms < min_rto_ms) rto_ms = min_rto_ms;
+            if (rto_ms > max_rto_ms) rto_ms = max_rto_ms;
+            counters.rto_ms = rto_ms;
+        }
+
+        void finish(const bool b_success) {
+            b_tx_active = false;
+            b_wait_ack = false;
+            if (b_success) {
+                counters.bytes = tx_size;
+                counters.elapsed_ms = Clock::ms() - tx_begin_ms;
+            }
+            if (tx_done) tx_done(b_success, progress());
+        }
+
+        void onData(const uint8_t* data, const size_t size) {
+            const uint8_t flags = data[0] & 0xF0;
+            const uint8_t id = data[1];
+            const uint16_t seq = (uint16_t)data[2] | ((uint16_t)data[3] << 8);
+
+            // new transfer
+            if (!b_rx_active || (id != rx_id)) {
+                rx_id = id;
+                b_rx_active = true;
+                b_rx_done = b_rx_last = false;
+                rx_next = 0;
+                rx_bitmap = 0;
+                rx_bytes = 0;
+            }
+
+            if (b_rx_done || (seq < rx_next) || (seq - rx_next >= ES920_TRANSFER_WINDOW) || (rx_bitmap & ((uint32_t)1 << (seq - rx_next)))) {
+                ++counters.duplicates;
+            } else {
+                ++counters.received;
+                const uint8_t s = seq % ES920_TRANSFER_WINDOW;
+                slot_sizes[s] = (uint8_t)(size - HEADER_SIZE);
+                for (uint8_t i = 0; i < slot_sizes[s]; ++i) slots[s][i] = data[HEADER_SIZE + i];
+                rx_bitmap |= (uint32_t)1 << (seq - rx_next);
+                if (flags & FLAG_LAST) {
+                    b_rx_last = true;
+                    rx_last = seq;
+                }
+                deliver();
+            }
+
+            if (flags & FLAG_POLL) sendAck();
+            if (b_rx_last && !b_rx_done && (rx_next > rx_last)) {
+                b_rx_done = true;
+                if (rx_done) rx_done(true, rx_bytes);
+            }
+        }
+
+        void deliver() {
+            while (rx_bitmap & 1) {
+                const uint8_t s = rx_next % ES920_TRANSFER_WINDOW;
+                if (sink) sink(rx_bytes, slots[s], slot_sizes[s]);
+                rx_bytes += slot_sizes[s];
+                rx_bitmap >>= 1;
+                ++rx_next;
+            }
+        }
+
+        void sendAck() {
+            const uint32_t bitmap = rx_bitmap >> 1;
+            const uint8_t msg[ACK_SIZE] {
+                TYPE_ACK,
+                rx_id,
+                (uint8_t)(rx_next & 0xFF),
+                (uint8_t)(rx_next >> 8),
+                (uint8_t)(bitmap),
+                (uint8_t)(bitmap >> 8),
+                (uint8_t)(bitmap >> 16),
+                (uint8_t)(bitmap >> 24),
+            };
+            radio.send(index, msg, ACK_SIZE);
+        }
+    };
+
+}  // namespace es920
+}  // namespace arduino
+
+#endif  // ARDUINO_ES920_TRANSFER_H
@@ -33,16 +33,117 @@
 #define ES920_STRING_CLEAR(s) s.clear()
 #define ES920_STRING_SUBSTR(s, i, j) s.substr(i, j)
 #define ES920_STRING_ERASE(s, i, j) s.erase(i, j)
-#define ES920_STRING_TO_INT(s) std::stoi(s)
+#define ES920_STRING_TO_INT(s) std::atoi(s.c_str())
+#else  // plain host (e.g. Linux) with ofSerial compatible streams like PosixSerial
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#define ELAPSED_TIME_MS arduino::es920::hostElapsedTimeMs
+#define ES920_SERIAL_BEGIN(s, n, b) s.setup(n, b)
+#define ES920_SERIAL_END(s) s.close()
+#define ES920_READ_BYTE stream->readByte
+#define ES920_WRITE_BYTE stream->writeByte
+#define ES920_WRITE_BYTES stream->writeBytes
+#define ES920_STRING_CAST(b) std::to_string(b)
+#define ES920_STRING_SIZE(s) s.size()
+#define ES920_STRING_POP_BACK(s) s.pop_back()
+#define ES920_STRING_CLEAR(s) s.clear()
+#define ES920_STRING_SUBSTR(s, i, j) s.substr(i, j)
+#define ES920_STRING_ERASE(s, i, j) s.erase(i, j)
+#define ES920_STRING_TO_INT(s) std::atoi(s.c_str())
+#endif
+
+// constant tables are placed in flash on boards with separate program memory (e.g. AVR)
+#if defined(ARDUINO) && defined(PROGMEM) && defined(pgm_read_byte)
+#define ES920_PROGMEM PROGMEM
+#define ES920_PGM_READ_BYTE(p) pgm_read_byte(p)
+#else
+#define ES920_PROGMEM
+#define ES920_PGM_READ_BYTE(p) (*(const uint8_t*)(p))
 #endif
 
 namespace arduino {
 namespace es920 {
 
-    inline void wait(const uint64_t ms) {
-        uint64_t start_ms = ELAPSED_TIME_MS();
-        while (ELAPSED_TIME_MS() < start_ms + ms)
-            ;
+#if !defined(ARDUINO) && !defined(OF_VERSION_MAJOR)
+    inline uint32_t hostElapsedTimeMs() {
+        static const auto start = std::chrono::steady_clock::now();
+        return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+#endif
+
+    // clock policy used by Parser and ES920Base
+    // ms() : elapsed time, idle() : called in every iteration of waiting loops
+    struct DefaultClock {
+        static uint32_t ms() { return ELAPSED_TIME_MS(); }
+        static void idle() {}
+    };
+
+#ifndef ARDUINO
+    // clock which advances only when asked (for deterministic and fast tests / simulations)
+    // waiting loops advance it by tick, so begin() or config() finishes in no time
+    struct VirtualClock {
+        static uint32_t ms() { return (uint32_t)(now() / 1000); }
+        static uint64_t us() { return now(); }
+        static void idle() { now() += tick(); }
+
+        static void advance(const uint64_t us) { now() += us; }
+        static void advanceTo(const uint64_t us) { now() = std::max(now(), us); }
+        static void set(const uint64_t us) { now() = us; }
+        static void tickUs(const uint32_t us) { tick() = us; }
+
+    private:
+        static uint64_t& now() {
+            static uint64_t t {0};
+            return t;
+        }
+        static uint32_t& tick() {
+            static uint32_t t {1000};
+            return t;
+        }
+    };
+#endif
+
+    template <typename Clock = DefaultClock>
+    inline void wait(const uint32_t ms) {
+        const uint32_t start_ms = Clock::ms();
+        while (Clock::ms() - start_ms < ms) Clock::idle();
+    }
+
+    inline uint32_t toBaudrate(const Baudrate b) {
+        switch (b) {
+            case Baudrate::BD_9600:
+                return 9600;
+            case Baudrate::BD_19200:
+                return 19200;
+            case Baudrate::BD_38400:
+                return 38400;
+            case Baudrate::BD_57600:
+                return 57600;
+            case Baudrate::BD_115200:
+                return 115200;
+            case Baudrate::BD_230400:
+                return 230400;
+            default:
+                return 115200;
+        }
+    }
+
+    // number of selectable channels
+    inline uint8_t channelCount(const Rate r) {
+        return (r == Rate::RATE_100KBPS) ? 19 : 38;
+    }
+
+    inline uint8_t channelCount(const BW bw) {
+        switch (bw) {
+            case BW::BW_250_KHZ:
+                return 7;
+            case BW::BW_500_KHZ:
+                return 5;
+            default:
+                return 15;
+        }
     }
 
     inline bool disableAndReturn(bool& b) {
@@ -0,0 +1,253 @@
+// throughput of AsciiParser / BinaryParser::feed()
+// g++ -std=c++17 -O2 -I<path/to/libraries> parser_benchmark.cpp -o parser_benchmark
+// ./parser_benchmark                      : synthetic streams
+// ./parser_benchmark ascii|binary <file> [--model es920|es920lr]  : recorded raw bytes (received from module, default es920)
+// ./parser_benchmark <capture file> [--model es920|es920lr]        : RX bytes of CaptureWriter with its model / rssi / rcvid / format
+//                                                                   (--model only for version 1 captures without model)
+
+#include <ES920.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCHMARK_RDTSC_ENABLE
+#endif
+
+// count heap allocations of the whole process
+static size_t g_allocs {0};
+
+void* operator new(std::size_t size) {
+    ++g_allocs;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+    using namespace arduino::es920;
+
+    struct Stream {
+        std::vector<uint8_t> bytes;
+        size_t packets {0};
+    };
+
+    struct Result {
+        double bytes_per_sec;
+        double packets_per_sec;
+        double allocs_per_packet;
+        double cycles_per_byte;
+    };
+
+    uint64_t cycles() {
+#ifdef BENCHMARK_RDTSC_ENABLE
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    void fill(std::vector<uint8_t>& data, const size_t size, const bool b_ascii) {
+        data.resize(size);
+        for (size_t i = 0; i < size; ++i)
+            data[i] = b_ascii ? (uint8_t)('0' + (i % 43)) : (uint8_t)(i * 7 + 1);
+    }
+
+    // rssi and rcvid header in the format of each module
+    std::string header(const bool b_lr, const bool b_rssi, const bool b_rcvid) {
+        std::string h;
+        if (b_rssi) h += b_lr ? "-060" : "78";
+        if (b_rcvid) h += b_lr ? "00010002" : "000100020002";
+        return h;
+    }
+
+    Stream asciiStream(const bool b_lr, const bool b_rssi, const bool b_rcvid, const size_t size, const size_t packets) {
+        Stream s;
+        std::vector<uint8_t> data;
+        fill(data, size, true);
+        const std::string h = header(b_lr, b_rssi, b_rcvid);
+        for (size_t i = 0; i < packets; ++i) {
+            s.bytes.insert(s.bytes.end(), h.begin(), h.end());
+            s.bytes.insert(s.bytes.end(), data.begin(), data.end());
+            s.bytes.push_back('\r');
+            s.bytes.push_back('\n');
+        }
+        s.packets = packets;
+        return s;
+    }
+
+    Stream binaryStream(const bool b_lr, const bool b_rssi, const bool b_rcvid, const size_t size, const size_t packets) {
+        Stream s;
+        std::vector<uint8_t> data;
+        fill(data, size, false);
+        Packetizer::Encoder<Packetizer::encoding::COBS> packer;
+        packer.encode(0x01, data.data(), data.size(), true);
+        const std::string h = header(b_lr, b_rssi, b_rcvid);
+        for (size_t i = 0; i < packets; ++i) {
+            s.bytes.push_back((uint8_t)(h.size() + ES920_EXT_HEADER_SIZE + packer.size()));
+            s.bytes.insert(s.bytes.end(), h.begin(), h.end());
+            s.bytes.insert(s.bytes.end(), (size_t)ES920_EXT_HEADER_SIZE, (uint8_t)0x00);  // no flags (not compressed, no sequence)
+            s.bytes.insert(s.bytes.end(), packer.data(), packer.data() + packer.size());
+        }
+        s.packets = packets;
+        return s;
+    }
+
+    // feed the stream repeatedly for at least min_sec
+    template <typename Feed>
+    Result measure(const Stream& s, const Feed& feed, const double min_sec = 0.05) {
+        size_t rounds = 0;
+        size_t allocs = 0;
+        uint64_t cyc = 0;
+        const auto start = std::chrono::steady_clock::now();
+        double sec = 0.;
+        while (sec < min_sec) {
+            const size_t a = g_allocs;
+            const uint64_t c = cycles();
+            feed(s.bytes.data(), s.bytes.size());
+            cyc += cycles() - c;
+            allocs += g_allocs - a;
+            ++rounds;
+            sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        const double bytes = (double)s.bytes.size() * (double)rounds;
+        const double packets = (double)s.packets * (double)rounds;
+        Result r;
+        r.bytes_per_sec = bytes / sec;
+        r.packets_per_sec = packets / sec;
+        r.allocs_per_packet = packets ? (double)allocs / packets : 0.;
+        r.cycles_per_byte = (double)cyc / bytes;
+        return r;
+    }
+
+    template <uint8_t PAYLOAD_SIZE>
+    Result benchAscii(const Stream& s, const bool b_rssi, const bool b_rcvid, const bool b_exec_cb) {
+        AsciiParser<PAYLOAD_SIZE> parser;
+        size_t received = 0;
+        parser.subscribe([&](const StringType& str) { received += str.size(); });
+        return measure(s, [&](const uint8_t* data, const size_t size) {
+            for (size_t i = 0; i < size; ++i) parser.feed((char)data[i], b_rssi, b_rcvid, b_exec_cb);
+            while (parser.available()) parser.pop();
+        });
+    }
+
+    template <uint8_t PAYLOAD_SIZE>
+    Result benchBinary(const Stream& s, const bool b_rssi, const bool b_rcvid, const bool b_exec_cb) {
+        BinaryParser<PAYLOAD_SIZE> parser;
+        size_t received = 0;
+        parser.subscribe([&](const uint8_t, const uint8_t*, const size_t size) { received += size; });
+        return measure(s, [&](const uint8_t* data, const size_t size) {
+            for (size_t i = 0; i < size; ++i) parser.feed(data[i], b_rssi, b_rcvid, b_exec_cb);
+            while (parser.available()) parser.pop();
+        });
+    }
+
+    void print(const char* parser, const char* module, const bool b_rssi, const bool b_rcvid, const size_t size, const bool b_exec_cb, const Result& r) {
+        std::printf("%s,%s,%d,%d,%zu,%d,%.0f,%.0f,%.3f,%.2f\n",
+            parser, module, b_rssi, b_rcvid, size, b_exec_cb,
+            r.bytes_per_sec, r.packets_per_sec, r.allocs_per_packet, r.cycles_per_byte);
+    }
+
+    template <uint8_t PAYLOAD_SIZE>
+    void benchSynthetic(const char* module) {
+        const bool b_lr = (PAYLOAD_SIZE == PAYLOAD_SIZE_ES920LR);
+        const size_t max_ascii = PAYLOAD_SIZE - 2;
+        const size_t max_binary = PAYLOAD_SIZE - 4 - ES920_EXT_HEADER_SIZE;
+        const size_t packets = 1000;
+        for (int opt = 0; opt < 4; ++opt) {
+            const bool b_rssi = opt & 1;
+            const bool b_rcvid = opt & 2;
+            for (const size_t size : {(size_t)8, (size_t)32, max_ascii}) {
+                const Stream s = asciiStream(b_lr, b_rssi, b_rcvid, size, packets);
+                for (const bool b_cb : {false, true})
+                    print("ascii", module, b_rssi, b_rcvid, size, b_cb, benchAscii<PAYLOAD_SIZE>(s, b_rssi, b_rcvid, b_cb));
+            }
+            for (const size_t size : {(size_t)8, (size_t)32, max_binary}) {
+                const Stream s = binaryStream(b_lr, b_rssi, b_rcvid, size, packets);
+                for (const bool b_cb : {false, true})
+                    print("binary", module, b_rssi, b_rcvid, size, b_cb, benchBinary<PAYLOAD_SIZE>(s, b_rssi, b_rcvid, b_cb));
+            }
+        }
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    // --model is taken out of positional arguments
+    uint8_t payload_size = PAYLOAD_SIZE_ES920;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        const std::string a = argv[i];
+        if ((a == "--model") && (i + 1 < argc)) {
+            const std::string m = argv[++i];
+            if (m == "es920lr")
+                payload_size = PAYLOAD_SIZE_ES920LR;
+            else if (m != "es920") {
+                std::cerr << "unknown model " << m << " (es920 or es920lr)" << std::endl;
+                return 1;
+            }
+        } else
+            args.push_back(a);
+    }
+    const bool b_lr = (payload_size == PAYLOAD_SIZE_ES920LR);
+
+    std::printf("parser,module,rssi,rcvid,size,exec_cb,bytes_per_sec,packets_per_sec,allocs_per_packet,cycles_per_byte\n");
+
+    if (args.size() == 1) {
+        CaptureReader reader;
+        if (!reader.open(args[0]) || !reader.hasConfig()) {
+            std::cerr << "cannot read capture file " << args[0] << std::endl;
+            return 1;
+        }
+        const Config& c = reader.config();
+        const bool b_ascii = (c.format == Format::ASCII);
+        Stream s;
+        const std::string rx = reader.bytes(Direction::RX);
+        s.bytes.assign(rx.begin(), rx.end());
+        for (size_t i = 0; i < s.bytes.size(); ++i)
+            if (s.bytes[i] == (b_ascii ? '\n' : 0x00)) ++s.packets;
+        // model recorded in capture file, or --model for old captures
+        const bool b_lr_capture = reader.payloadSize() ? (reader.payloadSize() == PAYLOAD_SIZE_ES920LR) : b_lr;
+        for (const bool b_cb : {false, true}) {
+            const char* module = b_lr_capture ? "ES920LR" : "ES920";
+            if (b_ascii)
+                print("ascii", module, c.rssi, c.rcvid, 0, b_cb, b_lr_capture ? benchAscii<PAYLOAD_SIZE_ES920LR>(s, c.rssi, c.rcvid, b_cb) : benchAscii<PAYLOAD_SIZE_ES920>(s, c.rssi, c.rcvid, b_cb));
+            else
+                print("binary", module, c.rssi, c.rcvid, 0, b_cb, b_lr_capture ? benchBinary<PAYLOAD_SIZE_ES920LR>(s, c.rssi, c.rcvid, b_cb) : benchBinary<PAYLOAD_SIZE_ES920>(s, c.rssi, c.rcvid, b_cb));
+        }
+        return 0;
+    }
+
+    if (args.size() >= 2) {
+        // recorded stream, rssi / rcvid are off and packets are counted by terminators
+        std::ifstream f(args[1], std::ios::binary);
+        if (!f) {
+            std::cerr << "cannot open " << args[1] << std::endl;
+            return 1;
+        }
+        Stream s;
+        s.bytes.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        const bool b_ascii = (args[0] == "ascii");
+        for (size_t i = 0; i < s.bytes.size(); ++i)
+            if (s.bytes[i] == (b_ascii ? '\n' : 0x00)) ++s.packets;
+        for (const bool b_cb : {false, true}) {
+            const char* module = b_lr ? "ES920LR" : "ES920";
+            if (b_ascii)
+                print("ascii", module, false, false, 0, b_cb, b_lr ? benchAscii<PAYLOAD_SIZE_ES920LR>(s, false, false, b_cb) : benchAscii<PAYLOAD_SIZE_ES920>(s, false, false, b_cb));
+            else
+                print("binary", module, false, false, 0, b_cb, b_lr ? benchBinary<PAYLOAD_SIZE_ES920LR>(s, false, false, b_cb) : benchBinary<PAYLOAD_SIZE_ES920>(s, false, false, b_cb));
+        }
+        return 0;
+    }
+
+    benchSynthetic<PAYLOAD_SIZE_ES920>("ES920");
+    benchSynthetic<PAYLOAD_SIZE_ES920LR>("ES920LR");
+    return 0;
+}
@@ -0,0 +1,476 @@
+// end-to-end send latency and goodput between two modules
+// g++ -std=c++17 -O2 -I<path/to/libraries> send_benchmark.cpp -o send_benchmark
+// ./send_benchmark [options]                            : two virtual modules (virtual clock)
+// ./send_benchmark --device /dev/ttyUSB0 /dev/ttyUSB1   : two real modules
+// ./send_benchmark bonded [options]                     : BondedLink over 1-3 virtual module pairs
+// ./send_benchmark fec [options]                        : FecCodec vs module retry on lossy virtual link
+//
+// options
+//   --model es920|es920lr  : only this model (default : both)
+//   --baud 115200          : only this baudrate (default : all, real modules : 115200)
+//   --packets 20           : packets per case
+//   --size 0               : data bytes per packet (default : max of each mode)
+
+#include <ES920.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+    using namespace arduino::es920;
+
+    constexpr uint8_t INDEX {0x01};
+    constexpr uint16_t PANID {0x0001};
+    constexpr uint16_t ID_A {0x0001};
+    constexpr uint16_t ID_B {0x0002};
+    constexpr uint32_t REPLY_TIMEOUT_MS {10000};
+    constexpr uint32_t GIVEUP_MS {20000};
+
+    struct Options {
+        int model {-1};  // -1 : both, 0 : ES920, 1 : ES920LR
+        int baud {0};    // 0 : all
+        size_t packets {20};
+        size_t size {0};
+        std::vector<std::string> devices;
+    };
+
+    struct Case {
+        bool b_lr;
+        Baudrate baud;
+        Rate rate;
+        SF sf;
+        BW bw;
+        Format format;
+        TransMode transmode;
+        bool ack;
+    };
+
+    struct Result {
+        size_t sent {0};  // replied "OK"
+        size_t errors {0};
+        size_t timeouts {0};
+        size_t delivered {0};
+        size_t size {0};
+        std::vector<uint64_t> reply_us;   // send -> "OK"
+        std::vector<uint64_t> oneway_us;  // send -> received by the other module
+        double goodput_bps {0.};
+    };
+
+    // current time in microseconds on the clock used by radio
+    template <typename Clock>
+    struct Micros {
+        static uint64_t now() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    };
+    template <>
+    struct Micros<VirtualClock> {
+        static uint64_t now() { return VirtualClock::us(); }
+    };
+
+    Config config(const Case& c, const uint16_t own, const uint16_t dst) {
+        Config cfg;
+        cfg.operation = Mode::OPERATION;
+        cfg.baudrate = c.baud;
+        cfg.rate = c.rate;
+        cfg.sf = c.sf;
+        cfg.bw = c.bw;
+        cfg.format = c.format;
+        cfg.transmode = c.transmode;
+        cfg.ack = c.ack;
+        cfg.panid = PANID;
+        cfg.ownid = own;
+        cfg.dstid = dst;
+        return cfg;
+    }
+
+    size_t maxSize(const Case& c, const uint8_t payload_size) {
+        const size_t full = payload_size + 4;  // PAYLOAD_SIZE
+        if (c.format == Format::ASCII)
+            return (c.transmode == TransMode::FRAME) ? full - 2 - 8 : full - 2;
+        else
+            return (c.transmode == TransMode::FRAME) ? full - 4 - 8 : full - 4;
+    }
+
+    // sends packets one by one and waits for both "OK" and reception
+    template <typename Radio, typename Clock, typename Pump>
+    Result run(Radio& a, Radio& b, const Case& c, const Options& opt, const Pump& pump) {
+        Result r;
+        r.size = opt.size ? std::min(opt.size, maxSize(c, Radio::payloadSize())) : maxSize(c, Radio::payloadSize());
+
+        uint64_t sent_us = 0;
+        bool b_received = false;
+        size_t delivered_bytes = 0;
+        const auto on_receive = [&](const size_t size) {
+            r.oneway_us.push_back(Micros<Clock>::now() - sent_us);
+            ++r.delivered;
+            delivered_bytes += size;
+            b_received = true;
+        };
+        if (c.format == Format::ASCII)
+            b.subscribe([&](const StringType& str) { on_receive(str.size()); });
+        else
+            b.subscribe(INDEX, [&](const uint8_t*, const size_t size) { on_receive(size); });
+
+        std::vector<uint8_t> data(r.size);
+        StringType str;
+        const uint64_t start_us = Micros<Clock>::now();
+        for (size_t i = 0; i < opt.packets; ++i) {
+            for (size_t j = 0; j < data.size(); ++j) data[j] = (uint8_t)('0' + ((i + j) % 43));
+            str.assign(data.begin(), data.end());
+
+            bool b_replied = false;
+            b_received = false;
+            const ReplyCallbackType on_reply = [&](const Reply& reply) {
+                b_replied = true;
+                if (reply.success()) {
+                    ++r.sent;
+                    r.reply_us.push_back(Micros<Clock>::now() - sent_us);
+                } else if (reply.b_timeout)
+                    ++r.timeouts;
+                else
+                    ++r.errors;
+            };
+            const uint32_t timeout_ms = c.ack ? REPLY_TIMEOUT_MS : 0;
+
+            sent_us = Micros<Clock>::now();
+            bool b_sent = false;
+            if (c.format == Format::ASCII) {
+                if (c.transmode == TransMode::FRAME)
+                    b_sent = a.sendAsync(PANID, ID_B, str, on_reply, timeout_ms);
+                else
+                    b_sent = a.sendAsync(str, on_reply, timeout_ms);
+            } else {
+                if (c.transmode == TransMode::FRAME)
+                    b_sent = a.sendAsync(PANID, ID_B, INDEX, data.data(), (uint8_t)data.size(), on_reply, timeout_ms);
+                else
+                    b_sent = a.sendAsync(INDEX, data.data(), (uint8_t)data.size(), on_reply, timeout_ms);
+            }
+            if (!b_sent) {
+                ++r.errors;
+                continue;
+            }
+
+            // frame can be lost without ack, so give up waiting after a while
+            const uint32_t giveup_start_ms = Clock::ms();
+            while (!(b_replied && b_received) && (Clock::ms() - giveup_start_ms < GIVEUP_MS)) {
+                a.parse();
+                b.parse();
+                pump();
+            }
+        }
+        const uint64_t elapsed_us = Micros<Clock>::now() - start_us;
+        r.goodput_bps = elapsed_us ? (double)delivered_bytes * 8. * 1000000. / (double)elapsed_us : 0.;
+        return r;
+    }
+
+    double percentile(std::vector<uint64_t>& v, const double q) {
+        if (v.empty()) return 0.;
+        std::sort(v.begin(), v.end());
+        const size_t i = std::min(v.size() - 1, (size_t)(q * (double)v.size()));
+        return (double)v[i] / 1000.;
+    }
+
+    const char* header() {
+        return "model,baudrate,rate_kbps,sf,bw_khz,format,transmode,ack,size,packets,sent,errors,timeouts,delivered,"
+               "reply_p50_ms,reply_p90_ms,reply_p99_ms,reply_max_ms,oneway_p50_ms,oneway_p90_ms,oneway_p99_ms,oneway_max_ms,goodput_bps";
+    }
+
+    void print(const Case& c, const Options& opt, Result& r) {
+        std::printf("%s,%lu,%d,%d,%.1f,%s,%s,%d,%zu,%zu,%zu,%zu,%zu,%zu,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.1f\n",
+            c.b_lr ? "ES920LR" : "ES920", (unsigned long)toBaudrate(c.baud),
+            c.b_lr ? 0 : ((c.rate == Rate::RATE_100KBPS) ? 100 : 50), c.b_lr ? (int)c.sf : 0, c.b_lr ? airtime::bandwidthHz(c.bw) / 1000. : 0.,
+            (c.format == Format::ASCII) ? "ascii" : "binary",
+            (c.transmode == TransMode::FRAME) ? "frame" : "payload",
+            c.ack, r.size, opt.packets, r.sent, r.errors, r.timeouts, r.delivered,
+            percentile(r.reply_us, 0.5), percentile(r.reply_us, 0.9), percentile(r.reply_us, 0.99), percentile(r.reply_us, 1.),
+            percentile(r.oneway_us, 0.5), percentile(r.oneway_us, 0.9), percentile(r.oneway_us, 0.99), percentile(r.oneway_us, 1.),
+            r.goodput_bps);
+        std::fflush(stdout);
+    }
+
+    std::vector<Case> cases(const bool b_lr, const Options& opt, const std::vector<Baudrate>& bauds) {
+        std::vector<Case> v;
+        std::vector<Rate> rates {Rate::RATE_50KBPS};
+        std::vector<SF> sfs {SF::SF_7};
+        std::vector<BW> bws {BW::BW_125_KHZ};
+        if (b_lr) {
+            sfs = {SF::SF_7, SF::SF_8, SF::SF_9, SF::SF_10, SF::SF_11, SF::SF_12};
+            bws = {BW::BW_62_5_KHZ, BW::BW_125_KHZ, BW::BW_250_KHZ, BW::BW_500_KHZ};
+        } else
+            rates = {Rate::RATE_50KBPS, Rate::RATE_100KBPS};
+
+        for (const Baudrate baud : bauds) {
+            if (opt.baud && ((int)toBaudrate(baud) != opt.baud)) continue;
+            for (const Rate rate : rates)
+                for (const SF sf : sfs)
+                    for (const BW bw : bws)
+                        for (const Format format : {Format::ASCII, Format::BINARY})
+                            for (const TransMode tm : {TransMode::PAYLOAD, TransMode::FRAME})
+                                for (const bool ack : {false, true})
+                                    v.push_back(Case {b_lr, baud, rate, sf, bw, format, tm, ack});
+        }
+        return v;
+    }
+
+    const std::vector<Baudrate> all_bauds {
+        Baudrate::BD_9600, Baudrate::BD_19200, Baudrate::BD_38400,
+        Baudrate::BD_57600, Baudrate::BD_115200, Baudrate::BD_230400};
+
+    // two virtual modules on one AirLink, time jumps to next event
+    template <typename Radio>
+    void benchVirtual(const bool b_lr, const Options& opt) {
+        const VirtualModule::Model model = b_lr ? VirtualModule::Model::ES920LR : VirtualModule::Model::ES920;
+        for (const Case& c : cases(b_lr, opt, all_bauds)) {
+            AirLink air;
+            air.virtualClock(true);
+            VirtualModule va(model), vb(model);
+            air.attach(va);
+            air.attach(vb);
+            Radio a, b;
+            a.resetTrigger([&] { va.reset(); });
+            b.resetTrigger([&] { vb.reset(); });
+            if (!a.begin(va, config(c, ID_A, ID_B)) || !b.begin(vb, config(c, ID_B, ID_A))) {
+                std::cerr << "begin failed" << std::endl;
+                continue;
+            }
+
+            Result r = run<Radio, VirtualClock>(a, b, c, opt, [&] {
+                const uint64_t t = std::min({air.nextEventUs(), va.nextEventUs(), vb.nextEventUs()});
+                if (t == UINT64_MAX)
+                    VirtualClock::idle();
+                else
+                    air.advance(t);
+            });
+            print(c, opt, r);
+        }
+    }
+
+#ifdef ES920_GATEWAY_POLL_ENABLE
+    // two real modules on serial ports, baudrate is fixed because module may not come back from other baudrate
+    template <typename Radio>
+    void benchDevice(const bool b_lr, Options opt) {
+        if (!opt.baud) opt.baud = 115200;
+        for (const Case& c : cases(b_lr, opt, all_bauds)) {
+            PosixSerial sa, sb;
+            Radio a, b;
+            Config ca = config(c, ID_A, ID_B);
+            Config cb = config(c, ID_B, ID_A);
+            ca.device = opt.devices[0];
+            cb.device = opt.devices[1];
+            if (!a.begin(sa, ca) || !b.begin(sb, cb)) {
+                std::cerr << "begin failed" << std::endl;
+                return;
+            }
+            Result r = run<Radio, DefaultClock>(a, b, c, opt, [] {});
+            print(c, opt, r);
+        }
+    }
+#endif
+
+    // BondedLink over 1-3 module pairs on different channels
+    template <typename Radio>
+    void benchBonded(const bool b_lr, const Options& opt) {
+        const VirtualModule::Model model = b_lr ? VirtualModule::Model::ES920LR : VirtualModule::Model::ES920;
+        const size_t total = opt.packets * (Radio::payloadSize() - 2);
+
+        for (uint8_t n = 1; n <= 3; ++n) {
+            AirLink air;
+            air.virtualClock(true);
+            std::vector<std::unique_ptr<VirtualModule>> vms;
+            Gateway tx, rx;
+            std::vector<uint8_t> ids;
+            bool b_begin = true;
+            for (uint8_t i = 0; i < n; ++i) {
+                Case c {b_lr, Baudrate::BD_115200, Rate::RATE_50KBPS, SF::SF_7, BW::BW_125_KHZ, Format::BINARY, TransMode::PAYLOAD, true};
+                for (uint8_t side = 0; side < 2; ++side) {
+                    vms.emplace_back(new VirtualModule(model));
+                    VirtualModule* vm = vms.back().get();
+                    air.attach(*vm);
+                    Gateway& gw = side ? rx : tx;
+                    Radio& radio = gw.add<Radio>(i, *vm);
+                    radio.resetTrigger([vm] { vm->reset(); });
+                    Config cfg = side ? config(c, ID_B, ID_A) : config(c, ID_A, ID_B);
+                    cfg.channel = (uint8_t)(1 + i);
+                    b_begin &= gw.begin(i, cfg);
+                }
+                ids.push_back(i);
+            }
+            if (!b_begin) {
+                std::cerr << "begin failed" << std::endl;
+                continue;
+            }
+
+            BondedLink sender(tx, ids, INDEX), receiver(rx, ids, INDEX);
+            size_t received = 0;
+            receiver.subscribe([&](const uint8_t*, const size_t size) { received += size; });
+            std::vector<uint8_t> data(total);
+            for (size_t i = 0; i < total; ++i) data[i] = (uint8_t)i;
+
+            const uint64_t start_us = VirtualClock::us();
+            sender.write(data.data(), data.size());
+            while ((received < total) && (VirtualClock::ms() - start_us / 1000 < 600000)) {
+                tx.update();
+                rx.update();
+                sender.update();
+                receiver.update();
+                uint64_t t = air.nextEventUs();
+                for (auto& vm : vms) t = std::min(t, vm->nextEventUs());
+                if (t == UINT64_MAX)
+                    VirtualClock::idle();
+                else
+                    air.advance(t);
+            }
+            const uint64_t elapsed_us = VirtualClock::us() - start_us;
+            std::printf("%s,%u,%zu,%zu,%zu,%zu,%.3f,%.1f\n",
+                b_lr ? "ES920LR" : "ES920", n, total, received,
+                sender.sentFrames(), sender.resentFrames(), (double)elapsed_us / 1000000.,
+                elapsed_us ? (double)received * 8. * 1000000. / (double)elapsed_us : 0.);
+            std::fflush(stdout);
+        }
+    }
+
+    // goodput on lossy link : module ack and retry (stop-and-wait) vs FecCodec without ack
+    // mode : retry (ack on), none (ack off, no fec), fec (ack off, k data + m parity frames)
+    template <typename Radio>
+    void benchFec(const bool b_lr, const Options& opt) {
+        using Codec = FecCodec<Radio, VirtualClock>;
+        const VirtualModule::Model model = b_lr ? VirtualModule::Model::ES920LR : VirtualModule::Model::ES920;
+        const uint8_t size = Codec::maxSize();
+        struct Mode {
+            const char* name;
+            bool ack;
+            uint8_t k;
+            uint8_t m;
+        };
+        const Mode modes[] {{"retry", true, 0, 0}, {"none", false, 0, 0}, {"fec", false, 4, 2}, {"fec", false, 8, 2}, {"fec", false, 8, 4}};
+
+        for (const float loss : {0.f, 0.05f, 0.1f, 0.2f, 0.3f}) {
+            for (const Mode& mode : modes) {
+                AirLink air;
+                air.virtualClock(true);
+                VirtualModule va(model), vb(model);
+                air.attach(va);
+                air.attach(vb);
+                Radio a, b;
+                a.resetTrigger([&] { va.reset(); });
+                b.resetTrigger([&] { vb.reset(); });
+                Case c {b_lr, Baudrate::BD_115200, Rate::RATE_50KBPS, SF::SF_10, BW::BW_125_KHZ, Format::BINARY, TransMode::PAYLOAD, mode.ack};
+                if (!a.begin(va, config(c, ID_A, ID_B)) || !b.begin(vb, config(c, ID_B, ID_A))) {
+                    std::cerr << "begin failed" << std::endl;
+                    continue;
+                }
+                air.lossRate(loss);
+
+                Codec tx(a), rx(b);
+                tx.redundancy(mode.k, mode.m);
+                tx.replyTimeout(REPLY_TIMEOUT_MS);
+                std::set<uint16_t> delivered;
+                rx.subscribe(INDEX, [&](const uint8_t* data, const size_t) { delivered.insert((uint16_t)(data[0] | (data[1] << 8))); });
+
+                const auto pump = [&] {
+                    a.parse();
+                    b.parse();
+                    tx.update();
+                    const uint64_t t = std::min({air.nextEventUs(), va.nextEventUs(), vb.nextEventUs()});
+                    if (t == UINT64_MAX)
+                        VirtualClock::idle();
+                    else
+                        air.advance(t);
+                };
+
+                std::vector<uint8_t> data(size);
+                const uint64_t start_us = VirtualClock::us();
+                for (size_t i = 0; i < opt.packets; ++i) {
+                    data[0] = (uint8_t)i;
+                    data[1] = (uint8_t)(i >> 8);
+                    const uint32_t giveup_start_ms = VirtualClock::ms();
+                    while (!tx.send(INDEX, data.data(), size) && (VirtualClock::ms() - giveup_start_ms < GIVEUP_MS)) pump();
+                }
+                tx.flush();
+                while (tx.busy()) pump();
+                const uint64_t end_us = VirtualClock::us();
+                while (VirtualClock::us() - end_us < 1000000) pump();  // frames on the air
+
+                const uint64_t elapsed_us = end_us - start_us;
+                std::printf("%s,%s,%u,%u,%.2f,%u,%zu,%zu,%zu,%zu,%zu,%.3f,%.1f\n",
+                    b_lr ? "ES920LR" : "ES920", mode.name, mode.k, mode.m, loss, size, opt.packets, delivered.size(),
+                    (size_t)rx.stats().recovered, air.sentFrames(), air.retriedFrames(), (double)elapsed_us / 1000000.,
+                    elapsed_us ? (double)(delivered.size() * size) * 8. * 1000000. / (double)elapsed_us : 0.);
+                std::fflush(stdout);
+            }
+        }
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    bool b_bonded = false;
+    bool b_fec = false;
+    bool b_packets = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "bonded")
+            b_bonded = true;
+        else if (arg == "fec")
+            b_fec = true;
+        else if ((arg == "--model") && (i + 1 < argc)) {
+            const std::string m = argv[++i];
+            opt.model = (m == "es920lr") ? 1 : 0;
+        } else if ((arg == "--baud") && (i + 1 < argc))
+            opt.baud = std::atoi(argv[++i]);
+        else if ((arg == "--packets") && (i + 1 < argc)) {
+            opt.packets = (size_t)std::atoi(argv[++i]);
+            b_packets = true;
+        }
+        else if ((arg == "--size") && (i + 1 < argc))
+            opt.size = (size_t)std::atoi(argv[++i]);
+        else if ((arg == "--device") && (i + 2 < argc)) {
+            opt.devices.push_back(argv[++i]);
+            opt.devices.push_back(argv[++i]);
+        } else {
+            std::cerr << "unknown option : " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (b_bonded) {
+        std::printf("model,modules,bytes,received,frames,resent_frames,elapsed_sec,goodput_bps\n");
+        if (opt.model != 1) benchBonded<ES920_<VirtualModule, 0xFF, VirtualClock>>(false, opt);
+        if (opt.model != 0) benchBonded<ES920LR_<VirtualModule, 0xFF, VirtualClock>>(true, opt);
+        return 0;
+    }
+
+    if (b_fec) {
+        if (!b_packets) opt.packets = 200;
+        std::printf("model,mode,k,m,loss,size,packets,delivered,recovered,frames,retried_frames,elapsed_sec,goodput_bps\n");
+        if (opt.model != 1) benchFec<ES920_<VirtualModule, 0xFF, VirtualClock>>(false, opt);
+        if (opt.model != 0) benchFec<ES920LR_<VirtualModule, 0xFF, VirtualClock>>(true, opt);
+        return 0;
+    }
+
+    std::printf("%s\n", header());
+    if (!opt.devices.empty()) {
+#ifdef ES920_GATEWAY_POLL_ENABLE
+        if (opt.model == 1)
+            benchDevice<ES920LR_<PosixSerial>>(true, opt);
+        else
+            benchDevice<ES920_<PosixSerial>>(false, opt);
+        return 0;
+#else
+        std::cerr << "serial port is not supported on this platform" << std::endl;
+        return 1;
+#endif
+    }
+
+    if (opt.model != 1) benchVirtual<ES920_<VirtualModule, 0xFF, VirtualClock>>(false, opt);
+    if (opt.model != 0) benchVirtual<ES920LR_<VirtualModule, 0xFF, VirtualClock>>(true, opt);
+    return 0;
+}
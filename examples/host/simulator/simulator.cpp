@@ -0,0 +1,23 @@
+// discrete-event simulation of ES920LR end devices sending to one coordinator
+// g++ -std=c++17 -O2 -I<path/to/libraries> simulator.cpp -o simulator
+
+#include <ES920.h>
+#include <iostream>
+
+int main() {
+    std::cout << ES920::SimulationResult::csvHeader() << std::endl;
+
+    for (size_t nodes = 100; nodes <= 500; nodes += 100) {
+        ES920::SimulationParams params;
+        params.nodes = nodes;
+        params.sf = ES920::SF::SF_7;
+        params.bw = ES920::BW::BW_125_KHZ;
+        params.size = 16;
+        params.interval_ms = 60000;
+        params.duration_ms = 600000;
+
+        ES920::Simulator<ES920::ES920LR_<ES920::VirtualModule, 0xFF, ES920::VirtualClock>> sim(params);
+        std::cout << sim.run().csv() << std::endl;
+    }
+    return 0;
+}
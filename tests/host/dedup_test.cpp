@@ -0,0 +1,126 @@
+// duplicated frames are dropped per source, also across a restart of the sender
+// g++ -std=c++17 -DES920_DEDUP_ENABLE -I<path/to/libraries> dedup_test.cpp -o dedup_test && ./dedup_test
+
+#ifndef ES920_DEDUP_ENABLE
+#define ES920_DEDUP_ENABLE
+#endif
+#include <ES920.h>
+#include <iostream>
+#include <optional>
+
+using namespace arduino::es920;
+
+static int g_failed {0};
+
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            std::cout << "FAILED line " << __LINE__ << " : " #cond << std::endl; \
+            ++g_failed;                                                       \
+        }                                                                     \
+    } while (0)
+
+using Radio = ES920LR_<VirtualModule, 0xFF, VirtualClock>;
+
+// two senders (ownid 1, 3) and one receiver (ownid 2) on a lossless link
+struct Net {
+    AirLink air {1};
+    VirtualModule v[3] {VirtualModule(VirtualModule::Model::ES920LR), VirtualModule(VirtualModule::Model::ES920LR), VirtualModule(VirtualModule::Model::ES920LR)};
+    std::optional<Radio> r[3];
+    Config c[3];
+    int got {0};
+
+    explicit Net(const bool b_rcvid) {
+        for (int i = 0; i < 3; ++i) {
+            air.attach(v[i]);
+            c[i].operation = Mode::OPERATION;
+            c[i].format = Format::BINARY;
+            c[i].rcvid = b_rcvid;
+            c[i].ownid = (i == 1) ? 2 : (i == 0 ? 1 : 3);
+            c[i].dstid = (i == 1) ? 1 : 2;
+        }
+        air.virtualClock(true);
+        for (int i = 0; i < 3; ++i) start(i);
+        r[1]->subscribe(1, [&](const uint8_t*, size_t) { ++got; });
+    }
+    // new library stack on the module (as after a reboot of the sender)
+    bool start(const int i) {
+        r[i].emplace();
+        VirtualModule* m = &v[i];
+        r[i]->resetTrigger([m] { m->reset(); });
+        return r[i]->begin(v[i], c[i]);
+    }
+
+    bool send(const int i) {
+        const uint8_t data[4] {1, 2, 3, 4};
+        return r[i]->send(1, data, sizeof(data), 10000);
+    }
+
+    void pump(const uint32_t ms) {
+        const uint32_t t = VirtualClock::ms();
+        while (VirtualClock::ms() - t < ms) {
+            for (auto& p : r) p->parse();
+            VirtualClock::idle();
+        }
+    }
+};
+
+int main() {
+    // sender restarts : seq counts from 0 again, new frames must not be dropped
+    {
+        Net n(true);
+        for (int i = 0; i < 20; ++i) CHECK(n.send(0));
+        n.pump(1000);
+        CHECK(n.got == 20);
+        CHECK(n.start(0));
+        for (int i = 0; i < 11; ++i) CHECK(n.send(0));
+        n.pump(1000);
+        CHECK(n.got == 31);
+        // restarted again before leaving the restart window
+        CHECK(n.start(0));
+        for (int i = 0; i < 5; ++i) CHECK(n.send(0));
+        n.pump(1000);
+        CHECK(n.got == 36);
+        CHECK(n.r[1]->stats().duplicates == 0);
+    }
+
+    // restart flag is only used for the first frames, module retries are still dropped
+    {
+        DedupTable<4> t;
+        CHECK(t.accept(0, 1, 0, true));
+        CHECK(!t.accept(0, 1, 0, true));
+        CHECK(t.accept(0, 1, 1, true));
+        CHECK(!t.accept(0, 1, 1, true));
+        CHECK(t.accept(0, 1, 32, false));
+        CHECK(!t.accept(0, 1, 32, false));
+        CHECK(t.accept(0, 1, 0, true));  // restarted
+    }
+
+    // several senders with the same seq are told apart by rcvid
+    {
+        Net n(true);
+        for (int i = 0; i < 10; ++i) {
+            CHECK(n.send(0));
+            CHECK(n.send(2));
+        }
+        n.pump(1000);
+        CHECK(n.got == 20);
+        CHECK(n.r[1]->stats().duplicates == 0);
+    }
+
+    // without rcvid sources are unknown, nothing is dropped
+    {
+        Net n(false);
+        for (int i = 0; i < 10; ++i) {
+            CHECK(n.send(0));
+            CHECK(n.send(2));
+        }
+        n.pump(1000);
+        CHECK(n.got == 20);
+        CHECK(n.r[1]->stats().duplicates == 0);
+    }
+
+    if (g_failed) return 1;
+    std::cout << "ok" << std::endl;
+    return 0;
+}
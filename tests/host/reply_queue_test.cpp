@@ -0,0 +1,161 @@
+// replies are matched to waiters in order of sends, also when the queue of waiters overflows
+// g++ -std=c++17 -I<path/to/libraries> reply_queue_test.cpp -o reply_queue_test && ./reply_queue_test
+
+#define ES920_MAX_REPLY_WAITERS 4
+#include <ES920.h>
+#include <iostream>
+
+using namespace arduino::es920;
+
+static int g_failed {0};
+
+#define CHECK(cond)                                                           \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            std::cout << "FAILED line " << __LINE__ << " : " #cond << std::endl; \
+            ++g_failed;                                                       \
+        }                                                                     \
+    } while (0)
+
+static Reply ok() {
+    return Reply();
+}
+
+static Reply ng() {
+    Reply r;
+    r.b_error = true;
+    r.code = ErrorCode::MissingAck;
+    return r;
+}
+
+int main() {
+    // fire-and-forget sends take no waiter
+    {
+        Dispatcher d;
+        for (int i = 0; i < 10; ++i) d.expectReply(0, 1000);
+        CHECK(d.pendingReplies() == 0);
+        CHECK(d.canWaitReply());
+    }
+
+    // replies of fire-and-forget sends before a waiter are skipped
+    {
+        Dispatcher d;
+        int n = 0;
+        Reply got;
+        d.expectReply(0, 1000);
+        d.expectReply(0, 1000);
+        d.waitReply(0, 1000, [&](const Reply& r) { ++n; got = r; });
+        d.expectReply(0, 1000);
+        d.onReply(ng());
+        d.onReply(ng());
+        CHECK(n == 0);
+        d.onReply(ok());
+        CHECK(n == 1);
+        CHECK(got.success());
+        d.onReply(ng());  // reply of the last fire-and-forget send
+        CHECK(n == 1);
+        CHECK(d.pendingReplies() == 0);
+    }
+
+    // overflow : waiters are rejected with timeout reply, queued ones keep their replies
+    {
+        Dispatcher d;
+        int done[6] {};
+        bool success[6] {};
+        bool timeout[6] {};
+        for (int i = 0; i < 6; ++i) {
+            const bool b = d.waitReply(0, 1000, [&, i](const Reply& r) {
+                ++done[i];
+                success[i] = r.success();
+                timeout[i] = r.b_timeout;
+            });
+            CHECK(b == (i < ES920_MAX_REPLY_WAITERS));
+        }
+        CHECK(d.pendingReplies() == ES920_MAX_REPLY_WAITERS);
+        CHECK((done[4] == 1) && timeout[4]);
+        CHECK((done[5] == 1) && timeout[5]);
+        for (int i = 0; i < 4; ++i) CHECK(done[i] == 0);
+
+        // replies of 4 waiters and 2 rejected sends
+        d.onReply(ok());
+        d.onReply(ng());
+        d.onReply(ok());
+        d.onReply(ok());
+        d.onReply(ng());
+        d.onReply(ng());
+        CHECK((done[0] == 1) && success[0]);
+        CHECK((done[1] == 1) && !success[1] && !timeout[1]);
+        CHECK((done[2] == 1) && success[2]);
+        CHECK((done[3] == 1) && success[3]);
+        CHECK((done[4] == 1) && (done[5] == 1));
+
+        // next waiter gets the next reply
+        int n = 0;
+        d.waitReply(0, 1000, [&](const Reply& r) { n += r.success(); });
+        d.onReply(ok());
+        CHECK(n == 1);
+
+        Stats s;
+        d.stats(s);
+        CHECK(s.rejected_waiters == 2);
+    }
+
+    // every waiter is completed by timeout if replies never come
+    {
+        Dispatcher d;
+        int n = 0;
+        for (int i = 0; i < 4; ++i) d.waitReply(0, 100, [&](const Reply& r) { n += r.b_timeout; });
+        d.poll(99);
+        CHECK(n == 0);
+        d.poll(100);
+        CHECK(n == 4);
+        CHECK(d.pendingReplies() == 0);
+    }
+
+    // sendAsync() is refused without writing to the module while the queue is full
+    {
+        using Radio = ES920LR_<VirtualModule, 0xFF, VirtualClock>;
+        Config c;
+        c.operation = Mode::OPERATION;
+        c.format = Format::BINARY;
+        AirLink air(1);
+        VirtualModule v1(VirtualModule::Model::ES920LR), v2(VirtualModule::Model::ES920LR);
+        air.attach(v1);
+        air.attach(v2);
+        air.virtualClock(true);
+        Radio r1, r2;
+        r1.resetTrigger([&] { v1.reset(); });
+        r2.resetTrigger([&] { v2.reset(); });
+        Config c1 = c, c2 = c;
+        c1.ownid = 1;
+        c1.dstid = 2;
+        c2.ownid = 2;
+        c2.dstid = 1;
+        CHECK(r1.begin(v1, c1));
+        CHECK(r2.begin(v2, c2));
+
+        const uint8_t data[4] {1, 2, 3, 4};
+        const Stats s0 = r1.stats();
+        int done = 0;
+        for (int i = 0; i < 3; ++i) CHECK(r1.send(1, data, sizeof(data)));
+        for (int i = 0; i < 6; ++i) {
+            const bool b = r1.sendAsync(1, data, sizeof(data), [&](const Reply&) { ++done; });
+            CHECK(b == (i < ES920_MAX_REPLY_WAITERS));
+        }
+        const uint32_t t = VirtualClock::ms();
+        while (VirtualClock::ms() - t < 30000) {
+            r1.parse();
+            r2.parse();
+            VirtualClock::idle();
+        }
+        // module replies to 7 sends (busy module replies NG to most of them), each waiter gets one of them
+        const Stats s = r1.stats();
+        CHECK(done == 4);
+        CHECK((s.replies_ok + s.ngTotal()) - (s0.replies_ok + s0.ngTotal()) == 7);
+        CHECK(s.reply_timeouts == 0);
+    }
+
+    if (g_failed) return 1;
+    std::cout << "ok" << std::endl;
+    return 0;
+}